@@ -1,19 +1,33 @@
-#include "bencode.hpp"
+#include "bencode_document.hpp"
+#include "create.hpp"
 #include "error.hpp"
-#include "lib/nlohmann/json.hpp"
 #include "peer.hpp"
 #include "spdlog/spdlog.h"
 #include "torrent.hpp"
+#include "torrent_index.hpp"
+#include "verify.hpp"
 #include <cctype>
+#include <charconv>
+#include <chrono>
 #include <cstdlib>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <system_error>
 #include <vector>
 
-using json = nlohmann::json;
+// Decimal number that is the whole of `str`, false otherwise
+template <typename T>
+static bool parse_number(std::string_view str, T& value) {
+    auto [end, ec] =
+        std::from_chars(str.data(), str.data() + str.size(), value);
+    return ec == std::errc() && end == str.data() + str.size();
+}
 
 static int torrent_info(std::string const& file_path) {
     std::error_code ec;
@@ -26,19 +40,16 @@ static int torrent_info(std::string const& file_path) {
     std::cout << "Tracker URL: " << torrent.announce << std::endl;
     std::cout << "Length: " << torrent.length << std::endl;
     std::cout << "Info Hash: " << torrent.info_hash() << std::endl;
+    if (torrent.has_v2())
+        std::cout << "Info Hash v2: "
+                  << bittorrent::to_hex(torrent.info_hash_v2_raw())
+                  << std::endl;
 
     std::cout << "Piece Length: " << torrent.piece_length << std::endl;
 
     std::cout << "Piece Hashes:" << std::endl;
-    auto piece_hashes = torrent.piece_hashes();
-    auto cout_flags = std::cout.flags();
-    for (std::string const& hash : piece_hashes) {
-        for (unsigned char c : hash)
-            std::cout << std::setw(2) << std::setfill('0') << std::hex
-                      << static_cast<unsigned int>(c);
-        std::cout << std::endl;
-        std::cout.flags(cout_flags);
-    }
+    for (bittorrent::Sha1Digest const& hash : torrent.piece_hashes())
+        std::cout << bittorrent::to_hex(hash) << std::endl;
     return 0;
 }
 
@@ -199,7 +210,8 @@ static int download_piece(std::string const& file_out,
 }
 
 static int download_file(std::string const& file_out,
-                         std::string const& torrent_path) {
+                         std::string const& torrent_path,
+                         size_t min_request_depth, size_t max_request_depth) {
     spdlog::debug("cli: downloading file");
     std::error_code ec;
 
@@ -209,6 +221,8 @@ static int download_file(std::string const& file_out,
         return 1;
     }
     bittorrent::Torrent& torrent = *get_torrent;
+    torrent.min_request_depth = min_request_depth;
+    torrent.max_request_depth = max_request_depth;
 
     spdlog::debug("cli: torrent parsed");
     ec = torrent.download_file(file_out);
@@ -223,6 +237,208 @@ static int download_file(std::string const& file_out,
     return 0;
 }
 
+static int index_torrents(int argc, char* argv[]) {
+    std::string out_path;
+    bool binary = false;
+    unsigned threads = 0;
+    std::vector<std::filesystem::path> paths;
+
+    // directories are searched for .torrent files, "-" reads paths from stdin
+    auto add_path = [&](std::filesystem::path const& path) {
+        std::error_code ec;
+        if (!std::filesystem::is_directory(path, ec)) {
+            paths.push_back(path);
+            return;
+        }
+        for (auto const& entry :
+             std::filesystem::recursive_directory_iterator(path, ec))
+            if (entry.is_regular_file() &&
+                entry.path().extension() == ".torrent")
+                paths.push_back(entry.path());
+    };
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+            out_path = argv[++i];
+        else if (arg == "-j" && i + 1 < argc) {
+            if (!parse_number(argv[++i], threads)) {
+                std::cerr << "Invalid number of threads: " << argv[i]
+                          << std::endl;
+                return 1;
+            }
+        } else if (arg == "--binary")
+            binary = true;
+        else if (arg == "-")
+            for (std::string line; std::getline(std::cin, line);)
+                add_path(line);
+        else
+            add_path(arg);
+    }
+    if (paths.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " index [-o <output_file>] [--binary] [-j <threads>] "
+                     "<torrent file|directory|->..."
+                  << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<bittorrent::IndexEntry> entries =
+        bittorrent::index_torrents(paths, threads);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    size_t failed = 0;
+    for (auto const& entry : entries) {
+        if (!entry.ec) continue;
+        std::cerr << "Error parsing torrent " << entry.path << ": "
+                  << entry.ec << std::endl;
+        failed++;
+    }
+
+    std::ofstream out_file;
+    if (!out_path.empty()) {
+        out_file.open(out_path, std::ios::binary);
+        if (!out_file) {
+            std::cerr << "Error opening " << out_path << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = out_path.empty() ? std::cout : out_file;
+    if (binary)
+        bittorrent::write_index_binary(entries, out);
+    else
+        bittorrent::write_index_csv(entries, out);
+
+    std::cerr << "Indexed " << entries.size() - failed << " torrents ("
+              << failed << " failed) in " << elapsed.count() << " s, "
+              << static_cast<size_t>(entries.size() /
+                                     std::max(elapsed.count(), 1e-9))
+              << " files/s" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+static int verify(int argc, char* argv[]) {
+    unsigned threads = 0;
+    std::vector<std::string> args;
+    bool valid = true;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            valid = parse_number(argv[++i], threads) && valid;
+        else
+            args.push_back(arg);
+    }
+    if (!valid || args.size() != 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " verify [-j <threads>] <torrent file> <path>"
+                  << std::endl;
+        return 1;
+    }
+
+    std::error_code ec;
+    auto torrent = bittorrent::Torrent::parse_torrent(args[0], ec);
+    if (!torrent) {
+        std::cerr << "Error parsing torrent: " << ec << std::endl;
+        return 1;
+    }
+
+    bittorrent::VerifyReport report =
+        bittorrent::verify_content(*torrent, args[1], threads);
+    for (auto const& [path, file_ec] : report.file_errors)
+        std::cerr << "Error reading " << path << ": " << file_ec.message()
+                  << std::endl;
+
+    std::cout << "Pieces: " << report.piece_count - report.mismatches.size()
+              << "/" << report.piece_count << " OK" << std::endl;
+    std::cout << "Bitfield: " << bittorrent::to_hex(report.bitfield)
+              << std::endl;
+    if (!report.mismatches.empty()) {
+        std::cout << "Mismatching pieces:";
+        for (size_t index : report.mismatches) std::cout << ' ' << index;
+        std::cout << std::endl;
+    }
+    std::cerr << "Hashed " << report.bytes_hashed << " bytes in "
+              << report.elapsed.count() << " s, "
+              << report.bytes_hashed / report.elapsed.count() / 1e9
+              << " GB/s" << std::endl;
+    return report.mismatches.empty() ? 0 : 1;
+}
+
+static int create(int argc, char* argv[]) {
+    std::string out_path;
+    bittorrent::CreateOptions options;
+    std::vector<std::string> args;
+    bool valid = true;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+            out_path = argv[++i];
+        else if (arg == "--piece-length" && i + 1 < argc)
+            valid = parse_number(argv[++i], options.piece_length) && valid;
+        else if (arg == "--announce" && i + 1 < argc)
+            options.announce = argv[++i];
+        else if (arg == "-j" && i + 1 < argc)
+            valid = parse_number(argv[++i], options.threads) && valid;
+        else
+            args.push_back(arg);
+    }
+    if (!valid || out_path.empty() || args.size() != 1) {
+        std::cerr << "Usage: " << argv[0]
+                  << " create -o <output_file> [--piece-length <bytes>] "
+                     "[--announce <url>] [-j <threads>] <path>"
+                  << std::endl;
+        return 1;
+    }
+
+    // redrawn at most 10 times per second, on stderr
+    auto start = std::chrono::steady_clock::now();
+    auto last_draw = start - std::chrono::seconds(1);
+    options.progress = [&](uint64_t hashed, uint64_t total) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_draw < std::chrono::milliseconds(100) && hashed < total)
+            return;
+        last_draw = now;
+        std::chrono::duration<double> elapsed = now - start;
+        std::cerr << "\rHashed " << hashed / (1 << 20) << "/"
+                  << total / (1 << 20) << " MiB ("
+                  << (total == 0 ? 100 : hashed * 100 / total) << "%), "
+                  << std::fixed << std::setprecision(1)
+                  << hashed / std::max(elapsed.count(), 1e-9) / 1e6
+                  << " MB/s   " << std::defaultfloat << std::setprecision(6)
+                  << std::flush;
+    };
+
+    std::error_code ec;
+    auto report = bittorrent::create_torrent(args[0], options, ec);
+    std::cerr << std::endl;
+    if (!report) {
+        std::cerr << "Error creating torrent: " << ec << std::endl;
+        return 1;
+    }
+
+    std::ofstream out(out_path, std::ios::binary);
+    out.write(report->metainfo.data(),
+              static_cast<std::streamsize>(report->metainfo.size()));
+    out.close();
+    if (!out) {
+        std::cerr << "Error writing " << out_path << std::endl;
+        return 1;
+    }
+
+    std::cout << "Info Hash: " << bittorrent::to_hex(report->info_hash)
+              << std::endl;
+    std::cout << "Pieces: " << report->piece_count << " of "
+              << report->piece_length << " bytes, " << report->file_count
+              << " files" << std::endl;
+    std::cerr << "Hashed " << report->total_size << " bytes in "
+              << report->elapsed.count() << " s, "
+              << report->total_size / report->elapsed.count() / 1e9
+              << " GB/s" << std::endl;
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     // Enable debug logging:
     // spdlog::set_level(spdlog::level::debug);
@@ -239,7 +455,21 @@ int main(int argc, char* argv[]) {
                   << " download_piece -o <output_file> <torrent file>"
                   << std::endl;
         std::cerr << "\t " << argv[0]
-                  << " download -o <output_file> <torrent file>" << std::endl;
+                  << " download -o <output_file> <torrent file> "
+                     "[--requests <in flight>] [--min-requests <in flight>] "
+                     "[--max-requests <in flight>]"
+                  << std::endl;
+        std::cerr << "\t " << argv[0]
+                  << " index [-o <output_file>] [--binary] [-j <threads>] "
+                     "<torrent file|directory|->..."
+                  << std::endl;
+        std::cerr << "\t " << argv[0]
+                  << " verify [-j <threads>] <torrent file> <path>"
+                  << std::endl;
+        std::cerr << "\t " << argv[0]
+                  << " create -o <output_file> [--piece-length <bytes>] "
+                     "[--announce <url>] [-j <threads>] <path>"
+                  << std::endl;
         return 1;
     }
 
@@ -254,14 +484,14 @@ int main(int argc, char* argv[]) {
 
         std::string encoded_value = argv[2];
         std::error_code ec;
-        auto decoded_value =
-            bittorrent::Bencode::decode_bencoded_value(encoded_value, ec);
+        auto document =
+            bittorrent::bencode::Document::parse(encoded_value, ec);
 
         if (ec) {
             std::cerr << "Error decoding bencoded value: " << ec << std::endl;
             return 1;
         }
-        std::cout << decoded_value.dump() << std::endl;
+        std::cout << document.root().dump() << std::endl;
     }
 
     else if (command == "info") {
@@ -304,13 +534,45 @@ int main(int argc, char* argv[]) {
     }
 
     else if (command == "download") {
-        if (argc < 5) {
+        // adapted to each peer between the limits, unless fixed
+        size_t min_requests = bittorrent::Peer::MIN_REQUEST_DEPTH;
+        size_t max_requests = bittorrent::Peer::MAX_REQUEST_DEPTH;
+        bool valid = argc >= 5;
+        for (int i = 5; i < argc && valid; i++) {
+            std::string arg = argv[i];
+            if (arg == "--requests" && i + 1 < argc) {
+                valid = parse_number(argv[++i], min_requests);
+                max_requests = min_requests;
+            } else if (arg == "--min-requests" && i + 1 < argc) {
+                valid = parse_number(argv[++i], min_requests);
+            } else if (arg == "--max-requests" && i + 1 < argc) {
+                valid = parse_number(argv[++i], max_requests);
+            } else {
+                valid = false;
+            }
+        }
+        if (!valid || min_requests == 0 || max_requests < min_requests) {
             std::cerr << "Usage: " << argv[0]
-                      << " download -o <output_file> <torrent file>"
+                      << " download -o <output_file> <torrent file> "
+                         "[--requests <in flight>] "
+                         "[--min-requests <in flight>] "
+                         "[--max-requests <in flight>]"
                       << std::endl;
             return 1;
         }
-        return download_file(argv[3], argv[4]);
+        return download_file(argv[3], argv[4], min_requests, max_requests);
+    }
+
+    else if (command == "index") {
+        return index_torrents(argc, argv);
+    }
+
+    else if (command == "verify") {
+        return verify(argc, argv);
+    }
+
+    else if (command == "create") {
+        return create(argc, argv);
     }
 
     else {
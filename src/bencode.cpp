@@ -1,4 +1,5 @@
 #include "bencode.hpp"
+#include "bencode_detail.hpp"
 #include "error.hpp"
 
 using json = nlohmann::json;
@@ -23,11 +24,19 @@ static nlohmann::json decode(std::string const& encoded_value,
                 errors::error_code_enum::bencode_decode_parse_string);
             return {};
         }
-        std::string size_string = std::string(it, colon_index);
-        int64_t number = std::atoll(size_string.c_str());
+        // the length must be digits only, and fit in the input
+        uint64_t length = 0;
+        std::string_view size_string(&*it, std::distance(it, colon_index));
+        if (!bencode::detail::parse_length(size_string, length) ||
+            length > static_cast<uint64_t>(
+                         std::distance(colon_index + 1, encoded_value.end()))) {
+            ec = errors::make_error_code(
+                errors::error_code_enum::bencode_decode_parse_string);
+            return {};
+        }
         std::string str =
-            std::string(colon_index + 1, colon_index + 1 + number);
-        it = colon_index + number + 1;
+            std::string(colon_index + 1, colon_index + 1 + length);
+        it = colon_index + length + 1;
         return json(str);
     }
 
@@ -42,32 +51,14 @@ static nlohmann::json decode(std::string const& encoded_value,
             return {};
         }
 
-        // Check for leading zeroes: i03e
-        if (*it == '0' && std::distance(it, e_index) > 1) {
-            ec = errors::make_error_code(
-                errors::error_code_enum::bencode_decode_parse_integer);
-            return {};
-        }
-
-        // Check for negative leading zeroes: i-0e
-        if (*it == '-' && (it + 1) != std::end(encoded_value) &&
-            *(it + 1) == '0') {
-            ec = errors::make_error_code(
-                errors::error_code_enum::bencode_decode_parse_integer);
-            return {};
-        }
-
-        // Check all digits
-        auto begin = (*it == '-') ? it + 1 : it;
-        auto digits = std::all_of(begin, e_index, isdigit);
-        if (!digits) {
+        // Checks leading zeroes (i03e), negative zero (i-0e) and digits
+        int64_t number = 0;
+        std::string_view digits(&*it, std::distance(it, e_index));
+        if (!bencode::detail::parse_integer(digits, number)) {
             ec = errors::make_error_code(
                 errors::error_code_enum::bencode_decode_parse_integer);
             return {};
         }
-
-        auto number_string = std::string(it, e_index);
-        int64_t number = std::atoll(number_string.c_str());
         it = e_index + 1;
         return json(number);
     }
@@ -132,34 +123,64 @@ nlohmann::json Bencode::decode_bencoded_value(std::string const& encoded_value,
     return decode(encoded_value, it, ec);
 }
 
-std::string encode(nlohmann::json const& value) {
-    std::string result;
+static void encode(nlohmann::json const& value, bencode::Writer& writer) {
     if (value.is_string()) {
-        result = std::to_string(value.get<std::string>().size()) + ":" +
-                 value.get<std::string>();
+        writer.string(value.get_ref<std::string const&>());
     } else if (value.is_number_integer()) {
-        result = "i" + std::to_string(value.get<int64_t>()) + "e";
+        writer.integer(value.get<int64_t>());
     } else if (value.is_array()) {
-        result = "l";
-        for (auto const& v : value) {
-            result += encode(v);
-        }
-        result += "e";
+        writer.begin_list();
+        for (auto const& v : value) encode(v, writer);
+        writer.end();
     } else if (value.is_object()) {
-        result = "d";
+        // keys are iterated in sorted order
+        writer.begin_dict();
         for (auto const& [key, val] : value.items()) {
-            result += encode(key);
-            result += encode(val);
+            writer.string(key);
+            encode(val, writer);
         }
-        result += "e";
+        writer.end();
     }
-    return result;
 }
 
-std::string Bencode::encode_bencoded_value(nlohmann::json const& value) {
+size_t Bencode::encoded_size(nlohmann::json const& value) {
+    if (value.is_string())
+        return bencode::Writer::string_size(
+            value.get_ref<std::string const&>());
+    if (value.is_number_integer())
+        return bencode::Writer::integer_size(value.get<int64_t>());
+
+    size_t size = 2;  // l...e, d...e
+    if (value.is_array()) {
+        for (auto const& v : value) size += encoded_size(v);
+    } else if (value.is_object()) {
+        for (auto const& [key, val] : value.items())
+            size += bencode::Writer::string_size(key) + encoded_size(val);
+    } else {
+        size = 0;
+    }
+    return size;
+}
+
+void Bencode::encode_bencoded_value(nlohmann::json const& value,
+                                    bencode::Sink& sink) {
     // Encode a value into bencoded format
     // Spec: https://wiki.theory.org/BitTorrentSpecification#Bencoding
-    return encode(value);
+    bencode::Writer writer(sink);
+    encode(value, writer);
+}
+
+void Bencode::encode_bencoded_value(nlohmann::json const& value,
+                                    std::string& out) {
+    bencode::StringSink sink(out);
+    encode_bencoded_value(value, sink);
+}
+
+std::string Bencode::encode_bencoded_value(nlohmann::json const& value) {
+    std::string result;
+    result.reserve(encoded_size(value));
+    encode_bencoded_value(value, result);
+    return result;
 }
 
 }  // namespace bittorrent
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "bencode_writer.hpp"
 #include "error.hpp"
 #include "lib/nlohmann/json.hpp"
 
@@ -10,6 +11,16 @@ class Bencode {
         std::string const& encoded_value, std::error_code& ec);
 
     static std::string encode_bencoded_value(nlohmann::json const& value);
+
+    // Appends the encoded value to `out`, which can be reused between calls
+    static void encode_bencoded_value(nlohmann::json const& value,
+                                      std::string& out);
+    // Encodes the value straight into a sink (socket, file, ...)
+    static void encode_bencoded_value(nlohmann::json const& value,
+                                      bencode::Sink& sink);
+
+    // Exact size of the encoded value, to reserve the output buffer
+    static size_t encoded_size(nlohmann::json const& value);
 };
 
 }  // namespace bittorrent
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+#include <system_error>
+
+namespace bittorrent {
+namespace bencode {
+namespace detail {
+
+inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// Validates the digits of an integer i<digits>e and converts them.
+// Rejects empty numbers, leading zeroes (i03e), negative zero (i-0e),
+// non-digit characters and values that do not fit in 64 bits.
+inline bool parse_integer(std::string_view digits, int64_t& value) {
+    size_t start = (!digits.empty() && digits[0] == '-') ? 1 : 0;
+    if (start == digits.size()) return false;
+
+    // leading zeroes: i03e, negative zero: i-0e
+    if (digits[start] == '0' && (start == 1 || digits.size() > 1))
+        return false;
+
+    for (size_t i = start; i < digits.size(); i++)
+        if (!is_digit(digits[i])) return false;
+
+    auto [ptr, err] =
+        std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    return err == std::errc() && ptr == digits.data() + digits.size();
+}
+
+// Validates the length prefix of a string <length>:<content>.
+inline bool parse_length(std::string_view digits, uint64_t& length) {
+    if (digits.empty()) return false;
+    for (char c : digits)
+        if (!is_digit(c)) return false;
+
+    auto [ptr, err] =
+        std::from_chars(digits.data(), digits.data() + digits.size(), length);
+    return err == std::errc() && ptr == digits.data() + digits.size();
+}
+
+}  // namespace detail
+}  // namespace bencode
+}  // namespace bittorrent
@@ -0,0 +1,351 @@
+#include "bencode_document.hpp"
+#include "bencode_detail.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace bittorrent {
+namespace bencode {
+
+// ===== Value =====
+
+Node const& Value::node() const { return document_->nodes()[index_]; }
+
+node_type Value::type() const { return node().type; }
+
+int64_t Value::integer() const { return node().integer; }
+
+std::string_view Value::string() const {
+    Node const& n = node();
+    return document_->source().substr(n.end - n.size, n.size);
+}
+
+std::string_view Value::raw() const {
+    Node const& n = node();
+    return document_->source().substr(n.begin, n.end - n.begin);
+}
+
+size_t Value::size() const { return node().size; }
+
+std::optional<Value> Value::find(std::string_view key) const {
+    if (!is_dict()) return {};
+    Node const& n = node();
+    auto first = document_->entries().begin() + n.entries;
+    auto last = first + n.size;
+
+    // duplicated keys: the last one wins, as with the json decoder
+    auto it = std::upper_bound(first, last, key,
+                               [this](std::string_view k, uint32_t index) {
+                                   return k < Value(*document_, index).string();
+                               });
+    if (it == first) return {};
+    --it;
+    if (Value(*document_, *it).string() != key) return {};
+    return Value(*document_, *it + 1);
+}
+
+std::optional<int64_t> Value::find_integer(std::string_view key) const {
+    auto value = find(key);
+    if (!value.has_value() || !value->is_integer()) return {};
+    return value->integer();
+}
+
+std::optional<std::string_view> Value::find_string(
+    std::string_view key) const {
+    auto value = find(key);
+    if (!value.has_value() || !value->is_string()) return {};
+    return value->string();
+}
+
+static void dump_string(std::string& out, std::string_view str) {
+    static char const hex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (char c : str) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out += "\\u00";
+                    out.push_back(hex[c >> 4]);
+                    out.push_back(hex[c & 0xF]);
+                } else {
+                    out.push_back(c);
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+static void dump(Document const& document, uint32_t index, std::string& out) {
+    Value value(document, index);
+    switch (value.type()) {
+        case node_type::integer:
+            out += std::to_string(value.integer());
+            break;
+        case node_type::string:
+            dump_string(out, value.string());
+            break;
+        case node_type::list: {
+            out.push_back('[');
+            bool first = true;
+            for (Value v : value) {
+                if (!first) out.push_back(',');
+                first = false;
+                dump(document, v.index(), out);
+            }
+            out.push_back(']');
+            break;
+        }
+        case node_type::dict: {
+            // keys in sorted order
+            out.push_back('{');
+            auto first = document.entries().begin() +
+                         document.nodes()[index].entries;
+            auto last = first + value.size();
+            bool first_entry = true;
+            for (auto it = first; it != last; ++it) {
+                // duplicated keys: the last one wins
+                std::string_view key = Value(document, *it).string();
+                if (it + 1 != last &&
+                    Value(document, *(it + 1)).string() == key)
+                    continue;
+                if (!first_entry) out.push_back(',');
+                first_entry = false;
+                dump_string(out, key);
+                out.push_back(':');
+                dump(document, *it + 1, out);
+            }
+            out.push_back('}');
+            break;
+        }
+    }
+}
+
+std::string Value::dump() const {
+    std::string out;
+    bencode::dump(*document_, index_, out);
+    return out;
+}
+
+Value::iterator& Value::iterator::operator++() {
+    index_ = document_->nodes()[index_].next;
+    return *this;
+}
+
+Value::iterator Value::begin() const {
+    return iterator(*document_, index_ + 1);
+}
+
+Value::iterator Value::end() const {
+    return iterator(*document_, node().next);
+}
+
+// ===== Document =====
+
+void Document::index_dict(uint32_t index) {
+    // entries of a dict are stored contiguously, sorted by key, so lookups
+    // are a binary search
+    Node& dict = nodes_[index];
+    dict.entries = entries_.size();
+    for (uint32_t key = index + 1; key != dict.next;
+         key = nodes_[nodes_[key].next].next) {
+        entries_.push_back(key);
+    }
+    // keys are usually already sorted, as required by the spec
+    auto first = entries_.begin() + dict.entries;
+    auto less = [this](uint32_t a, uint32_t b) {
+        return Value(*this, a).string() < Value(*this, b).string();
+    };
+    if (!std::is_sorted(first, entries_.end(), less))
+        std::stable_sort(first, entries_.end(), less);
+}
+
+static std::error_code make_error(errors::error_code_enum e) {
+    return errors::make_error_code(e);
+}
+
+// Finds token terminators by scanning the input
+class ScanFinder {
+   public:
+    explicit ScanFinder(std::string_view source) : source_(source) {}
+
+    // position of the first `c` at or after `pos`, npos if none
+    size_t find(size_t pos, char c) const {
+        void const* found =
+            std::memchr(source_.data() + pos, c, source_.size() - pos);
+        if (found == nullptr) return std::string_view::npos;
+        return static_cast<char const*>(found) - source_.data();
+    }
+
+   private:
+    std::string_view source_;
+};
+
+Document Document::parse(std::string_view source, std::error_code& ec) {
+    return parse(source, ScanFinder(source), ec);
+}
+
+Document Document::parse_indexed(std::string_view source, std::error_code& ec,
+                                 simd_level level) {
+    if (source.size() > std::numeric_limits<uint32_t>::max()) {
+        ec = make_error(errors::error_code_enum::bencode_decode_invalid);
+        return {};
+    }
+    StructuralIndex index;
+    find_structurals(source, index, level);
+    return parse(source, index, ec);
+}
+
+template <typename Finder>
+Document Document::parse(std::string_view source, Finder const& finder,
+                         std::error_code& ec) {
+    // Same grammar and checks as Bencode::decode_bencoded_value, but
+    // iterative (no recursion) and without copying strings.
+    // Spec: https://wiki.theory.org/BitTorrentSpecification#Bencoding
+    Document document;
+    document.source_ = source;
+
+    if (source.size() > std::numeric_limits<uint32_t>::max()) {
+        ec = make_error(errors::error_code_enum::bencode_decode_invalid);
+        return {};
+    }
+
+    struct Frame {
+        uint32_t index;
+        // dicts alternate between keys and values
+        bool expect_key;
+    };
+    std::vector<Frame> stack;
+    std::vector<Node>& nodes = document.nodes_;
+
+    size_t pos = 0;
+    size_t const size = source.size();
+    char const* data = source.data();
+
+    do {
+        bool in_dict = false;
+        bool is_key = false;
+        if (!stack.empty()) {
+            Frame& top = stack.back();
+            Node& container = nodes[top.index];
+            in_dict = container.type == node_type::dict;
+
+            if (pos == size) {
+                if (in_dict && !top.expect_key)
+                    ec = make_error(
+                        errors::error_code_enum::bencode_decode_parse_eof);
+                else
+                    ec = make_error(
+                        in_dict
+                            ? errors::error_code_enum::bencode_decode_parse_dict
+                            : errors::error_code_enum::
+                                  bencode_decode_parse_list);
+                return {};
+            }
+
+            if (data[pos] == 'e') {
+                if (in_dict && !top.expect_key) {
+                    // key without value
+                    ec = make_error(
+                        errors::error_code_enum::bencode_decode_invalid);
+                    return {};
+                }
+                pos++;
+                container.end = pos;
+                container.next = nodes.size();
+                if (in_dict) document.index_dict(top.index);
+                stack.pop_back();
+                continue;
+            }
+
+            if (in_dict) {
+                is_key = top.expect_key;
+                top.expect_key = !top.expect_key;
+                if (is_key && !detail::is_digit(data[pos])) {
+                    // key must be a string
+                    ec = make_error(
+                        errors::error_code_enum::bencode_decode_parse_dict_key);
+                    return {};
+                }
+                if (is_key) container.size++;
+            } else {
+                container.size++;
+            }
+        } else if (pos == size) {
+            ec = make_error(errors::error_code_enum::bencode_decode_parse_eof);
+            return {};
+        }
+
+        Node node{};
+        node.begin = pos;
+
+        // strings: <size>:<content>
+        if (detail::is_digit(data[pos])) {
+            size_t colon_index = finder.find(pos, ':');
+            if (colon_index == std::string_view::npos) {
+                ec = make_error(
+                    errors::error_code_enum::bencode_decode_parse_string);
+                return {};
+            }
+            uint64_t length = 0;
+            if (!detail::parse_length(source.substr(pos, colon_index - pos),
+                                      length) ||
+                length > size - colon_index - 1) {
+                ec = make_error(
+                    errors::error_code_enum::bencode_decode_parse_string);
+                return {};
+            }
+            node.type = node_type::string;
+            node.size = length;
+            pos = colon_index + 1 + length;
+        }
+
+        // integers: i<number>e
+        else if (data[pos] == 'i') {
+            size_t e_index = finder.find(pos + 1, 'e');
+            if (e_index == std::string_view::npos) {
+                ec = make_error(
+                    errors::error_code_enum::bencode_decode_parse_integer);
+                return {};
+            }
+            if (!detail::parse_integer(
+                    source.substr(pos + 1, e_index - pos - 1), node.integer)) {
+                ec = make_error(
+                    errors::error_code_enum::bencode_decode_parse_integer);
+                return {};
+            }
+            node.type = node_type::integer;
+            pos = e_index + 1;
+        }
+
+        // lists: l<bencoded_elements>e, dicts: d<key1><value1>...e
+        else if (data[pos] == 'l' || data[pos] == 'd') {
+            node.type = data[pos] == 'l' ? node_type::list : node_type::dict;
+            pos++;
+            stack.push_back({static_cast<uint32_t>(nodes.size()), true});
+            nodes.push_back(node);
+            continue;
+        }
+
+        else {
+            ec = make_error(errors::error_code_enum::bencode_decode_invalid);
+            return {};
+        }
+
+        node.end = pos;
+        node.next = nodes.size() + 1;
+        nodes.push_back(node);
+    } while (!stack.empty());
+
+    return document;
+}
+
+}  // namespace bencode
+}  // namespace bittorrent
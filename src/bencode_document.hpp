@@ -0,0 +1,128 @@
+#pragma once
+
+#include "bencode_index.hpp"
+#include "error.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace bittorrent {
+namespace bencode {
+
+enum class node_type : uint8_t { integer, string, list, dict };
+
+// A decoded value, stored in a flat vector in document order (a value is
+// followed by its children). Integers are stored inline and strings are
+// offsets into the source buffer.
+struct Node {
+    node_type type;
+    // string: length, list: number of elements, dict: number of entries
+    uint32_t size;
+    // encoded bytes of the value: source[begin, end)
+    uint32_t begin;
+    uint32_t end;
+    // index of the first node after this value and its children
+    uint32_t next;
+    union {
+        int64_t integer;
+        // dict: offset of its entries in the document's sorted key index
+        uint32_t entries;
+    };
+};
+
+class Document;
+
+// Lightweight handle to a node of a Document
+class Value {
+   public:
+    Value(Document const& document, uint32_t index)
+        : document_(&document), index_(index) {}
+
+    node_type type() const;
+    bool is_integer() const { return type() == node_type::integer; }
+    bool is_string() const { return type() == node_type::string; }
+    bool is_list() const { return type() == node_type::list; }
+    bool is_dict() const { return type() == node_type::dict; }
+
+    int64_t integer() const;
+    // View into the source buffer, no copy
+    std::string_view string() const;
+    // Encoded bytes of this value in the source buffer
+    std::string_view raw() const;
+    // Number of elements of a list or entries of a dict
+    size_t size() const;
+
+    // Dict lookup, binary search on the sorted keys
+    std::optional<Value> find(std::string_view key) const;
+    std::optional<int64_t> find_integer(std::string_view key) const;
+    std::optional<std::string_view> find_string(std::string_view key) const;
+
+    // JSON representation, as printed by the `decode` command
+    std::string dump() const;
+
+    // Iteration over the children of a list (values) or a dict
+    // (key, value, key, value, ...)
+    class iterator {
+       public:
+        iterator(Document const& document, uint32_t index)
+            : document_(&document), index_(index) {}
+        Value operator*() const { return Value(*document_, index_); }
+        iterator& operator++();
+        bool operator==(iterator const& other) const {
+            return index_ == other.index_;
+        }
+
+       private:
+        Document const* document_;
+        uint32_t index_;
+    };
+    iterator begin() const;
+    iterator end() const;
+
+    uint32_t index() const { return index_; }
+
+   private:
+    Node const& node() const;
+
+    Document const* document_;
+    uint32_t index_;
+};
+
+// Zero-copy bencode decoder: strings are views into the caller's buffer,
+// which must outlive the Document.
+class Document {
+   public:
+    Document() = default;
+
+    static Document parse(std::string_view source, std::error_code& ec);
+
+    // Two-stage decoder: the token terminators are located with SIMD
+    // (find_structurals) before the nodes are built. Gives the same result
+    // as parse() for every input. Scans every byte, including the content
+    // of strings that parse() skips over.
+    static Document parse_indexed(std::string_view source, std::error_code& ec,
+                                  simd_level level = best_simd_level());
+
+    Value root() const { return Value(*this, 0); }
+
+    std::string_view source() const { return source_; }
+    std::vector<Node> const& nodes() const { return nodes_; }
+    // Key nodes of every dict, sorted by key within each dict
+    std::vector<uint32_t> const& entries() const { return entries_; }
+
+   private:
+    template <typename Finder>
+    static Document parse(std::string_view source, Finder const& finder,
+                          std::error_code& ec);
+    void index_dict(uint32_t index);
+
+    std::string_view source_;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> entries_;
+};
+
+}  // namespace bencode
+}  // namespace bittorrent
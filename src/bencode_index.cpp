@@ -0,0 +1,146 @@
+#include "bencode_index.hpp"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITTORRENT_X86 1
+#include <immintrin.h>
+#endif
+
+namespace bittorrent {
+namespace bencode {
+
+size_t StructuralIndex::find(size_t pos, char c) const {
+    std::vector<uint64_t> const& bitmap = c == ':' ? colons : ends;
+    size_t word = pos / 64;
+    if (word >= bitmap.size()) return std::string_view::npos;
+
+    uint64_t bits = bitmap[word] & (~uint64_t{0} << (pos % 64));
+    while (bits == 0) {
+        if (++word == bitmap.size()) return std::string_view::npos;
+        bits = bitmap[word];
+    }
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+// Sets the bits of the block of [begin, end), 64 bytes at most, starting
+// at a multiple of 64
+static void find_structurals_scalar(char const* data, size_t begin,
+                                    size_t end, StructuralIndex& index) {
+    uint64_t colons = 0;
+    uint64_t ends = 0;
+    for (size_t i = begin; i < end; i++) {
+        colons |= uint64_t{data[i] == ':'} << (i - begin);
+        ends |= uint64_t{data[i] == 'e'} << (i - begin);
+    }
+    index.colons[begin / 64] = colons;
+    index.ends[begin / 64] = ends;
+}
+
+#ifdef BITTORRENT_X86
+
+__attribute__((target("sse2"))) static size_t find_structurals_sse2(
+    char const* data, size_t size, StructuralIndex& index) {
+    __m128i const colon = _mm_set1_epi8(':');
+    __m128i const e = _mm_set1_epi8('e');
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        uint64_t colons = 0;
+        uint64_t ends = 0;
+        for (size_t j = 0; j < 64; j += 16) {
+            __m128i chunk = _mm_loadu_si128(
+                reinterpret_cast<__m128i const*>(data + i + j));
+            colons |= static_cast<uint64_t>(static_cast<uint16_t>(
+                          _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, colon))))
+                      << j;
+            ends |= static_cast<uint64_t>(static_cast<uint16_t>(
+                        _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, e))))
+                    << j;
+        }
+        index.colons[i / 64] = colons;
+        index.ends[i / 64] = ends;
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static size_t find_structurals_avx2(
+    char const* data, size_t size, StructuralIndex& index) {
+    __m256i const colon = _mm256_set1_epi8(':');
+    __m256i const e = _mm256_set1_epi8('e');
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        uint64_t colons = 0;
+        uint64_t ends = 0;
+        for (size_t j = 0; j < 64; j += 32) {
+            __m256i chunk = _mm256_loadu_si256(
+                reinterpret_cast<__m256i const*>(data + i + j));
+            colons |= static_cast<uint64_t>(static_cast<uint32_t>(
+                          _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, colon))))
+                      << j;
+            ends |= static_cast<uint64_t>(static_cast<uint32_t>(
+                        _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, e))))
+                    << j;
+        }
+        index.colons[i / 64] = colons;
+        index.ends[i / 64] = ends;
+    }
+    return i;
+}
+
+#endif
+
+bool is_supported(simd_level level) {
+    switch (level) {
+        case simd_level::scalar:
+            return true;
+#ifdef BITTORRENT_X86
+        case simd_level::sse2:
+            return __builtin_cpu_supports("sse2");
+        case simd_level::avx2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+simd_level best_simd_level() {
+    static simd_level const level = is_supported(simd_level::avx2)
+                                        ? simd_level::avx2
+                                    : is_supported(simd_level::sse2)
+                                        ? simd_level::sse2
+                                        : simd_level::scalar;
+    return level;
+}
+
+void find_structurals(std::string_view input, StructuralIndex& index,
+                      simd_level level) {
+    if (!is_supported(level)) level = simd_level::scalar;
+
+    size_t words = (input.size() + 63) / 64;
+    index.colons.assign(words, 0);
+    index.ends.assign(words, 0);
+
+    // full 64-byte blocks
+    size_t done = 0;
+    switch (level) {
+#ifdef BITTORRENT_X86
+        case simd_level::avx2:
+            done = find_structurals_avx2(input.data(), input.size(), index);
+            break;
+        case simd_level::sse2:
+            done = find_structurals_sse2(input.data(), input.size(), index);
+            break;
+#endif
+        default:
+            break;
+    }
+
+    // remaining bytes, one block at a time
+    for (size_t begin = done; begin < input.size(); begin += 64) {
+        size_t end = std::min(begin + 64, input.size());
+        find_structurals_scalar(input.data(), begin, end, index);
+    }
+}
+
+}  // namespace bencode
+}  // namespace bittorrent
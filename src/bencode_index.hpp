@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace bittorrent {
+namespace bencode {
+
+enum class simd_level { scalar, sse2, avx2 };
+
+// Best implementation supported by the CPU, detected once at runtime
+simd_level best_simd_level();
+bool is_supported(simd_level level);
+
+// Stage 1 of the indexed decoder: bitmaps of the ':' and 'e' bytes of the
+// input, the only bytes that end a token. Bit i of word i / 64 is set when
+// input[i] matches. String contents are not known yet, so bytes inside
+// strings are included; stage 2 skips them.
+struct StructuralIndex {
+    std::vector<uint64_t> colons;
+    std::vector<uint64_t> ends;
+
+    // position of the first ':' or 'e' (`c`) at or after `pos`,
+    // std::string_view::npos if none
+    size_t find(size_t pos, char c) const;
+};
+
+void find_structurals(std::string_view input, StructuralIndex& index,
+                      simd_level level = best_simd_level());
+
+}  // namespace bencode
+}  // namespace bittorrent
@@ -0,0 +1,218 @@
+#include "bencode_lazy.hpp"
+#include "bencode_detail.hpp"
+#include "error.hpp"
+#include <algorithm>
+
+namespace bittorrent {
+namespace bencode {
+
+static std::error_code make_error(errors::error_code_enum e) {
+    return errors::make_error_code(e);
+}
+
+// Skips one string or integer token, returns the offset past it
+static size_t skip_token(std::string_view input, size_t pos,
+                         std::error_code& ec) {
+    char const* data = input.data();
+    size_t const size = input.size();
+
+    // strings: <size>:<content>
+    // tokens are short, scanning them inline is cheaper than memchr
+    if (detail::is_digit(data[pos])) {
+        size_t colon = pos + 1;
+        while (colon < size && detail::is_digit(data[colon])) colon++;
+        uint64_t length = 0;
+        if (colon == size || data[colon] != ':' ||
+            !detail::parse_length(input.substr(pos, colon - pos), length) ||
+            length > size - colon - 1) {
+            ec = make_error(errors::error_code_enum::bencode_decode_parse_string);
+            return 0;
+        }
+        return colon + 1 + length;
+    }
+
+    // integers: i<number>e
+    if (data[pos] == 'i') {
+        size_t e = pos + 1;
+        while (e < size && data[e] != 'e') e++;
+        int64_t value = 0;
+        if (e == size ||
+            !detail::parse_integer(input.substr(pos + 1, e - pos - 1), value)) {
+            ec = make_error(
+                errors::error_code_enum::bencode_decode_parse_integer);
+            return 0;
+        }
+        return e + 1;
+    }
+
+    ec = make_error(errors::error_code_enum::bencode_decode_invalid);
+    return 0;
+}
+
+size_t skip_value(std::string_view input, size_t pos, std::error_code& ec) {
+    // Containers are walked iteratively. For each open container, whether
+    // it is a dict and whether a key is expected next.
+    struct Frame {
+        bool dict;
+        bool expect_key;
+    };
+    std::vector<Frame> stack;
+    size_t const size = input.size();
+
+    do {
+        if (pos == size) {
+            if (stack.empty() || (stack.back().dict && !stack.back().expect_key))
+                ec = make_error(errors::error_code_enum::bencode_decode_parse_eof);
+            else
+                ec = make_error(
+                    stack.back().dict
+                        ? errors::error_code_enum::bencode_decode_parse_dict
+                        : errors::error_code_enum::bencode_decode_parse_list);
+            return 0;
+        }
+
+        char c = input[pos];
+        if (!stack.empty()) {
+            Frame& top = stack.back();
+            if (c == 'e') {
+                if (top.dict && !top.expect_key) {
+                    // key without value
+                    ec = make_error(
+                        errors::error_code_enum::bencode_decode_invalid);
+                    return 0;
+                }
+                stack.pop_back();
+                pos++;
+                continue;
+            }
+            if (top.dict) {
+                if (top.expect_key && !detail::is_digit(c)) {
+                    // key must be a string
+                    ec = make_error(
+                        errors::error_code_enum::bencode_decode_parse_dict_key);
+                    return 0;
+                }
+                top.expect_key = !top.expect_key;
+            }
+        }
+
+        if (c == 'l' || c == 'd') {
+            stack.push_back({c == 'd', true});
+            pos++;
+            continue;
+        }
+
+        pos = skip_token(input, pos, ec);
+        if (ec) return 0;
+    } while (!stack.empty());
+
+    return pos;
+}
+
+// ===== LazyValue =====
+
+node_type LazyValue::type() const {
+    if (!raw_.empty()) {
+        if (raw_[0] == 'i') return node_type::integer;
+        if (raw_[0] == 'l') return node_type::list;
+        if (raw_[0] == 'd') return node_type::dict;
+    }
+    return node_type::string;
+}
+
+std::optional<int64_t> LazyValue::integer() const {
+    int64_t value = 0;
+    if (type() != node_type::integer ||
+        !detail::parse_integer(raw_.substr(1, raw_.size() - 2), value))
+        return {};
+    return value;
+}
+
+std::optional<std::string_view> LazyValue::string() const {
+    if (type() != node_type::string) return {};
+    size_t colon = raw_.find(':');
+    if (colon == std::string_view::npos) return {};
+    return raw_.substr(colon + 1);
+}
+
+// ===== LazyDict =====
+
+std::optional<LazyDict> LazyDict::parse(std::string_view input,
+                                        std::error_code& ec) {
+    if (input.empty() || input[0] != 'd') {
+        ec = make_error(errors::error_code_enum::bencode_decode_parse_dict);
+        return {};
+    }
+
+    LazyDict dict;
+    size_t pos = 1;
+    while (pos < input.size() && input[pos] != 'e') {
+        // key must be a string
+        if (!detail::is_digit(input[pos])) {
+            ec = make_error(
+                errors::error_code_enum::bencode_decode_parse_dict_key);
+            return {};
+        }
+        size_t key_end = skip_token(input, pos, ec);
+        if (ec) return {};
+        std::string_view key =
+            *LazyValue(input.substr(pos, key_end - pos)).string();
+
+        if (key_end == input.size() || input[key_end] == 'e') {
+            ec = make_error(
+                key_end == input.size()
+                    ? errors::error_code_enum::bencode_decode_parse_eof
+                    : errors::error_code_enum::bencode_decode_invalid);
+            return {};
+        }
+        size_t value_end = skip_value(input, key_end, ec);
+        if (ec) return {};
+
+        dict.entries_.emplace_back(
+            key, LazyValue(input.substr(key_end, value_end - key_end)));
+        pos = value_end;
+    }
+    if (pos == input.size()) {
+        ec = make_error(errors::error_code_enum::bencode_decode_parse_dict);
+        return {};
+    }
+    dict.raw_ = input.substr(0, pos + 1);
+
+    // keys are usually already sorted, as required by the spec
+    auto less = [](auto const& a, auto const& b) { return a.first < b.first; };
+    if (!std::is_sorted(dict.entries_.begin(), dict.entries_.end(), less))
+        std::stable_sort(dict.entries_.begin(), dict.entries_.end(), less);
+    return dict;
+}
+
+std::optional<LazyValue> LazyDict::find(std::string_view key) const {
+    // duplicated keys: the last one wins, as with the other decoders
+    auto it = std::upper_bound(
+        entries_.begin(), entries_.end(), key,
+        [](std::string_view k, auto const& entry) { return k < entry.first; });
+    if (it == entries_.begin() || (it - 1)->first != key) return {};
+    return (it - 1)->second;
+}
+
+std::optional<int64_t> LazyDict::find_integer(std::string_view key) const {
+    auto value = find(key);
+    if (!value.has_value()) return {};
+    return value->integer();
+}
+
+std::optional<std::string_view> LazyDict::find_string(
+    std::string_view key) const {
+    auto value = find(key);
+    if (!value.has_value()) return {};
+    return value->string();
+}
+
+std::optional<LazyDict> LazyDict::find_dict(std::string_view key,
+                                            std::error_code& ec) const {
+    auto value = find(key);
+    if (!value.has_value() || value->type() != node_type::dict) return {};
+    return parse(value->raw(), ec);
+}
+
+}  // namespace bencode
+}  // namespace bittorrent
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "bencode_document.hpp"
+#include "error.hpp"
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace bittorrent {
+namespace bencode {
+
+// Returns the offset just past the value starting at input[pos], without
+// decoding it: strings are jumped over using their length prefix, lists and
+// dicts are walked token by token.
+size_t skip_value(std::string_view input, size_t pos, std::error_code& ec);
+
+// Encoded value, decoded only when accessed
+class LazyValue {
+   public:
+    LazyValue() = default;
+    explicit LazyValue(std::string_view raw) : raw_(raw) {}
+
+    node_type type() const;
+    // Encoded bytes of the value
+    std::string_view raw() const { return raw_; }
+
+    std::optional<int64_t> integer() const;
+    std::optional<std::string_view> string() const;
+
+   private:
+    std::string_view raw_;
+};
+
+// On-demand document: indexes the keys of one dict and locates the values
+// by skipping over them. Nested values are only parsed when accessed, e.g.
+// with find_dict. Strings are views into the input, which must outlive the
+// LazyDict.
+class LazyDict {
+   public:
+    LazyDict() = default;
+
+    // `input` starts with a dict, trailing bytes are ignored
+    static std::optional<LazyDict> parse(std::string_view input,
+                                         std::error_code& ec);
+
+    std::optional<LazyValue> find(std::string_view key) const;
+    std::optional<int64_t> find_integer(std::string_view key) const;
+    std::optional<std::string_view> find_string(std::string_view key) const;
+    std::optional<LazyDict> find_dict(std::string_view key,
+                                      std::error_code& ec) const;
+
+    // Encoded bytes of the dict
+    std::string_view raw() const { return raw_; }
+    size_t size() const { return entries_.size(); }
+    // Keys and values, sorted by key
+    std::vector<std::pair<std::string_view, LazyValue>> const& entries()
+        const {
+        return entries_;
+    }
+
+   private:
+    std::string_view raw_;
+    // sorted by key
+    std::vector<std::pair<std::string_view, LazyValue>> entries_;
+};
+
+}  // namespace bencode
+}  // namespace bittorrent
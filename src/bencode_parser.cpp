@@ -0,0 +1,203 @@
+#include "bencode_parser.hpp"
+#include "bencode_detail.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace bittorrent {
+namespace bencode {
+
+// longest valid integer or string length: 20 characters
+static constexpr size_t MAX_TOKEN_LENGTH = 20;
+
+StreamParser::StreamParser(Handler& handler, uint64_t max_string_length)
+    : handler_(handler), max_string_length_(max_string_length) {}
+
+void StreamParser::emit_string(std::string_view value) {
+    if (is_key_)
+        handler_.key(value);
+    else
+        handler_.string(value);
+    complete_value();
+}
+
+void StreamParser::complete_value() {
+    state_ = stack_.empty() ? state::done : state::value;
+}
+
+void StreamParser::feed(std::string_view chunk, std::error_code& ec) {
+    // Spec: https://wiki.theory.org/BitTorrentSpecification#Bencoding
+    if (error_) {
+        ec = error_;
+        return;
+    }
+
+    auto fail = [&](errors::error_code_enum e) {
+        error_ = errors::make_error_code(e);
+        ec = error_;
+    };
+
+    size_t i = 0;
+    size_t const size = chunk.size();
+    char const* data = chunk.data();
+
+    while (i < size && state_ != state::done) {
+        switch (state_) {
+            case state::value: {
+                char c = data[i];
+                bool in_dict = !stack_.empty() && stack_.back().dict;
+
+                if (!stack_.empty() && c == 'e') {
+                    if (in_dict && !stack_.back().expect_key) {
+                        // key without value
+                        return fail(
+                            errors::error_code_enum::bencode_decode_invalid);
+                    }
+                    i++;
+                    offset_++;
+                    stack_.pop_back();
+                    handler_.end();
+                    complete_value();
+                    break;
+                }
+
+                is_key_ = false;
+                if (in_dict) {
+                    is_key_ = stack_.back().expect_key;
+                    stack_.back().expect_key = !stack_.back().expect_key;
+                    // key must be a string
+                    if (is_key_ && !detail::is_digit(c))
+                        return fail(errors::error_code_enum::
+                                        bencode_decode_parse_dict_key);
+                }
+
+                // strings: <size>:<content>
+                if (detail::is_digit(c)) {
+                    token_.clear();
+                    state_ = state::length;
+                }
+                // integers: i<number>e
+                else if (c == 'i') {
+                    token_.clear();
+                    state_ = state::integer;
+                    i++;
+                    offset_++;
+                }
+                // lists: l<bencoded_elements>e, dicts: d<key1><value1>...e
+                else if (c == 'l' || c == 'd') {
+                    i++;
+                    offset_++;
+                    stack_.push_back({c == 'd', true});
+                    if (c == 'd')
+                        handler_.begin_dict();
+                    else
+                        handler_.begin_list();
+                } else {
+                    return fail(errors::error_code_enum::bencode_decode_invalid);
+                }
+                break;
+            }
+
+            case state::length: {
+                void const* colon = std::memchr(data + i, ':', size - i);
+                size_t end = colon ? static_cast<char const*>(colon) - data
+                                   : size;
+                token_.append(data + i, end - i);
+                offset_ += end - i;
+                i = end;
+                if (token_.size() > MAX_TOKEN_LENGTH)
+                    return fail(
+                        errors::error_code_enum::bencode_decode_parse_string);
+                if (colon == nullptr) break;
+
+                i++;
+                offset_++;
+                if (!detail::parse_length(token_, remaining_) ||
+                    remaining_ > max_string_length_)
+                    return fail(
+                        errors::error_code_enum::bencode_decode_parse_string);
+                buffer_.clear();
+                state_ = state::string;
+                if (remaining_ == 0) emit_string({});
+                break;
+            }
+
+            case state::string: {
+                size_t available = std::min<uint64_t>(remaining_, size - i);
+                std::string_view part(data + i, available);
+                i += available;
+                offset_ += available;
+                remaining_ -= available;
+
+                // whole string in this chunk: no copy
+                if (remaining_ == 0 && buffer_.empty()) {
+                    emit_string(part);
+                    break;
+                }
+                buffer_.append(part);
+                if (remaining_ == 0) emit_string(buffer_);
+                break;
+            }
+
+            case state::integer: {
+                void const* e = std::memchr(data + i, 'e', size - i);
+                size_t end = e ? static_cast<char const*>(e) - data : size;
+                token_.append(data + i, end - i);
+                offset_ += end - i;
+                i = end;
+                if (token_.size() > MAX_TOKEN_LENGTH)
+                    return fail(
+                        errors::error_code_enum::bencode_decode_parse_integer);
+                if (e == nullptr) break;
+
+                i++;
+                offset_++;
+                int64_t value = 0;
+                if (!detail::parse_integer(token_, value))
+                    return fail(
+                        errors::error_code_enum::bencode_decode_parse_integer);
+                handler_.integer(value);
+                complete_value();
+                break;
+            }
+
+            case state::done:
+                break;
+        }
+    }
+}
+
+void StreamParser::finish(std::error_code& ec) {
+    if (error_) {
+        ec = error_;
+        return;
+    }
+
+    errors::error_code_enum e = errors::error_code_enum::ok;
+    switch (state_) {
+        case state::done:
+            return;
+        case state::length:
+        case state::string:
+            e = errors::error_code_enum::bencode_decode_parse_string;
+            break;
+        case state::integer:
+            e = errors::error_code_enum::bencode_decode_parse_integer;
+            break;
+        case state::value:
+            if (stack_.empty())
+                e = errors::error_code_enum::bencode_decode_parse_eof;
+            else if (!stack_.back().dict)
+                e = errors::error_code_enum::bencode_decode_parse_list;
+            else if (stack_.back().expect_key)
+                e = errors::error_code_enum::bencode_decode_parse_dict;
+            else
+                e = errors::error_code_enum::bencode_decode_parse_eof;
+            break;
+    }
+    error_ = errors::make_error_code(e);
+    ec = error_;
+}
+
+}  // namespace bencode
+}  // namespace bittorrent
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "error.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace bittorrent {
+namespace bencode {
+
+// Receives the events of a StreamParser.
+// Strings are only valid for the duration of the call.
+class Handler {
+   public:
+    virtual ~Handler() = default;
+
+    virtual void begin_dict() {}
+    virtual void begin_list() {}
+    // end of the current dict or list
+    virtual void end() {}
+    virtual void key(std::string_view key) { (void)key; }
+    virtual void string(std::string_view value) { (void)value; }
+    virtual void integer(int64_t value) { (void)value; }
+};
+
+// Push (SAX) bencode parser. Input can be fed in chunks of any size as it
+// arrives; events are emitted as soon as a token is complete. Only strings
+// split across chunks are buffered.
+class StreamParser {
+   public:
+    // Strings longer than this are rejected, to bound memory usage
+    static constexpr uint64_t DEFAULT_MAX_STRING_LENGTH = 64 * 1024 * 1024;
+
+    explicit StreamParser(
+        Handler& handler,
+        uint64_t max_string_length = DEFAULT_MAX_STRING_LENGTH);
+
+    // Parses the next chunk of input. Bytes after the end of the top-level
+    // value are ignored.
+    void feed(std::string_view chunk, std::error_code& ec);
+
+    // Signals the end of the input, sets ec if the value is incomplete
+    void finish(std::error_code& ec);
+
+    // A complete top-level value has been parsed
+    bool done() const { return state_ == state::done; }
+
+    // Number of input bytes consumed. Inside a callback, this is the offset
+    // just past the reported token.
+    uint64_t offset() const { return offset_; }
+
+   private:
+    enum class state : uint8_t { value, length, string, integer, done };
+
+    struct Frame {
+        bool dict;
+        // dicts alternate between keys and values
+        bool expect_key;
+    };
+
+    void emit_string(std::string_view value);
+    void complete_value();
+
+    Handler& handler_;
+    uint64_t max_string_length_;
+
+    state state_ = state::value;
+    std::vector<Frame> stack_;
+    uint64_t offset_ = 0;
+    std::error_code error_;
+
+    // string being parsed is a dict key
+    bool is_key_ = false;
+    // digits of the current integer or string length
+    std::string token_;
+    // bytes of the current string still to be read
+    uint64_t remaining_ = 0;
+    // string split across chunks
+    std::string buffer_;
+};
+
+}  // namespace bencode
+}  // namespace bittorrent
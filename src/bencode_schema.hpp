@@ -0,0 +1,227 @@
+#pragma once
+
+#include "bencode_lazy.hpp"
+#include "bencode_writer.hpp"
+#include "error.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bittorrent {
+namespace bencode {
+
+// Binds a struct member to a dict key
+template <typename T, typename M>
+struct Field {
+    std::string_view key;
+    M T::*member;
+};
+
+template <typename T, typename M>
+constexpr Field<T, M> field(std::string_view key, M T::*member) {
+    return {key, member};
+}
+
+// Compile-time description of how a struct maps to a bencoded dict,
+// specialized for each bound struct:
+//
+//   template <>
+//   struct bencode::Schema<Info> {
+//       static constexpr auto fields =
+//           std::tuple{bencode::field("length", &Info::length),
+//                      bencode::field("name", &Info::name)};
+//   };
+//
+// Fields are listed in key order, the order they are encoded in. Members of
+// type std::optional are optional keys, all the others are required. Member
+// types can be integers, std::string, std::string_view (a view into the
+// input), LazyValue (the encoded value, kept as is), std::vector of those,
+// std::optional of those, or other bound structs.
+template <typename T>
+struct Schema;
+
+template <typename T>
+concept Bound = requires { Schema<T>::fields; };
+
+namespace detail {
+
+template <typename M>
+struct is_optional : std::false_type {};
+template <typename M>
+struct is_optional<std::optional<M>> : std::true_type {};
+
+template <typename M>
+struct is_vector : std::false_type {};
+template <typename M>
+struct is_vector<std::vector<M>> : std::true_type {};
+
+template <typename T>
+constexpr bool keys_sorted() {
+    return std::apply(
+        [](auto const&... fields) {
+            std::string_view keys[] = {fields.key...};
+            for (size_t i = 1; i < sizeof...(fields); i++)
+                if (!(keys[i - 1] < keys[i])) return false;
+            return true;
+        },
+        Schema<T>::fields);
+}
+
+inline std::error_code type_mismatch() {
+    return errors::make_error_code(
+        errors::error_code_enum::bencode_schema_type_mismatch);
+}
+
+template <Bound T>
+bool decode_fields(LazyDict const& dict, T& out, std::error_code& ec);
+
+template <typename M>
+bool decode_value(LazyValue value, M& out, std::error_code& ec) {
+    if constexpr (std::is_same_v<M, LazyValue>) {
+        out = value;
+    } else if constexpr (std::is_integral_v<M> && !std::is_same_v<M, bool>) {
+        std::optional<int64_t> integer = value.integer();
+        if (!integer || !std::in_range<M>(*integer)) {
+            ec = type_mismatch();
+            return false;
+        }
+        out = static_cast<M>(*integer);
+    } else if constexpr (std::is_same_v<M, std::string> ||
+                         std::is_same_v<M, std::string_view>) {
+        std::optional<std::string_view> string = value.string();
+        if (!string) {
+            ec = type_mismatch();
+            return false;
+        }
+        out = M(*string);
+    } else if constexpr (is_optional<M>::value) {
+        return decode_value(value, out.emplace(), ec);
+    } else if constexpr (is_vector<M>::value) {
+        if (value.type() != node_type::list) {
+            ec = type_mismatch();
+            return false;
+        }
+        std::string_view raw = value.raw();
+        out.clear();
+        for (size_t pos = 1; raw[pos] != 'e';) {
+            size_t end = skip_value(raw, pos, ec);
+            if (ec) return false;
+            if (!decode_value(LazyValue(raw.substr(pos, end - pos)),
+                              out.emplace_back(), ec))
+                return false;
+            pos = end;
+        }
+    } else {
+        static_assert(Bound<M>, "member type cannot be bound to bencode");
+        if (value.type() != node_type::dict) {
+            ec = type_mismatch();
+            return false;
+        }
+        std::optional<LazyDict> dict = LazyDict::parse(value.raw(), ec);
+        if (!dict) return false;
+        return decode_fields(*dict, out, ec);
+    }
+    return true;
+}
+
+template <Bound T>
+bool decode_fields(LazyDict const& dict, T& out, std::error_code& ec) {
+    static_assert(keys_sorted<T>(), "schema keys must be sorted");
+    return std::apply(
+        [&](auto const&... fields) {
+            auto decode_field = [&](auto const& field) {
+                using M = std::remove_reference_t<decltype(out.*field.member)>;
+                std::optional<LazyValue> value = dict.find(field.key);
+                if (!value) {
+                    if constexpr (is_optional<M>::value) {
+                        (out.*field.member).reset();
+                        return true;
+                    }
+                    ec = errors::make_error_code(
+                        errors::error_code_enum::bencode_schema_missing_key);
+                    return false;
+                }
+                return decode_value(*value, out.*field.member, ec);
+            };
+            // stops at the first error
+            return (decode_field(fields) && ...);
+        },
+        Schema<T>::fields);
+}
+
+template <typename M>
+void encode_value(M const& value, Writer& writer) {
+    if constexpr (std::is_same_v<M, LazyValue>) {
+        writer.raw(value.raw());
+    } else if constexpr (std::is_integral_v<M> && !std::is_same_v<M, bool>) {
+        writer.integer(static_cast<int64_t>(value));
+    } else if constexpr (std::is_same_v<M, std::string> ||
+                         std::is_same_v<M, std::string_view>) {
+        writer.string(value);
+    } else if constexpr (is_vector<M>::value) {
+        writer.begin_list();
+        for (auto const& element : value) encode_value(element, writer);
+        writer.end();
+    } else {
+        static_assert(Bound<M>, "member type cannot be bound to bencode");
+        static_assert(keys_sorted<M>(), "schema keys must be sorted");
+        writer.begin_dict();
+        std::apply(
+            [&](auto const&... fields) {
+                auto encode_field = [&](auto const& field) {
+                    auto const& member = value.*field.member;
+                    using F = std::remove_cvref_t<decltype(member)>;
+                    if constexpr (is_optional<F>::value) {
+                        if (!member) return;
+                        writer.string(field.key);
+                        encode_value(*member, writer);
+                    } else {
+                        writer.string(field.key);
+                        encode_value(member, writer);
+                    }
+                };
+                (encode_field(fields), ...);
+            },
+            Schema<M>::fields);
+        writer.end();
+    }
+}
+
+}  // namespace detail
+
+// Decodes a bencoded dict into T. Missing required keys and values of the
+// wrong type are reported in `ec`, unknown keys are ignored. Views into the
+// input must not outlive it.
+template <Bound T>
+std::optional<T> decode(std::string_view input, std::error_code& ec) {
+    std::optional<LazyDict> dict = LazyDict::parse(input, ec);
+    if (!dict) return {};
+    T value{};
+    if (!detail::decode_fields(*dict, value, ec)) return {};
+    return value;
+}
+
+// Encodes T as a dict, with the keys of its schema. Absent optional members
+// are left out.
+template <Bound T>
+void encode(T const& value, Writer& writer) {
+    detail::encode_value(value, writer);
+}
+
+template <Bound T>
+std::string encode(T const& value) {
+    std::string out;
+    StringSink sink(out);
+    Writer writer(sink);
+    encode(value, writer);
+    return out;
+}
+
+}  // namespace bencode
+}  // namespace bittorrent
@@ -0,0 +1,105 @@
+#include "bencode_writer.hpp"
+#include "error.hpp"
+#include <cerrno>
+#include <charconv>
+#include <unistd.h>
+
+namespace bittorrent {
+namespace bencode {
+
+// ===== FdSink =====
+
+void FdSink::write(char const* data, size_t size) {
+    if (buffer_.size() + size > BUFFER_SIZE) flush();
+    // large writes skip the buffer
+    if (size >= BUFFER_SIZE) {
+        write_all(data, size);
+        return;
+    }
+    buffer_.insert(buffer_.end(), data, data + size);
+}
+
+std::error_code FdSink::flush() {
+    write_all(buffer_.data(), buffer_.size());
+    buffer_.clear();
+    return ec_;
+}
+
+void FdSink::write_all(char const* data, size_t size) {
+    size_t written = 0;
+    while (!ec_ && written < size) {
+        ssize_t r = ::write(fd_, data + written, size - written);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0)
+            ec_ = std::error_code(errno, std::system_category());
+        else
+            written += r;
+    }
+}
+
+// ===== Writer =====
+
+// integers: i<number>e
+Writer& Writer::integer(int64_t value) {
+    char buffer[24];
+    buffer[0] = 'i';
+    auto [end, err] = std::to_chars(buffer + 1, buffer + sizeof(buffer), value);
+    (void)err;
+    *end++ = 'e';
+    sink_.write(buffer, end - buffer);
+    return *this;
+}
+
+// strings: <size>:<content>
+Writer& Writer::string(std::string_view value) {
+    char buffer[24];
+    auto [end, err] =
+        std::to_chars(buffer, buffer + sizeof(buffer), value.size());
+    (void)err;
+    *end++ = ':';
+    sink_.write(buffer, end - buffer);
+    sink_.write(value.data(), value.size());
+    return *this;
+}
+
+Writer& Writer::begin_list() {
+    sink_.write("l", 1);
+    return *this;
+}
+
+Writer& Writer::begin_dict() {
+    sink_.write("d", 1);
+    return *this;
+}
+
+Writer& Writer::end() {
+    sink_.write("e", 1);
+    return *this;
+}
+
+Writer& Writer::raw(std::string_view encoded) {
+    sink_.write(encoded.data(), encoded.size());
+    return *this;
+}
+
+static size_t digits(uint64_t value) {
+    size_t n = 1;
+    while (value >= 10) {
+        value /= 10;
+        n++;
+    }
+    return n;
+}
+
+size_t Writer::integer_size(int64_t value) {
+    // i, sign, digits, e
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : value;
+    return 2 + (value < 0 ? 1 : 0) + digits(magnitude);
+}
+
+size_t Writer::string_size(std::string_view value) {
+    return digits(value.size()) + 1 + value.size();
+}
+
+}  // namespace bencode
+}  // namespace bittorrent
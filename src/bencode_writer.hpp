@@ -0,0 +1,90 @@
+#pragma once
+
+#include "error.hpp"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace bittorrent {
+namespace bencode {
+
+// Destination of encoded bytes
+class Sink {
+   public:
+    virtual ~Sink() = default;
+    virtual void write(char const* data, size_t size) = 0;
+};
+
+// Appends to a caller-supplied buffer, which can be reused between encodes
+class StringSink : public Sink {
+   public:
+    explicit StringSink(std::string& out) : out_(out) {}
+    void write(char const* data, size_t size) override {
+        out_.append(data, size);
+    }
+
+   private:
+    std::string& out_;
+};
+
+class OstreamSink : public Sink {
+   public:
+    explicit OstreamSink(std::ostream& out) : out_(out) {}
+    void write(char const* data, size_t size) override {
+        out_.write(data, size);
+    }
+
+   private:
+    std::ostream& out_;
+};
+
+// Writes to a file descriptor (file or connected socket) through a buffer
+class FdSink : public Sink {
+   public:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    explicit FdSink(int fd) : fd_(fd) { buffer_.reserve(BUFFER_SIZE); }
+    ~FdSink() override { flush(); }
+
+    void write(char const* data, size_t size) override;
+    // Writes the buffered bytes, returns the first write error
+    std::error_code flush();
+
+   private:
+    void write_all(char const* data, size_t size);
+
+    int fd_;
+    std::vector<char> buffer_;
+    std::error_code ec_;
+};
+
+// Single-pass bencode encoder: values are written in order to the sink,
+// without building intermediate strings. Containers are opened with
+// begin_list/begin_dict and closed with end; dict keys are written with
+// string, in sorted order.
+class Writer {
+   public:
+    explicit Writer(Sink& sink) : sink_(sink) {}
+
+    Writer& integer(int64_t value);
+    Writer& string(std::string_view value);
+    Writer& begin_list();
+    Writer& begin_dict();
+    Writer& end();
+
+    // Already encoded bytes
+    Writer& raw(std::string_view encoded);
+
+    // Encoded size of values, to reserve buffers
+    static size_t integer_size(int64_t value);
+    static size_t string_size(std::string_view value);
+
+   private:
+    Sink& sink_;
+};
+
+}  // namespace bencode
+}  // namespace bittorrent
@@ -0,0 +1,344 @@
+#include "create.hpp"
+#include "bencode_writer.hpp"
+#include "error.hpp"
+#include "lib/sha1.hpp"
+#include "lib/utils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace bittorrent {
+
+constexpr size_t MIN_PIECE_LENGTH = 16 * 1024;
+constexpr size_t MAX_PIECE_LENGTH = 16 * 1024 * 1024;
+constexpr uint64_t TARGET_PIECE_COUNT = 1000;
+
+size_t default_piece_length(uint64_t total_size) {
+    size_t piece_length = MIN_PIECE_LENGTH;
+    while (piece_length < MAX_PIECE_LENGTH &&
+           total_size / piece_length > TARGET_PIECE_COUNT)
+        piece_length *= 2;
+    return piece_length;
+}
+
+namespace {
+
+struct InputFile {
+    std::filesystem::path path;
+    // path in the torrent, empty for a single-file torrent
+    std::vector<std::string> components;
+    uint64_t length;
+};
+
+// The file at `root`, or the regular files under it sorted by path
+std::vector<InputFile> list_files(std::filesystem::path const& root,
+                                  std::error_code& ec) {
+    namespace fs = std::filesystem;
+    fs::file_status status = fs::status(root, ec);
+    if (ec) return {};
+    if (!fs::is_directory(status)) {
+        uint64_t length = fs::file_size(root, ec);
+        if (ec) return {};
+        return {{root, {}, length}};
+    }
+
+    std::vector<InputFile> files;
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end;
+         it.increment(ec)) {
+        // broken links and special files are left out
+        std::error_code type_ec;
+        if (!it->is_regular_file(type_ec)) continue;
+        InputFile file{it->path(), {}, it->file_size(ec)};
+        if (ec) return {};
+        for (fs::path const& component : it->path().lexically_relative(root))
+            file.components.push_back(component.string());
+        files.push_back(std::move(file));
+    }
+    if (ec) return {};
+    std::sort(files.begin(), files.end(),
+              [](InputFile const& a, InputFile const& b) {
+                  return a.components < b.components;
+              });
+    return files;
+}
+
+// Whole pieces of the data, read at once. Only the last run of the torrent
+// ends with a shorter piece.
+struct Run {
+    std::vector<uint8_t> data;
+    size_t size = 0;
+    size_t first_piece = 0;
+};
+
+// Reads the files one after the other as a single stream
+class FileReader {
+   public:
+    explicit FileReader(std::vector<InputFile> const& files) : files_(files) {}
+    ~FileReader() { close(); }
+
+    // Fills `buffer` unless the end of the data is reached first, returns
+    // the number of bytes read
+    size_t read(uint8_t* buffer, size_t size, std::error_code& ec) {
+        size_t done = 0;
+        while (done < size) {
+            if (fd_ < 0) {
+                if (next_ == files_.size()) break;
+                if (!open(files_[next_++], ec)) return done;
+                continue;
+            }
+            ssize_t n = ::read(fd_, buffer + done,
+                               std::min<uint64_t>(size - done, remaining_));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                ec = std::error_code(errno, std::system_category());
+                return done;
+            }
+            // the file shrank since it was listed
+            if (n == 0) {
+                ec = std::make_error_code(std::errc::io_error);
+                return done;
+            }
+            done += static_cast<size_t>(n);
+            remaining_ -= static_cast<uint64_t>(n);
+            if (remaining_ == 0) close();
+        }
+        return done;
+    }
+
+   private:
+    bool open(InputFile const& file, std::error_code& ec) {
+        if (file.length == 0) return true;
+        fd_ = ::open(file.path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            ec = std::error_code(errno, std::system_category());
+            return false;
+        }
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        remaining_ = file.length;
+        return true;
+    }
+
+    void close() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    std::vector<InputFile> const& files_;
+    size_t next_ = 0;
+    int fd_ = -1;
+    uint64_t remaining_ = 0;
+};
+
+// Runs go from the reader to the workers through `ready`, and back through
+// `free`, so at most runs.size() are in memory
+class RunPipeline {
+   public:
+    RunPipeline(size_t runs, size_t run_size) : runs_(runs) {
+        for (size_t i = 0; i < runs; i++) {
+            runs_[i].data.resize(run_size);
+            free_.push_back(i);
+        }
+    }
+
+    // Reader side
+    Run& acquire() {
+        std::unique_lock lock(mutex_);
+        free_cv_.wait(lock, [&] { return !free_.empty(); });
+        size_t index = free_.front();
+        free_.pop_front();
+        return runs_[index];
+    }
+    void submit(Run& run) {
+        {
+            std::lock_guard lock(mutex_);
+            ready_.push_back(static_cast<size_t>(&run - runs_.data()));
+        }
+        ready_cv_.notify_one();
+    }
+    void finish() {
+        {
+            std::lock_guard lock(mutex_);
+            finished_ = true;
+        }
+        ready_cv_.notify_all();
+    }
+
+    // Worker side, nullptr once the reader finished and every run was taken
+    Run* take() {
+        std::unique_lock lock(mutex_);
+        ready_cv_.wait(lock, [&] { return !ready_.empty() || finished_; });
+        if (ready_.empty()) return nullptr;
+        size_t index = ready_.front();
+        ready_.pop_front();
+        return &runs_[index];
+    }
+    void release(Run& run) {
+        {
+            std::lock_guard lock(mutex_);
+            free_.push_back(static_cast<size_t>(&run - runs_.data()));
+        }
+        free_cv_.notify_one();
+    }
+
+   private:
+    std::vector<Run> runs_;
+    std::mutex mutex_;
+    std::condition_variable free_cv_;
+    std::condition_variable ready_cv_;
+    std::deque<size_t> free_;
+    std::deque<size_t> ready_;
+    bool finished_ = false;
+};
+
+// Hashes the pieces of `run` into `hashes`
+void hash_run(Run const& run, size_t piece_length,
+              std::vector<Sha1Digest>& hashes) {
+    std::vector<uint8_t const*> batch;
+    size_t piece = run.first_piece;
+    size_t offset = 0;
+    for (; offset + piece_length <= run.size; offset += piece_length) {
+        batch.push_back(run.data.data() + offset);
+        if (batch.size() == sha1::MAX_BATCH) {
+            utils::sha1_hash_batch(batch.data(), batch.size(), piece_length,
+                                   &hashes[piece]);
+            piece += batch.size();
+            batch.clear();
+        }
+    }
+    if (!batch.empty())
+        utils::sha1_hash_batch(batch.data(), batch.size(), piece_length,
+                               &hashes[piece]);
+    piece += batch.size();
+    if (offset < run.size)
+        hashes[piece] =
+            utils::sha1_digest(run.data.data() + offset, run.size - offset);
+}
+
+}  // namespace
+
+std::optional<CreateReport> create_torrent(std::filesystem::path const& path,
+                                           CreateOptions const& options,
+                                           std::error_code& ec) {
+    auto start = std::chrono::steady_clock::now();
+
+    size_t piece_length = options.piece_length;
+    if (piece_length != 0 && (piece_length < MIN_PIECE_LENGTH ||
+                              (piece_length & (piece_length - 1)) != 0)) {
+        ec = errors::make_error_code(
+            errors::error_code_enum::create_invalid_piece_length);
+        return {};
+    }
+
+    // "dir/" is the directory "dir"
+    std::filesystem::path root = path.lexically_normal();
+    if (!root.has_filename() && root.has_parent_path())
+        root = root.parent_path();
+    std::vector<InputFile> files = list_files(root, ec);
+    if (ec) return {};
+    if (files.empty()) {
+        ec = errors::make_error_code(errors::error_code_enum::create_no_files);
+        return {};
+    }
+
+    CreateReport report;
+    for (InputFile const& file : files) report.total_size += file.length;
+    uint64_t const total = report.total_size;
+    if (piece_length == 0) piece_length = default_piece_length(total);
+    size_t const piece_count = (total + piece_length - 1) / piece_length;
+    report.piece_length = piece_length;
+    report.piece_count = piece_count;
+    report.file_count = files.size();
+
+    unsigned threads = options.threads;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t const run_pieces =
+        std::max<size_t>(1, options.read_size / piece_length);
+    // one run being read, one per worker being hashed, one ready
+    RunPipeline pipeline(threads + 2, run_pieces * piece_length);
+
+    std::vector<Sha1Digest> hashes(piece_count);
+    std::atomic<uint64_t> hashed{0};
+    auto work = [&] {
+        while (Run* run = pipeline.take()) {
+            hash_run(*run, piece_length, hashes);
+            hashed += run->size;
+            pipeline.release(*run);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++) workers.emplace_back(work);
+
+    FileReader reader(files);
+    for (size_t piece = 0; piece < piece_count && !ec; piece += run_pieces) {
+        Run& run = pipeline.acquire();
+        run.first_piece = piece;
+        run.size = reader.read(run.data.data(), run.data.size(), ec);
+        if (ec) {
+            pipeline.release(run);
+            break;
+        }
+        pipeline.submit(run);
+        if (options.progress) options.progress(hashed, total);
+    }
+    pipeline.finish();
+    for (std::thread& worker : workers) worker.join();
+    if (ec) return {};
+    if (options.progress) options.progress(hashed, total);
+
+    // the name of "." is the one of the current directory
+    std::filesystem::path name = std::filesystem::absolute(root, ec);
+    if (ec) return {};
+    name = name.lexically_normal();
+    if (!name.has_filename()) name = name.parent_path();
+
+    bencode::StringSink sink(report.metainfo);
+    bencode::Writer writer(sink);
+    writer.begin_dict();
+    if (!options.announce.empty())
+        writer.string("announce").string(options.announce);
+    writer.string("created by").string("ownbittorrent");
+    writer.string("creation date").integer(std::time(nullptr));
+
+    writer.string("info");
+    size_t const info_begin = report.metainfo.size();
+    writer.begin_dict();
+    if (files.size() == 1 && files[0].components.empty()) {
+        writer.string("length").integer(static_cast<int64_t>(total));
+    } else {
+        writer.string("files").begin_list();
+        for (InputFile const& file : files) {
+            writer.begin_dict();
+            writer.string("length").integer(static_cast<int64_t>(file.length));
+            writer.string("path").begin_list();
+            for (std::string const& component : file.components)
+                writer.string(component);
+            writer.end().end();
+        }
+        writer.end();
+    }
+    writer.string("name").string(name.filename().string());
+    writer.string("piece length").integer(static_cast<int64_t>(piece_length));
+    writer.string("pieces").string(
+        std::string_view(reinterpret_cast<char const*>(hashes.data()),
+                         hashes.size() * sizeof(Sha1Digest)));
+    writer.end();
+    size_t const info_end = report.metainfo.size();
+    writer.end();
+
+    report.info_hash = utils::sha1_digest(
+        reinterpret_cast<uint8_t const*>(report.metainfo.data()) + info_begin,
+        info_end - info_begin);
+    report.elapsed = std::chrono::steady_clock::now() - start;
+    return report;
+}
+
+}  // namespace bittorrent
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "sha1_digest.hpp"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <system_error>
+
+namespace bittorrent {
+
+struct CreateOptions {
+    // tracker URL, left out of the metainfo if empty
+    std::string announce;
+    // power of two of at least 16 KiB, 0 to pick one from the total size
+    size_t piece_length = 0;
+    // hashing workers, 0: one per core
+    unsigned threads = 0;
+    // bytes read at once from the files, rounded down to whole pieces;
+    // sha1::MAX_BATCH pieces fill the widest SIMD batch
+    size_t read_size = 16 * 1024 * 1024;
+    // called from the calling thread after each read with the number of
+    // bytes hashed so far and the total
+    std::function<void(uint64_t hashed, uint64_t total)> progress;
+};
+
+// Result of create_torrent
+struct CreateReport {
+    // encoded metainfo, to be written to a .torrent file
+    std::string metainfo;
+    Sha1Digest info_hash{};
+    size_t piece_length = 0;
+    size_t piece_count = 0;
+    size_t file_count = 0;
+    uint64_t total_size = 0;
+    std::chrono::duration<double> elapsed{0};
+};
+
+// Piece length for `total_size` bytes of data: about a thousand pieces,
+// between 16 KiB and 16 MiB
+size_t default_piece_length(uint64_t total_size);
+
+// Builds a v1 torrent of the file or directory at `path`. Directories are
+// walked recursively, their files sorted by path.
+//
+// The files are read sequentially by the calling thread in runs of whole
+// pieces, which are handed to the hashing workers; a bounded number of runs
+// is in flight so memory use does not grow with the size of the data.
+std::optional<CreateReport> create_torrent(std::filesystem::path const& path,
+                                           CreateOptions const& options,
+                                           std::error_code& ec);
+
+}  // namespace bittorrent
@@ -25,6 +25,10 @@ enum class error_code_enum {
     bencode_decode_parse_eof,
     // invalid bencode value
     bencode_decode_invalid,
+    // required key missing from a bound dict
+    bencode_schema_missing_key,
+    // value of a bound key has the wrong type or is out of range
+    bencode_schema_type_mismatch,
 
     discover_peers_http,
     discover_peers_invalid_announce_url,
@@ -35,18 +39,35 @@ enum class error_code_enum {
     peer_connect,
     peer_send,
     peer_recv,
+    // connection closed by the peer
+    peer_disconnected,
     // connection is not established
     peer_no_connection,
 
     message_type_not_handled,
     message_expected_bitfield,
+    // length prefix over MessageReader::MAX_MESSAGE_SIZE
+    message_too_large,
 
     piece_invalid_index,
+    // block outside of the piece, or of another piece
+    piece_invalid_block,
+    // not every block of the piece was received
+    piece_incomplete,
     piece_hash_mismatch,
+    // hashes message not matching the merkle tree of the piece
+    piece_invalid_hashes,
+    // the hashes needed to check a piece were rejected
+    piece_hashes_rejected,
 
     torrent_download_file_no_peers,
 
-    parse_torrent
+    parse_torrent,
+
+    // piece length is not a power of two of at least 16 KiB
+    create_invalid_piece_length,
+    // nothing to put in the torrent
+    create_no_files
 };
 
 std::error_code make_error_code(error_code_enum e);
@@ -0,0 +1,222 @@
+// Hardware SHA1 compression functions and runtime dispatch.
+// The kernels follow the reference sequences of the Intel SHA extensions
+// and ARMv8 crypto extensions, 4 rounds per instruction.
+// The ARMv8 kernel has not been run on hardware yet: it is only built with
+// ARMV8_SHA (cmake -DARMV8_SHA=ON), otherwise aarch64 uses the portable one.
+#include "lib/sha1.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA1_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(ARMV8_SHA)
+#define SHA1_ARM 1
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#if defined(__clang__)
+#define SHA1_ARM_TARGET __attribute__((target("crypto")))
+#else
+#define SHA1_ARM_TARGET __attribute__((target("+crypto")))
+#endif
+#endif
+
+namespace sha1 {
+
+#ifdef SHA1_X86
+
+#define SHA1_SHANI_TARGET __attribute__((target("sha,sse4.1")))
+
+// Rounds 4g..4g+3. The message words are kept in 4 registers, m[g % 4]
+// holds words 4g..4g+3, and the next ones are computed as they go.
+template <int g>
+SHA1_SHANI_TARGET static inline void shaniRounds(__m128i& abcd, __m128i& e0,
+                                                 __m128i& e1, __m128i m[4],
+                                                 uint8_t const* block) {
+    __m128i const byteSwap =
+        _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i& e = g % 2 == 0 ? e0 : e1;
+    __m128i& next = g % 2 == 0 ? e1 : e0;
+    __m128i& msg = m[g % 4];
+
+    if constexpr (g < 4)
+        msg = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + g * 16)),
+            byteSwap);
+    if constexpr (g == 0)
+        e = _mm_add_epi32(e, msg);
+    else
+        e = _mm_sha1nexte_epu32(e, msg);
+    next = abcd;
+    if constexpr (g >= 3 && g <= 18)
+        m[(g + 1) % 4] = _mm_sha1msg2_epu32(m[(g + 1) % 4], msg);
+    abcd = _mm_sha1rnds4_epu32(abcd, e, g / 5);
+    if constexpr (g >= 1 && g <= 16)
+        m[(g + 3) % 4] = _mm_sha1msg1_epu32(m[(g + 3) % 4], msg);
+    if constexpr (g >= 2 && g <= 17)
+        m[(g + 2) % 4] = _mm_xor_si128(m[(g + 2) % 4], msg);
+}
+
+template <int... g>
+SHA1_SHANI_TARGET static inline void shaniBlock(
+    __m128i& abcd, __m128i& e0, __m128i& e1, __m128i m[4],
+    uint8_t const* block, std::integer_sequence<int, g...>) {
+    (shaniRounds<g>(abcd, e0, e1, m, block), ...);
+}
+
+SHA1_SHANI_TARGET static void compressShani(uint32_t state[5],
+                                            uint8_t const* blocks,
+                                            size_t count) {
+    // a, b, c, d from the high to the low lane, e in the high lane of e0
+    __m128i abcd = _mm_shuffle_epi32(
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(state)), 0x1B);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+    __m128i e1;
+    __m128i m[4];
+
+    for (; count > 0; count--, blocks += 64) {
+        __m128i abcdSave = abcd;
+        __m128i e0Save = e0;
+        shaniBlock(abcd, e0, e1, m, blocks,
+                   std::make_integer_sequence<int, 20>());
+        e0 = _mm_sha1nexte_epu32(e0, e0Save);
+        abcd = _mm_add_epi32(abcd, abcdSave);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                     _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+static bool cpuHasShani() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    return (ebx & (1u << 29)) != 0 && __builtin_cpu_supports("sse4.1");
+}
+
+#endif
+
+#ifdef SHA1_ARM
+
+// Rounds 4g..4g+3. m[g % 4] holds words 4g..4g+3, tmp[g % 2] the words
+// plus the round constant.
+template <int g>
+SHA1_ARM_TARGET static inline void armv8Rounds(uint32x4_t& abcd,
+                                               uint32_t& e0, uint32_t& e1,
+                                               uint32x4_t m[4],
+                                               uint32x4_t tmp[2]) {
+    static uint32_t const k[4] = {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC,
+                                  0xCA62C1D6};
+    uint32_t& e = g % 2 == 0 ? e0 : e1;
+    uint32_t& next = g % 2 == 0 ? e1 : e0;
+
+    next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    if constexpr (g < 5)
+        abcd = vsha1cq_u32(abcd, e, tmp[g % 2]);
+    else if constexpr (g < 10 || g >= 15)
+        abcd = vsha1pq_u32(abcd, e, tmp[g % 2]);
+    else
+        abcd = vsha1mq_u32(abcd, e, tmp[g % 2]);
+
+    if constexpr (g + 2 < 20)
+        tmp[g % 2] = vaddq_u32(m[(g + 2) % 4], vdupq_n_u32(k[(g + 2) / 5]));
+    if constexpr (g >= 1 && g <= 16)
+        m[(g + 3) % 4] = vsha1su1q_u32(m[(g + 3) % 4], m[(g + 2) % 4]);
+    if constexpr (g <= 15)
+        m[g % 4] = vsha1su0q_u32(m[g % 4], m[(g + 1) % 4], m[(g + 2) % 4]);
+}
+
+template <int... g>
+SHA1_ARM_TARGET static inline void armv8Block(uint32x4_t& abcd, uint32_t& e0,
+                                              uint32_t& e1, uint32x4_t m[4],
+                                              uint32x4_t tmp[2],
+                                              std::integer_sequence<int, g...>) {
+    (armv8Rounds<g>(abcd, e0, e1, m, tmp), ...);
+}
+
+SHA1_ARM_TARGET static void compressArmv8(uint32_t state[5],
+                                          uint8_t const* blocks,
+                                          size_t count) {
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e0 = state[4];
+    uint32_t e1 = 0;
+
+    for (; count > 0; count--, blocks += 64) {
+        uint32x4_t abcdSave = abcd;
+        uint32_t e0Save = e0;
+
+        uint32x4_t m[4];
+        for (int i = 0; i < 4; i++)
+            m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + i * 16)));
+        uint32x4_t tmp[2] = {vaddq_u32(m[0], vdupq_n_u32(0x5A827999)),
+                             vaddq_u32(m[1], vdupq_n_u32(0x5A827999))};
+
+        armv8Block(abcd, e0, e1, m, tmp, std::make_integer_sequence<int, 20>());
+
+        e0 += e0Save;
+        abcd = vaddq_u32(abcd, abcdSave);
+    }
+
+    vst1q_u32(state, abcd);
+    state[4] = e0;
+}
+
+static bool cpuHasArmv8Sha1() {
+#if defined(__APPLE__)
+    return true;
+#elif defined(__linux__) && defined(HWCAP_SHA1)
+    return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif
+
+bool isSupported(Implementation implementation) {
+    switch (implementation) {
+        case Implementation::portable:
+            return true;
+#ifdef SHA1_X86
+        case Implementation::shani: {
+            static bool const supported = cpuHasShani();
+            return supported;
+        }
+#endif
+#ifdef SHA1_ARM
+        case Implementation::armv8: {
+            static bool const supported = cpuHasArmv8Sha1();
+            return supported;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+Implementation bestImplementation() {
+    static Implementation const implementation =
+        isSupported(Implementation::shani)   ? Implementation::shani
+        : isSupported(Implementation::armv8) ? Implementation::armv8
+                                             : Implementation::portable;
+    return implementation;
+}
+
+CompressFunction compressFunction(Implementation implementation) {
+    if (!isSupported(implementation)) implementation = Implementation::portable;
+    switch (implementation) {
+#ifdef SHA1_X86
+        case Implementation::shani:
+            return compressShani;
+#endif
+#ifdef SHA1_ARM
+        case Implementation::armv8:
+            return compressArmv8;
+#endif
+        default:
+            return SHA1::processBlocks;
+    }
+}
+
+}  // namespace sha1
@@ -9,6 +9,9 @@
  *
  * Copyright (c) 2012-22 SAURAV MOHAPATRA <mohaps@gmail.com>
  *
+ * Modified: blocks are compressed directly from the input buffer instead
+ * of byte by byte.
+ *
  * Permission to use, copy, modify, and distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
  * copyright notice and this permission notice appear in all copies.
@@ -23,11 +26,44 @@
  */
 #ifndef _TINY_SHA1_HPP_
 #define _TINY_SHA1_HPP_
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <stdint.h>
+#include <utility>
 namespace sha1 {
+
+// Compresses `count` 64-byte blocks into the five state words
+typedef void (*CompressFunction)(uint32_t state[5], uint8_t const* blocks,
+                                 size_t count);
+
+enum class Implementation { portable, shani, armv8 };
+
+// Implementations are selected at runtime, see sha1.cpp
+bool isSupported(Implementation implementation);
+// Fastest implementation supported by the CPU, detected once
+Implementation bestImplementation();
+// Falls back to the portable implementation if `implementation` is not
+// supported
+CompressFunction compressFunction(Implementation implementation);
+
+// Multi-buffer hashing of messages of the same size, one message per SIMD
+// lane (8 with AVX2, 16 with AVX-512), see sha1_batch.cpp. `single` hashes
+// the messages one after the other with SHA1.
+enum class BatchImplementation { single, avx2, avx512 };
+// Messages hashed together by the widest implementation, callers batching
+// pieces for hashBatch fill it with this many
+constexpr size_t MAX_BATCH = 16;
+
+bool isSupported(BatchImplementation implementation);
+BatchImplementation bestBatchImplementation();
+// Writes the digests of the `count` messages of `size` bytes to `digests`.
+// Falls back to `single` if `implementation` is not supported.
+void hashBatch(uint8_t const* const* messages, size_t count, size_t size,
+               uint8_t (*digests)[20],
+               BatchImplementation implementation = bestBatchImplementation());
+
 class SHA1 {
    public:
     typedef uint32_t digest32_t[5];
@@ -35,10 +71,15 @@ class SHA1 {
     inline static uint32_t LeftRotate(uint32_t value, size_t count) {
         return (value << count) ^ (value >> (32 - count));
     }
-    SHA1() { reset(); }
+    SHA1() : SHA1(bestImplementation()) {}
+    explicit SHA1(Implementation implementation)
+        : m_compress(compressFunction(implementation)) {
+        reset();
+    }
     virtual ~SHA1() {}
     SHA1(const SHA1& s) { *this = s; }
     const SHA1& operator=(const SHA1& s) {
+        m_compress = s.m_compress;
         memcpy(m_digest, s.m_digest, 5 * sizeof(uint32_t));
         memcpy(m_block, s.m_block, 64);
         m_blockByteIndex = s.m_blockByteIndex;
@@ -60,47 +101,50 @@ class SHA1 {
         ++this->m_byteCount;
         if (m_blockByteIndex == 64) {
             this->m_blockByteIndex = 0;
-            processBlock();
+            m_compress(m_digest, m_block, 1);
         }
         return *this;
     }
     SHA1& processBlock(void const* const start, void const* const end) {
-        uint8_t const* begin = static_cast<uint8_t const*>(start);
-        uint8_t const* finish = static_cast<uint8_t const*>(end);
-        while (begin != finish) {
-            processByte(*begin);
-            begin++;
-        }
-        return *this;
+        return processBytes(start, static_cast<uint8_t const*>(end) -
+                                       static_cast<uint8_t const*>(start));
     }
+    // Whole blocks are compressed straight from the input, only an
+    // unaligned head and tail go through m_block
     SHA1& processBytes(void const* const data, size_t len) {
-        uint8_t const* block = static_cast<uint8_t const*>(data);
-        processBlock(block, block + len);
+        uint8_t const* bytes = static_cast<uint8_t const*>(data);
+        m_byteCount += len;
+
+        if (m_blockByteIndex != 0) {
+            size_t head = std::min(len, 64 - m_blockByteIndex);
+            memcpy(m_block + m_blockByteIndex, bytes, head);
+            m_blockByteIndex += head;
+            bytes += head;
+            len -= head;
+            if (m_blockByteIndex < 64) return *this;
+            m_compress(m_digest, m_block, 1);
+            m_blockByteIndex = 0;
+        }
+
+        m_compress(m_digest, bytes, len / 64);
+        bytes += len / 64 * 64;
+        len %= 64;
+
+        memcpy(m_block, bytes, len);
+        m_blockByteIndex = len;
         return *this;
     }
     uint32_t const* getDigest(digest32_t digest) {
-        size_t bitCount = this->m_byteCount * 8;
-        processByte(0x80);
-        if (this->m_blockByteIndex > 56) {
-            while (m_blockByteIndex != 0) {
-                processByte(0);
-            }
-            while (m_blockByteIndex < 56) {
-                processByte(0);
-            }
-        } else {
-            while (m_blockByteIndex < 56) {
-                processByte(0);
-            }
-        }
-        processByte(0);
-        processByte(0);
-        processByte(0);
-        processByte(0);
-        processByte(static_cast<unsigned char>((bitCount >> 24) & 0xFF));
-        processByte(static_cast<unsigned char>((bitCount >> 16) & 0xFF));
-        processByte(static_cast<unsigned char>((bitCount >> 8) & 0xFF));
-        processByte(static_cast<unsigned char>((bitCount) & 0xFF));
+        uint64_t bitCount = static_cast<uint64_t>(this->m_byteCount) * 8;
+
+        // 0x80, zeroes up to 56 mod 64, then the big endian bit count
+        uint8_t padding[128] = {0x80};
+        size_t padLength =
+            (m_blockByteIndex < 56 ? 56 : 120) - m_blockByteIndex;
+        for (size_t i = 0; i < 8; i++)
+            padding[padLength + i] =
+                static_cast<uint8_t>(bitCount >> (56 - i * 8));
+        processBytes(padding, padLength + 8);
 
         memcpy(digest, m_digest, 5 * sizeof(uint32_t));
         return digest;
@@ -137,57 +181,86 @@ class SHA1 {
     }
 
    protected:
-    void processBlock() {
-        uint32_t w[80];
-        for (size_t i = 0; i < 16; i++) {
-            w[i] = (m_block[i * 4 + 0] << 24);
-            w[i] |= (m_block[i * 4 + 1] << 16);
-            w[i] |= (m_block[i * 4 + 2] << 8);
-            w[i] |= (m_block[i * 4 + 3]);
-        }
-        for (size_t i = 16; i < 80; i++) {
-            w[i] = LeftRotate((w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16]), 1);
-        }
+    static uint32_t loadBigEndian(uint8_t const* p) {
+        return (static_cast<uint32_t>(p[0]) << 24) |
+               (static_cast<uint32_t>(p[1]) << 16) |
+               (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+    }
 
-        uint32_t a = m_digest[0];
-        uint32_t b = m_digest[1];
-        uint32_t c = m_digest[2];
-        uint32_t d = m_digest[3];
-        uint32_t e = m_digest[4];
-
-        for (std::size_t i = 0; i < 80; ++i) {
-            uint32_t f = 0;
-            uint32_t k = 0;
-
-            if (i < 20) {
-                f = (b & c) | (~b & d);
-                k = 0x5A827999;
-            } else if (i < 40) {
-                f = b ^ c ^ d;
-                k = 0x6ED9EBA1;
-            } else if (i < 60) {
-                f = (b & c) | (b & d) | (c & d);
-                k = 0x8F1BBCDC;
-            } else {
-                f = b ^ c ^ d;
-                k = 0xCA62C1D6;
-            }
-            uint32_t temp = LeftRotate(a, 5) + f + e + k + w[i];
-            e = d;
-            d = c;
-            c = LeftRotate(b, 30);
-            b = a;
-            a = temp;
+    // One round; the callers rotate the roles of a..e instead of moving the
+    // values around. The message schedule is kept in a rolling 16-word
+    // window.
+    template <size_t i>
+    static void round(uint32_t a, uint32_t& b, uint32_t c, uint32_t d,
+                      uint32_t& e, uint32_t w[16]) {
+        if constexpr (i >= 16)
+            w[i & 15] = LeftRotate(w[(i - 3) & 15] ^ w[(i - 8) & 15] ^
+                                       w[(i - 14) & 15] ^ w[i & 15],
+                                   1);
+        uint32_t f;
+        uint32_t k;
+        if constexpr (i < 20) {
+            f = d ^ (b & (c ^ d));
+            k = 0x5A827999;
+        } else if constexpr (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if constexpr (i < 60) {
+            f = (b & c) + (d & (b ^ c));
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
         }
+        e += (w[i & 15] + k) + f + LeftRotate(a, 5);
+        b = LeftRotate(b, 30);
+    }
+
+    // Five rounds, after which a..e are back in their original roles
+    template <size_t i>
+    static void rounds(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d,
+                       uint32_t& e, uint32_t w[16]) {
+        round<i + 0>(a, b, c, d, e, w);
+        round<i + 1>(e, a, b, c, d, w);
+        round<i + 2>(d, e, a, b, c, w);
+        round<i + 3>(c, d, e, a, b, w);
+        round<i + 4>(b, c, d, e, a, w);
+    }
 
-        m_digest[0] += a;
-        m_digest[1] += b;
-        m_digest[2] += c;
-        m_digest[3] += d;
-        m_digest[4] += e;
+    template <size_t... i>
+    static void allRounds(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d,
+                          uint32_t& e, uint32_t w[16],
+                          std::index_sequence<i...>) {
+        (rounds<i * 5>(a, b, c, d, e, w), ...);
+    }
+
+   public:
+    // Portable compression function
+    static void processBlocks(uint32_t state[5], uint8_t const* blocks,
+                              size_t count) {
+        for (; count > 0; count--, blocks += 64) {
+            uint32_t w[16];
+            for (size_t i = 0; i < 16; i++)
+                w[i] = loadBigEndian(blocks + i * 4);
+
+            uint32_t a = state[0];
+            uint32_t b = state[1];
+            uint32_t c = state[2];
+            uint32_t d = state[3];
+            uint32_t e = state[4];
+
+            allRounds(a, b, c, d, e, w, std::make_index_sequence<16>());
+
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+        }
     }
 
    private:
+    CompressFunction m_compress;
     digest32_t m_digest;
     uint8_t m_block[64];
     size_t m_blockByteIndex;
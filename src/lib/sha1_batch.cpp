@@ -0,0 +1,308 @@
+// Multi-buffer SHA1: equal-length messages are hashed together, message i
+// in lane i of the SIMD registers, so each instruction advances 8 (AVX2)
+// or 16 (AVX-512) messages by one step of the portable algorithm. The
+// words of each block are gathered from the messages with 64-bit offsets
+// from the first one.
+#include "lib/sha1.hpp"
+#include <cstring>
+
+#if defined(__x86_64__)
+#define SHA1_BATCH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace sha1 {
+
+static uint32_t const initialState[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE,
+                                         0x10325476, 0xC3D2E1F0};
+static uint32_t const roundConstants[4] = {0x5A827999, 0x6ED9EBA1,
+                                           0x8F1BBCDC, 0xCA62C1D6};
+
+// Copies the last size % 64 bytes of a `size`-byte message followed by the
+// padding into `tail`, returns the number of blocks written (1 or 2)
+static size_t paddedTail(uint8_t const* message, size_t size,
+                         uint8_t tail[128]) {
+    size_t rest = size % 64;
+    size_t blocks = rest < 56 ? 1 : 2;
+    memcpy(tail, message + size - rest, rest);
+    tail[rest] = 0x80;
+    memset(tail + rest + 1, 0, blocks * 64 - rest - 1);
+    uint64_t bitCount = static_cast<uint64_t>(size) * 8;
+    for (size_t i = 0; i < 8; i++)
+        tail[blocks * 64 - 8 + i] =
+            static_cast<uint8_t>(bitCount >> (56 - i * 8));
+    return blocks;
+}
+
+// Writes the digest of each lane, `words` holds state word w of lane i at
+// [w * lanes + i]
+static void storeDigests(uint32_t const* words, size_t lanes,
+                         uint8_t (*digests)[20]) {
+    for (size_t lane = 0; lane < lanes; lane++)
+        for (size_t w = 0; w < 5; w++)
+            for (size_t i = 0; i < 4; i++)
+                digests[lane][w * 4 + i] =
+                    static_cast<uint8_t>(words[w * lanes + lane] >> (24 - i * 8));
+}
+
+#ifdef SHA1_BATCH_X86
+
+// ===== AVX2, 8 lanes =====
+
+#define SHA1_AVX2_TARGET __attribute__((target("avx2")))
+
+template <int n>
+SHA1_AVX2_TARGET static inline __m256i rotl8(__m256i x) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+template <int phase>
+SHA1_AVX2_TARGET static inline void round8(__m256i& a, __m256i& b, __m256i& c,
+                                           __m256i& d, __m256i& e,
+                                           __m256i w[16], size_t i) {
+    if (i >= 16)
+        w[i & 15] = rotl8<1>(_mm256_xor_si256(
+            _mm256_xor_si256(w[(i - 3) & 15], w[(i - 8) & 15]),
+            _mm256_xor_si256(w[(i - 14) & 15], w[i & 15])));
+
+    __m256i f;
+    if constexpr (phase == 0)
+        f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+    else if constexpr (phase == 2)
+        f = _mm256_or_si256(_mm256_and_si256(b, c),
+                            _mm256_and_si256(d, _mm256_or_si256(b, c)));
+    else
+        f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+
+    __m256i temp = _mm256_add_epi32(
+        _mm256_add_epi32(rotl8<5>(a), f),
+        _mm256_add_epi32(
+            _mm256_add_epi32(e, w[i & 15]),
+            _mm256_set1_epi32(static_cast<int>(roundConstants[phase]))));
+    e = d;
+    d = c;
+    c = rotl8<30>(b);
+    b = a;
+    a = temp;
+}
+
+// Compresses `blocks` blocks of each lane, starting at lanes[i]
+SHA1_AVX2_TARGET static void compress8(__m256i state[5],
+                                       uint8_t const* const* lanes,
+                                       size_t blocks) {
+    __m256i const byteSwap = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15,
+        8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    uint8_t const* base = lanes[0];
+    __m256i offsetsLow = _mm256_set_epi64x(lanes[3] - base, lanes[2] - base,
+                                           lanes[1] - base, 0);
+    __m256i offsetsHigh =
+        _mm256_set_epi64x(lanes[7] - base, lanes[6] - base, lanes[5] - base,
+                          lanes[4] - base);
+
+    for (size_t block = 0; block < blocks; block++, base += 64) {
+        __m256i w[16];
+        for (size_t t = 0; t < 16; t++) {
+            int const* word = reinterpret_cast<int const*>(base + t * 4);
+            __m128i low = _mm256_i64gather_epi32(word, offsetsLow, 1);
+            __m128i high = _mm256_i64gather_epi32(word, offsetsHigh, 1);
+            w[t] = _mm256_shuffle_epi8(_mm256_set_m128i(high, low), byteSwap);
+        }
+
+        __m256i a = state[0], b = state[1], c = state[2], d = state[3],
+                e = state[4];
+        for (size_t i = 0; i < 20; i++) round8<0>(a, b, c, d, e, w, i);
+        for (size_t i = 20; i < 40; i++) round8<1>(a, b, c, d, e, w, i);
+        for (size_t i = 40; i < 60; i++) round8<2>(a, b, c, d, e, w, i);
+        for (size_t i = 60; i < 80; i++) round8<3>(a, b, c, d, e, w, i);
+
+        state[0] = _mm256_add_epi32(state[0], a);
+        state[1] = _mm256_add_epi32(state[1], b);
+        state[2] = _mm256_add_epi32(state[2], c);
+        state[3] = _mm256_add_epi32(state[3], d);
+        state[4] = _mm256_add_epi32(state[4], e);
+    }
+}
+
+SHA1_AVX2_TARGET static void hash8(uint8_t const* const* messages, size_t size,
+                                   uint8_t (*digests)[20]) {
+    __m256i state[5];
+    for (size_t w = 0; w < 5; w++)
+        state[w] = _mm256_set1_epi32(static_cast<int>(initialState[w]));
+
+    compress8(state, messages, size / 64);
+
+    alignas(64) uint8_t tails[8][128];
+    uint8_t const* tailLanes[8];
+    size_t tailBlocks = 0;
+    for (size_t lane = 0; lane < 8; lane++) {
+        tailBlocks = paddedTail(messages[lane], size, tails[lane]);
+        tailLanes[lane] = tails[lane];
+    }
+    compress8(state, tailLanes, tailBlocks);
+
+    alignas(32) uint32_t words[5 * 8];
+    for (size_t w = 0; w < 5; w++)
+        _mm256_store_si256(reinterpret_cast<__m256i*>(words + w * 8),
+                           state[w]);
+    storeDigests(words, 8, digests);
+}
+
+// ===== AVX-512, 16 lanes =====
+
+#define SHA1_AVX512_TARGET __attribute__((target("avx512f,avx512bw")))
+
+// GCC warns about the _mm512_undefined_* placeholders used inside its own
+// intrinsics
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+template <int phase>
+SHA1_AVX512_TARGET static inline void round16(__m512i& a, __m512i& b,
+                                              __m512i& c, __m512i& d,
+                                              __m512i& e, __m512i w[16],
+                                              size_t i) {
+    if (i >= 16)
+        w[i & 15] = _mm512_rol_epi32(
+            _mm512_ternarylogic_epi32(
+                _mm512_xor_si512(w[(i - 3) & 15], w[(i - 8) & 15]),
+                w[(i - 14) & 15], w[i & 15], 0x96),
+            1);
+
+    // choose, parity and majority of b, c, d
+    __m512i f;
+    if constexpr (phase == 0)
+        f = _mm512_ternarylogic_epi32(b, c, d, 0xCA);
+    else if constexpr (phase == 2)
+        f = _mm512_ternarylogic_epi32(b, c, d, 0xE8);
+    else
+        f = _mm512_ternarylogic_epi32(b, c, d, 0x96);
+
+    __m512i temp = _mm512_add_epi32(
+        _mm512_add_epi32(_mm512_rol_epi32(a, 5), f),
+        _mm512_add_epi32(
+            _mm512_add_epi32(e, w[i & 15]),
+            _mm512_set1_epi32(static_cast<int>(roundConstants[phase]))));
+    e = d;
+    d = c;
+    c = _mm512_rol_epi32(b, 30);
+    b = a;
+    a = temp;
+}
+
+SHA1_AVX512_TARGET static void compress16(__m512i state[5],
+                                          uint8_t const* const* lanes,
+                                          size_t blocks) {
+    __m512i const byteSwap = _mm512_set_epi64(
+        0x0c0d0e0f08090a0bLL, 0x0405060700010203LL, 0x0c0d0e0f08090a0bLL,
+        0x0405060700010203LL, 0x0c0d0e0f08090a0bLL, 0x0405060700010203LL,
+        0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+    uint8_t const* base = lanes[0];
+    __m512i offsetsLow = _mm512_set_epi64(
+        lanes[7] - base, lanes[6] - base, lanes[5] - base, lanes[4] - base,
+        lanes[3] - base, lanes[2] - base, lanes[1] - base, 0);
+    __m512i offsetsHigh = _mm512_set_epi64(
+        lanes[15] - base, lanes[14] - base, lanes[13] - base, lanes[12] - base,
+        lanes[11] - base, lanes[10] - base, lanes[9] - base, lanes[8] - base);
+
+    for (size_t block = 0; block < blocks; block++, base += 64) {
+        __m512i w[16];
+        for (size_t t = 0; t < 16; t++) {
+            void const* word = base + t * 4;
+            __m256i low = _mm512_i64gather_epi32(offsetsLow, word, 1);
+            __m256i high = _mm512_i64gather_epi32(offsetsHigh, word, 1);
+            w[t] = _mm512_shuffle_epi8(
+                _mm512_inserti64x4(_mm512_castsi256_si512(low), high, 1),
+                byteSwap);
+        }
+
+        __m512i a = state[0], b = state[1], c = state[2], d = state[3],
+                e = state[4];
+        for (size_t i = 0; i < 20; i++) round16<0>(a, b, c, d, e, w, i);
+        for (size_t i = 20; i < 40; i++) round16<1>(a, b, c, d, e, w, i);
+        for (size_t i = 40; i < 60; i++) round16<2>(a, b, c, d, e, w, i);
+        for (size_t i = 60; i < 80; i++) round16<3>(a, b, c, d, e, w, i);
+
+        state[0] = _mm512_add_epi32(state[0], a);
+        state[1] = _mm512_add_epi32(state[1], b);
+        state[2] = _mm512_add_epi32(state[2], c);
+        state[3] = _mm512_add_epi32(state[3], d);
+        state[4] = _mm512_add_epi32(state[4], e);
+    }
+}
+
+SHA1_AVX512_TARGET static void hash16(uint8_t const* const* messages,
+                                      size_t size, uint8_t (*digests)[20]) {
+    __m512i state[5];
+    for (size_t w = 0; w < 5; w++)
+        state[w] = _mm512_set1_epi32(static_cast<int>(initialState[w]));
+
+    compress16(state, messages, size / 64);
+
+    alignas(64) uint8_t tails[16][128];
+    uint8_t const* tailLanes[16];
+    size_t tailBlocks = 0;
+    for (size_t lane = 0; lane < 16; lane++) {
+        tailBlocks = paddedTail(messages[lane], size, tails[lane]);
+        tailLanes[lane] = tails[lane];
+    }
+    compress16(state, tailLanes, tailBlocks);
+
+    alignas(64) uint32_t words[5 * 16];
+    for (size_t w = 0; w < 5; w++) _mm512_store_si512(words + w * 16, state[w]);
+    storeDigests(words, 16, digests);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+bool isSupported(BatchImplementation implementation) {
+    switch (implementation) {
+        case BatchImplementation::single:
+            return true;
+#ifdef SHA1_BATCH_X86
+        case BatchImplementation::avx2:
+            return __builtin_cpu_supports("avx2");
+        case BatchImplementation::avx512:
+            return __builtin_cpu_supports("avx512f") &&
+                   __builtin_cpu_supports("avx512bw");
+#endif
+        default:
+            return false;
+    }
+}
+
+BatchImplementation bestBatchImplementation() {
+    static BatchImplementation const implementation =
+        isSupported(BatchImplementation::avx512) ? BatchImplementation::avx512
+        : isSupported(BatchImplementation::avx2) ? BatchImplementation::avx2
+                                                 : BatchImplementation::single;
+    return implementation;
+}
+
+void hashBatch(uint8_t const* const* messages, size_t count, size_t size,
+               uint8_t (*digests)[20], BatchImplementation implementation) {
+    if (!isSupported(implementation))
+        implementation = BatchImplementation::single;
+
+    size_t i = 0;
+#ifdef SHA1_BATCH_X86
+    if (implementation == BatchImplementation::avx512)
+        for (; i + 16 <= count; i += 16)
+            hash16(messages + i, size, digests + i);
+    // AVX-512 CPUs have AVX2, for the last 8 to 15 messages
+    if (implementation != BatchImplementation::single)
+        for (; i + 8 <= count; i += 8) hash8(messages + i, size, digests + i);
+#endif
+
+    // fewer messages than lanes left
+    for (; i < count; i++)
+        SHA1().processBytes(messages[i], size).getDigestBytes(digests[i]);
+}
+
+}  // namespace sha1
@@ -0,0 +1,312 @@
+// SHA-256 compression functions and runtime dispatch. The hardware kernels
+// follow the reference sequences of the Intel SHA extensions and ARMv8
+// crypto extensions, 4 rounds per group.
+// As for SHA1, the ARMv8 kernel is only built with ARMV8_SHA.
+#include "lib/sha256.hpp"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(ARMV8_SHA)
+#define SHA256_ARM 1
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#if defined(__clang__)
+#define SHA256_ARM_TARGET __attribute__((target("crypto")))
+#else
+#define SHA256_ARM_TARGET __attribute__((target("+crypto")))
+#endif
+#endif
+
+namespace sha256 {
+
+alignas(16) static uint32_t const K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+// ===== SHA256 =====
+
+SHA256& SHA256::reset() {
+    static uint32_t const initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                        0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                        0x1f83d9ab, 0x5be0cd19};
+    memcpy(m_state, initial, sizeof(m_state));
+    m_blockByteIndex = 0;
+    m_byteCount = 0;
+    return *this;
+}
+
+SHA256& SHA256::processBytes(void const* data, size_t len) {
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    m_byteCount += len;
+
+    if (m_blockByteIndex != 0) {
+        size_t head = std::min(len, 64 - m_blockByteIndex);
+        memcpy(m_block + m_blockByteIndex, bytes, head);
+        m_blockByteIndex += head;
+        bytes += head;
+        len -= head;
+        if (m_blockByteIndex < 64) return *this;
+        m_compress(m_state, m_block, 1);
+        m_blockByteIndex = 0;
+    }
+
+    m_compress(m_state, bytes, len / 64);
+    bytes += len / 64 * 64;
+    len %= 64;
+
+    memcpy(m_block, bytes, len);
+    m_blockByteIndex = len;
+    return *this;
+}
+
+uint8_t const* SHA256::getDigestBytes(digest8_t digest) {
+    uint64_t bitCount = m_byteCount * 8;
+
+    // 0x80, zeroes up to 56 mod 64, then the big endian bit count
+    uint8_t padding[128] = {0x80};
+    size_t padLength = (m_blockByteIndex < 56 ? 56 : 120) - m_blockByteIndex;
+    for (size_t i = 0; i < 8; i++)
+        padding[padLength + i] = static_cast<uint8_t>(bitCount >> (56 - i * 8));
+    processBytes(padding, padLength + 8);
+
+    for (size_t i = 0; i < 8; i++)
+        for (size_t j = 0; j < 4; j++)
+            digest[i * 4 + j] = static_cast<uint8_t>(m_state[i] >> (24 - j * 8));
+    return digest;
+}
+
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+void SHA256::processBlocks(uint32_t state[8], uint8_t const* blocks,
+                           size_t count) {
+    for (; count > 0; count--, blocks += 64) {
+        uint32_t w[64];
+        for (size_t t = 0; t < 16; t++)
+            w[t] = static_cast<uint32_t>(blocks[t * 4]) << 24 |
+                   static_cast<uint32_t>(blocks[t * 4 + 1]) << 16 |
+                   static_cast<uint32_t>(blocks[t * 4 + 2]) << 8 |
+                   static_cast<uint32_t>(blocks[t * 4 + 3]);
+        for (size_t t = 16; t < 64; t++) {
+            uint32_t s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^
+                          (w[t - 15] >> 3);
+            uint32_t s1 =
+                rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+                 e = state[4], f = state[5], g = state[6], h = state[7];
+        for (size_t t = 0; t < 64; t++) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t temp1 = h + s1 + ch + K[t] + w[t];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t temp2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef SHA256_X86
+
+#define SHA256_SHANI_TARGET __attribute__((target("sha,sse4.1")))
+
+// Rounds 4g..4g+3. m[g % 4] holds words 4g..4g+3, the next ones are
+// computed as they go.
+template <int g>
+SHA256_SHANI_TARGET static inline void shaniRounds(__m128i& state0,
+                                                   __m128i& state1,
+                                                   __m128i m[4],
+                                                   uint8_t const* block) {
+    __m128i const byteSwap =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    if constexpr (g < 4)
+        m[g] = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + g * 16)),
+            byteSwap);
+
+    __m128i msg = _mm_add_epi32(
+        m[g % 4], _mm_load_si128(reinterpret_cast<__m128i const*>(K + g * 4)));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    if constexpr (g >= 3 && g <= 14) {
+        __m128i& next = m[(g + 1) % 4];
+        next = _mm_add_epi32(next,
+                             _mm_alignr_epi8(m[g % 4], m[(g + 3) % 4], 4));
+        next = _mm_sha256msg2_epu32(next, m[g % 4]);
+    }
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+    if constexpr (g >= 1 && g <= 12)
+        m[(g + 3) % 4] = _mm_sha256msg1_epu32(m[(g + 3) % 4], m[g % 4]);
+}
+
+template <int... g>
+SHA256_SHANI_TARGET static inline void shaniBlock(
+    __m128i& state0, __m128i& state1, __m128i m[4], uint8_t const* block,
+    std::integer_sequence<int, g...>) {
+    (shaniRounds<g>(state0, state1, m, block), ...);
+}
+
+SHA256_SHANI_TARGET static void compressShani(uint32_t state[8],
+                                              uint8_t const* blocks,
+                                              size_t count) {
+    // the rounds instruction works on ABEF and CDGH
+    __m128i abcd = _mm_shuffle_epi32(
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(state)), 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(state + 4)), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(abcd, efgh, 8);
+    __m128i state1 = _mm_blend_epi16(efgh, abcd, 0xF0);
+    __m128i m[4];
+
+    for (; count > 0; count--, blocks += 64) {
+        __m128i save0 = state0;
+        __m128i save1 = state1;
+        shaniBlock(state0, state1, m, blocks,
+                   std::make_integer_sequence<int, 16>());
+        state0 = _mm_add_epi32(state0, save0);
+        state1 = _mm_add_epi32(state1, save1);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(state0, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                     _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4),
+                     _mm_alignr_epi8(dchg, feba, 8));
+}
+
+static bool cpuHasShani() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    return (ebx & (1u << 29)) != 0 && __builtin_cpu_supports("sse4.1");
+}
+
+#endif
+
+#ifdef SHA256_ARM
+
+SHA256_ARM_TARGET static void compressArmv8(uint32_t state[8],
+                                            uint8_t const* blocks,
+                                            size_t count) {
+    uint32x4_t state0 = vld1q_u32(state);
+    uint32x4_t state1 = vld1q_u32(state + 4);
+
+    for (; count > 0; count--, blocks += 64) {
+        uint32x4_t save0 = state0;
+        uint32x4_t save1 = state1;
+
+        uint32x4_t m[4];
+        for (int i = 0; i < 4; i++)
+            m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + i * 16)));
+
+        for (int g = 0; g < 16; g++) {
+            uint32x4_t msg = vaddq_u32(m[g % 4], vld1q_u32(K + g * 4));
+            if (g < 12) m[g % 4] = vsha256su0q_u32(m[g % 4], m[(g + 1) % 4]);
+            uint32x4_t previous = state0;
+            state0 = vsha256hq_u32(state0, state1, msg);
+            state1 = vsha256h2q_u32(state1, previous, msg);
+            if (g < 12)
+                m[g % 4] =
+                    vsha256su1q_u32(m[g % 4], m[(g + 2) % 4], m[(g + 3) % 4]);
+        }
+
+        state0 = vaddq_u32(state0, save0);
+        state1 = vaddq_u32(state1, save1);
+    }
+
+    vst1q_u32(state, state0);
+    vst1q_u32(state + 4, state1);
+}
+
+static bool cpuHasArmv8Sha256() {
+#if defined(__APPLE__)
+    return true;
+#elif defined(__linux__) && defined(HWCAP_SHA2)
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif
+
+bool isSupported(Implementation implementation) {
+    switch (implementation) {
+        case Implementation::portable:
+            return true;
+#ifdef SHA256_X86
+        case Implementation::shani: {
+            static bool const supported = cpuHasShani();
+            return supported;
+        }
+#endif
+#ifdef SHA256_ARM
+        case Implementation::armv8: {
+            static bool const supported = cpuHasArmv8Sha256();
+            return supported;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+Implementation bestImplementation() {
+    static Implementation const implementation =
+        isSupported(Implementation::shani)   ? Implementation::shani
+        : isSupported(Implementation::armv8) ? Implementation::armv8
+                                             : Implementation::portable;
+    return implementation;
+}
+
+CompressFunction compressFunction(Implementation implementation) {
+    if (!isSupported(implementation)) implementation = Implementation::portable;
+    switch (implementation) {
+#ifdef SHA256_X86
+        case Implementation::shani:
+            return compressShani;
+#endif
+#ifdef SHA256_ARM
+        case Implementation::armv8:
+            return compressArmv8;
+#endif
+        default:
+            return SHA256::processBlocks;
+    }
+}
+
+}  // namespace sha256
@@ -0,0 +1,53 @@
+// SHA-256 (FIPS 180-4), for BitTorrent v2 merkle trees (BEP 52).
+// Same interface and runtime dispatch as sha1.hpp.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sha256 {
+
+// Compresses `count` 64-byte blocks into the eight state words
+typedef void (*CompressFunction)(uint32_t state[8], uint8_t const* blocks,
+                                 size_t count);
+
+enum class Implementation { portable, shani, armv8 };
+
+// Implementations are selected at runtime, see sha256.cpp
+bool isSupported(Implementation implementation);
+// Fastest implementation supported by the CPU, detected once
+Implementation bestImplementation();
+// Falls back to the portable implementation if `implementation` is not
+// supported
+CompressFunction compressFunction(Implementation implementation);
+
+class SHA256 {
+   public:
+    typedef uint8_t digest8_t[32];
+
+    SHA256() : SHA256(bestImplementation()) {}
+    explicit SHA256(Implementation implementation)
+        : m_compress(compressFunction(implementation)) {
+        reset();
+    }
+
+    SHA256& reset();
+    // Whole blocks are compressed straight from the input, only an
+    // unaligned head and tail are buffered
+    SHA256& processBytes(void const* data, size_t len);
+    // Pads the message; call reset() before reusing the object
+    uint8_t const* getDigestBytes(digest8_t digest);
+
+    // Portable compression function
+    static void processBlocks(uint32_t state[8], uint8_t const* blocks,
+                              size_t count);
+
+   private:
+    CompressFunction m_compress;
+    uint32_t m_state[8];
+    uint8_t m_block[64];
+    size_t m_blockByteIndex;
+    uint64_t m_byteCount;
+};
+
+}  // namespace sha256
@@ -60,6 +60,19 @@ std::vector<uint8_t> sha1_hash(uint8_t const* data, size_t size) {
     return result;
 }
 
+Sha1Digest sha1_digest(uint8_t const* data, size_t size) {
+    Sha1Digest digest;
+    sha1::SHA1().processBytes(data, size).getDigestBytes(digest.data());
+    return digest;
+}
+
+void sha1_hash_batch(uint8_t const* const* buffers, size_t count, size_t size,
+                     Sha1Digest* digests) {
+    static_assert(sizeof(Sha1Digest) == 20);
+    sha1::hashBatch(buffers, count, size,
+                    reinterpret_cast<uint8_t(*)[20]>(digests));
+}
+
 }  // namespace utils
 
 }  // namespace bittorrent
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "sha1_digest.hpp"
 #include <cstdint>
 #include <iomanip>
 #include <sstream>
@@ -13,6 +14,11 @@ std::string url_encode(std::string const& value);
 
 std::vector<uint8_t> hex_to_bytes(std::string const& hex);
 std::vector<uint8_t> sha1_hash(uint8_t const* data, size_t size);
+Sha1Digest sha1_digest(uint8_t const* data, size_t size);
+// SHA1 of `count` buffers of `size` bytes each, hashed in parallel SIMD lanes
+// when the CPU allows it (pieces of a torrent all have the same length)
+void sha1_hash_batch(uint8_t const* const* buffers, size_t count, size_t size,
+                     Sha1Digest* digests);
 
 }  // namespace utils
 }  // namespace bittorrent
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace bittorrent {
+
+std::optional<MappedFile> MappedFile::open(std::filesystem::path const& path,
+                                           std::error_code& ec) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        ec = std::error_code(errno, std::system_category());
+        return {};
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ec = std::error_code(errno, std::system_category());
+        ::close(fd);
+        return {};
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    // mmap does not map empty files
+    if (size == 0) {
+        ::close(fd);
+        return MappedFile(nullptr, 0);
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        ec = std::error_code(errno, std::system_category());
+        return {};
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    return MappedFile(static_cast<uint8_t const*>(data), size);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+// madvise wants page-aligned addresses
+static void advise(uint8_t const* data, size_t size, size_t offset,
+                   size_t length, int advice) {
+    if (data == nullptr || offset >= size) return;
+    static size_t const page_size = sysconf(_SC_PAGESIZE);
+    size_t begin = offset / page_size * page_size;
+    size_t end = std::min(offset + length, size);
+    madvise(const_cast<uint8_t*>(data) + begin, end - begin, advice);
+}
+
+void MappedFile::will_need(size_t offset, size_t length) const {
+    advise(data_, size_, offset, length, MADV_WILLNEED);
+}
+
+void MappedFile::dont_need(size_t offset, size_t length) const {
+    advise(data_, size_, offset, length, MADV_DONTNEED);
+}
+
+}  // namespace bittorrent
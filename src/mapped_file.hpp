@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <system_error>
+
+namespace bittorrent {
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+   public:
+    static std::optional<MappedFile> open(std::filesystem::path const& path,
+                                          std::error_code& ec);
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+    ~MappedFile();
+
+    uint8_t const* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Starts reading the pages of [offset, offset + length) in the
+    // background
+    void will_need(size_t offset, size_t length) const;
+    // The pages of [offset, offset + length) can be dropped from the
+    // mapping, they stay in the page cache
+    void dont_need(size_t offset, size_t length) const;
+
+   private:
+    MappedFile(uint8_t const* data, size_t size) : data_(data), size_(size) {}
+
+    uint8_t const* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+}  // namespace bittorrent
@@ -0,0 +1,151 @@
+#include "merkle.hpp"
+#include "lib/sha256.hpp"
+#include <algorithm>
+
+namespace bittorrent {
+namespace merkle {
+
+Sha256Digest hash_leaf(uint8_t const* data, size_t size) {
+    Sha256Digest digest;
+    sha256::SHA256().processBytes(data, size).getDigestBytes(digest.data());
+    return digest;
+}
+
+Sha256Digest hash_parent(Sha256Digest const& left, Sha256Digest const& right) {
+    uint8_t pair[64];
+    std::copy(left.begin(), left.end(), pair);
+    std::copy(right.begin(), right.end(), pair + 32);
+    return hash_leaf(pair, sizeof(pair));
+}
+
+Sha256Digest zero_root(size_t leaves) {
+    Sha256Digest node{};
+    for (; leaves > 1; leaves /= 2) node = hash_parent(node, node);
+    return node;
+}
+
+size_t tree_width(size_t count) {
+    size_t width = 1;
+    while (width < count) width *= 2;
+    return width;
+}
+
+Sha256Digest root(std::span<Sha256Digest const> nodes, size_t width,
+                  Sha256Digest const& pad) {
+    if (nodes.empty() && width <= 1) return pad;
+    std::vector<Sha256Digest> level(nodes.begin(), nodes.end());
+    Sha256Digest level_pad = pad;
+    for (; width > 1; width /= 2) {
+        std::vector<Sha256Digest> parents((level.size() + 1) / 2);
+        for (size_t i = 0; i < parents.size(); i++)
+            parents[i] = hash_parent(
+                level[i * 2], i * 2 + 1 < level.size() ? level[i * 2 + 1]
+                                                       : level_pad);
+        level = std::move(parents);
+        level_pad = hash_parent(level_pad, level_pad);
+    }
+    return level.empty() ? level_pad : level[0];
+}
+
+std::vector<Sha256Digest> leaves(uint8_t const* data, size_t size) {
+    std::vector<Sha256Digest> result;
+    for (size_t begin = 0; begin < size; begin += BLOCK_SIZE)
+        result.push_back(
+            hash_leaf(data + begin, std::min(BLOCK_SIZE, size - begin)));
+    return result;
+}
+
+Sha256Digest file_root(uint8_t const* data, size_t size) {
+    if (size == 0) return {};
+    auto hashes = leaves(data, size);
+    return root(hashes, tree_width(hashes.size()), Sha256Digest{});
+}
+
+std::vector<Sha256Digest> piece_layer(uint8_t const* data, size_t size,
+                                      size_t piece_length) {
+    if (size <= piece_length) return {};
+    size_t const width = piece_length / BLOCK_SIZE;
+    std::vector<Sha256Digest> layer;
+    for (size_t begin = 0; begin < size; begin += piece_length) {
+        auto hashes =
+            leaves(data + begin, std::min(piece_length, size - begin));
+        layer.push_back(root(hashes, width, Sha256Digest{}));
+    }
+    return layer;
+}
+
+Sha256Digest root_from_piece_layer(std::span<Sha256Digest const> layer,
+                                   size_t piece_length) {
+    return root(layer, tree_width(layer.size()),
+                zero_root(piece_length / BLOCK_SIZE));
+}
+
+bool verify_proof(Sha256Digest const& leaf, size_t index,
+                  std::span<Sha256Digest const> proof,
+                  Sha256Digest const& root) {
+    Sha256Digest node = leaf;
+    for (Sha256Digest const& sibling : proof) {
+        node = index % 2 == 0 ? hash_parent(node, sibling)
+                              : hash_parent(sibling, node);
+        index /= 2;
+    }
+    return index == 0 && node == root;
+}
+
+}  // namespace merkle
+
+// ===== BlockVerifier =====
+
+BlockVerifier::BlockVerifier(Sha256Digest const& piece_hash,
+                             size_t piece_size, size_t width)
+    : piece_hash_(piece_hash),
+      piece_size_(piece_size),
+      width_(width),
+      hashes_((piece_size + merkle::BLOCK_SIZE - 1) / merkle::BLOCK_SIZE),
+      have_(hashes_.size(), false) {}
+
+bool BlockVerifier::set_leaves(std::span<Sha256Digest const> leaves) {
+    if (trusted_) return true;
+    if (leaves.size() != hashes_.size() ||
+        merkle::root(leaves, width_, Sha256Digest{}) != piece_hash_)
+        return false;
+
+    // blocks received before are checked now
+    for (size_t i = 0; i < hashes_.size(); i++) {
+        if (have_[i] && hashes_[i] != leaves[i]) {
+            have_[i] = false;
+            received_--;
+        }
+        hashes_[i] = leaves[i];
+    }
+    trusted_ = true;
+    return true;
+}
+
+BlockVerifier::Status BlockVerifier::add_block(size_t index,
+                                               uint8_t const* data,
+                                               size_t size) {
+    size_t begin = index * merkle::BLOCK_SIZE;
+    if (index >= hashes_.size() ||
+        size != std::min(merkle::BLOCK_SIZE, piece_size_ - begin))
+        return Status::bad;
+
+    Sha256Digest leaf = merkle::hash_leaf(data, size);
+    if (trusted_ && leaf != hashes_[index]) return Status::bad;
+
+    if (!have_[index]) {
+        have_[index] = true;
+        received_++;
+    }
+    if (trusted_) return Status::ok;
+    hashes_[index] = leaf;
+    return Status::pending;
+}
+
+std::optional<bool> BlockVerifier::passed() const {
+    if (!complete()) return {};
+    if (trusted_) return true;
+    return merkle::root(hashes_, width_, Sha256Digest{}) == piece_hash_;
+}
+
+}  // namespace bittorrent
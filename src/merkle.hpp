@@ -0,0 +1,121 @@
+#pragma once
+
+#include "sha1_digest.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace bittorrent {
+
+// SHA-256 digest, the node type of BitTorrent v2 merkle trees
+using Sha256Digest = std::array<uint8_t, 32>;
+
+// Digests stored back to back, as in the `piece layers` of a v2 torrent,
+// viewed in place. A partial digest at the end is left out.
+inline std::span<Sha256Digest const> sha256_digests_view(
+    std::string_view concatenated) {
+    static_assert(sizeof(Sha256Digest) == 32 && alignof(Sha256Digest) == 1);
+    return {reinterpret_cast<Sha256Digest const*>(concatenated.data()),
+            concatenated.size() / sizeof(Sha256Digest)};
+}
+
+// Merkle trees of BitTorrent v2 files (BEP 52)
+// https://www.bittorrent.org/beps/bep_0052.html
+//
+// The leaves are the SHA-256 of the 16 KiB blocks of a file, the last one
+// possibly shorter. The tree is padded to a power of two leaves with
+// zero hashes. The root of a file is its `pieces root`; the nodes covering
+// `piece length` bytes form its piece layer.
+namespace merkle {
+
+constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+Sha256Digest hash_leaf(uint8_t const* data, size_t size);
+Sha256Digest hash_parent(Sha256Digest const& left, Sha256Digest const& right);
+
+// Root of a subtree of `leaves` zero leaves (a power of two)
+Sha256Digest zero_root(size_t leaves);
+
+// Root of a tree of `width` nodes (a power of two): `nodes` followed by
+// `pad` nodes
+Sha256Digest root(std::span<Sha256Digest const> nodes, size_t width,
+                  Sha256Digest const& pad);
+
+// Smallest power of two greater than or equal to `count` (1 for 0)
+size_t tree_width(size_t count);
+
+// Leaf hashes of `size` bytes of data
+std::vector<Sha256Digest> leaves(uint8_t const* data, size_t size);
+
+// Pieces root of a file of `size` bytes (zeroes for an empty file)
+Sha256Digest file_root(uint8_t const* data, size_t size);
+
+// Hash of each `piece_length` bytes of a file, the last piece padded with
+// zero leaves. Files of at most one piece have no piece layer.
+std::vector<Sha256Digest> piece_layer(uint8_t const* data, size_t size,
+                                      size_t piece_length);
+
+// Pieces root of a file from its piece layer
+Sha256Digest root_from_piece_layer(std::span<Sha256Digest const> layer,
+                                   size_t piece_length);
+
+// Checks that `leaf` is leaf `index` of the tree of `root`, given the
+// sibling hashes from the leaf up to the root
+bool verify_proof(Sha256Digest const& leaf, size_t index,
+                  std::span<Sha256Digest const> proof,
+                  Sha256Digest const& root);
+
+}  // namespace merkle
+
+// Checks the 16 KiB blocks of one v2 piece against its hash, the node of the
+// piece layer (or the pieces root of a file of at most one piece).
+//
+// Once the leaf hashes of the piece are known (received from a peer and
+// checked against the piece hash with set_leaves), every block is checked
+// as it arrives, so a corrupt block is pinned to the peer that sent it.
+// Otherwise the blocks are checked together when the last one arrives.
+class BlockVerifier {
+   public:
+    enum class Status {
+        // the block matches its leaf hash
+        ok,
+        // the block does not match, the other blocks are unaffected
+        bad,
+        // stored, checked with the whole piece
+        pending,
+    };
+
+    // `piece_size` bytes of data in a subtree of `width` leaves: the blocks
+    // of a piece of a larger file (piece_length / 16 KiB), or
+    // tree_width(blocks) for a file of at most one piece
+    BlockVerifier(Sha256Digest const& piece_hash, size_t piece_size,
+                  size_t width);
+
+    size_t block_count() const { return hashes_.size(); }
+
+    // Leaf hashes of the blocks of the piece; false, and ignored, if they do
+    // not hash to the piece hash
+    bool set_leaves(std::span<Sha256Digest const> leaves);
+
+    Status add_block(size_t index, uint8_t const* data, size_t size);
+
+    // Every block was received
+    bool complete() const { return received_ == hashes_.size(); }
+    // Whether the piece matches its hash, nullopt until complete
+    std::optional<bool> passed() const;
+
+   private:
+    Sha256Digest piece_hash_;
+    size_t piece_size_;
+    size_t width_;
+    // known leaf hashes, checked against the piece hash
+    bool trusted_ = false;
+    std::vector<Sha256Digest> hashes_;
+    std::vector<bool> have_;
+    size_t received_ = 0;
+};
+
+}  // namespace bittorrent
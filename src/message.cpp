@@ -1,6 +1,8 @@
 #include "message.hpp"
 #include <arpa/inet.h>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 namespace bittorrent {
 Message::Message(message_type type, std::vector<uint8_t>&& payload)
@@ -49,6 +51,34 @@ Message Message::make_request(uint32_t index, uint32_t begin, uint32_t length) {
     return message;
 }
 
+Message Message::make_hash_request(HashRequest const& request) {
+    return Message(message_type::hash_request, request.serialize());
+}
+
+std::optional<HashRequest> HashRequest::parse(
+    std::span<uint8_t const> payload) {
+    // payload format: <pieces root><base layer><index><length><proof layers>
+    if (payload.size() < SIZE) return {};
+    HashRequest request;
+    std::copy(payload.begin(), payload.begin() + 32,
+              request.pieces_root.begin());
+    uint32_t fields[4];
+    std::memcpy(fields, payload.data() + 32, sizeof(fields));
+    request.base_layer = ntohl(fields[0]);
+    request.index = ntohl(fields[1]);
+    request.length = ntohl(fields[2]);
+    request.proof_layers = ntohl(fields[3]);
+    return request;
+}
+
+std::vector<uint8_t> HashRequest::serialize() const {
+    std::vector<uint8_t> payload(pieces_root.begin(), pieces_root.end());
+    payload.reserve(SIZE);
+    for (uint32_t field : {base_layer, index, length, proof_layers})
+        push_uint32_t(payload, htonl(field));
+    return payload;
+}
+
 Block Message::parse_block() const {
     // payload format: <index><begin><block>
     assert(type == message_type::piece);
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "merkle.hpp"
 #include <cstdint>
+#include <optional>
+#include <span>
 #include <vector>
 
 namespace bittorrent {
@@ -15,6 +18,10 @@ enum class message_type {
     request = 6,
     piece = 7,
     cancel = 8,
+    // BitTorrent v2 (BEP 52)
+    hash_request = 21,
+    hashes = 22,
+    hash_reject = 23,
 };
 
 struct Block {
@@ -23,12 +30,35 @@ struct Block {
     std::vector<uint8_t> data;
 };
 
+// Start of the payload of the hash request, hashes and hash reject messages:
+// `length` nodes of the merkle tree of a file from `index` in `base_layer`
+// (0: the leaves), and the uncles of their subtree. `proof_layers` counts
+// the layers from the base one, those of the subtree need no uncle.
+// A hashes message follows it with the nodes, then the uncles from the
+// lowest layer up.
+struct HashRequest {
+    static constexpr size_t SIZE = 48;
+
+    Sha256Digest pieces_root;
+    uint32_t base_layer;
+    uint32_t index;
+    uint32_t length;
+    uint32_t proof_layers;
+
+    // nullopt if `payload` is shorter than SIZE
+    static std::optional<HashRequest> parse(std::span<uint8_t const> payload);
+    std::vector<uint8_t> serialize() const;
+
+    bool operator==(HashRequest const&) const = default;
+};
+
 struct Message {
     Message(message_type type, std::vector<uint8_t>&& payload);
     Message(message_type type);
 
     static Message make_request(uint32_t index, uint32_t begin,
                                 uint32_t length);
+    static Message make_hash_request(HashRequest const& request);
 
     std::vector<uint8_t> serialize() const;
     Block parse_block() const;
@@ -0,0 +1,142 @@
+#include "message_reader.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+
+namespace bittorrent {
+
+static uint32_t load_length(uint8_t const* data) {
+    uint32_t length;
+    std::memcpy(&length, data, sizeof(length));
+    return ntohl(length);
+}
+
+MessageReader::MessageReader(size_t capacity) : buffer_(capacity) {}
+
+// piece message up to its block: <length><id><index><begin>
+constexpr size_t PIECE_HEADER_SIZE = 13;
+
+std::optional<MessageView> MessageReader::frame(bool split_blocks,
+                                                std::error_code& ec) {
+    // message format: <length><message_id><payload>
+    if (buffered() < 4) return {};
+    uint32_t length = load_length(buffer_.data() + begin_);
+    if (length > MAX_MESSAGE_SIZE) {
+        ec = errors::make_error_code(
+            errors::error_code_enum::message_too_large);
+        return {};
+    }
+    uint8_t const* message = buffer_.data() + begin_ + 4;
+
+    if (split_blocks && length >= PIECE_HEADER_SIZE - 4 &&
+        buffered() >= PIECE_HEADER_SIZE &&
+        message[0] == static_cast<uint8_t>(message_type::piece)) {
+        begin_ += PIECE_HEADER_SIZE;
+        pending_block_ = length - (PIECE_HEADER_SIZE - 4);
+        return MessageView{length, message[0], {message + 1, 8}};
+    }
+
+    if (buffered() - 4 < length) return {};
+    begin_ += 4 + length;
+    if (length == 0) return MessageView{0, 0, {}};
+    return MessageView{length, message[0], {message + 1, length - 1}};
+}
+
+std::optional<MessageView> MessageReader::next(std::error_code& ec) {
+    return frame(false, ec);
+}
+
+std::optional<MessageView> MessageReader::read(int socket_fd,
+                                               std::error_code& ec) {
+    while (true) {
+        auto message = frame(false, ec);
+        if (message || ec) return message;
+        ec = fill(socket_fd);
+        if (ec) return {};
+    }
+}
+
+std::optional<MessageView> MessageReader::read_until_block(
+    int socket_fd, std::error_code& ec) {
+    while (true) {
+        auto message = frame(true, ec);
+        if (message || ec) return message;
+        ec = fill(socket_fd);
+        if (ec) return {};
+    }
+}
+
+std::error_code MessageReader::read_block(int socket_fd,
+                                          uint8_t* destination) {
+    size_t const size = pending_block_;
+    size_t done = std::min(buffered(), size);
+    std::memcpy(destination, buffer_.data() + begin_, done);
+    begin_ += done;
+    block_bytes_copied_ += done;
+
+    // MSG_WAITALL: the rest of the block in one call, unless interrupted
+    while (done < size) {
+        ssize_t r = recv(socket_fd, destination + done, size - done,
+                         MSG_WAITALL);
+        recv_calls_++;
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0)
+            return errors::make_error_code(errors::error_code_enum::peer_recv);
+        if (r == 0)
+            return errors::make_error_code(
+                errors::error_code_enum::peer_disconnected);
+        done += static_cast<size_t>(r);
+        block_bytes_direct_ += static_cast<uint64_t>(r);
+    }
+    pending_block_ = 0;
+    return {};
+}
+
+std::error_code MessageReader::skip_block(int socket_fd) {
+    while (pending_block_ > 0) {
+        if (buffered() == 0) {
+            std::error_code ec = fill(socket_fd);
+            if (ec) return ec;
+        }
+        size_t skipped = std::min(buffered(), pending_block_);
+        begin_ += skipped;
+        pending_block_ -= skipped;
+    }
+    return {};
+}
+
+std::error_code MessageReader::fill(int socket_fd) {
+    if (begin_ == end_) begin_ = end_ = 0;
+
+    // room for the rest of the next message, or at least its length
+    size_t needed = 4;
+    if (buffered() >= 4)
+        needed = std::max<size_t>(
+            needed, 4 + std::min<size_t>(load_length(buffer_.data() + begin_),
+                                         MAX_MESSAGE_SIZE));
+    if (buffer_.size() - begin_ < needed || end_ == buffer_.size()) {
+        std::memmove(buffer_.data(), buffer_.data() + begin_, buffered());
+        end_ -= begin_;
+        begin_ = 0;
+    }
+    if (buffer_.size() < needed) buffer_.resize(needed);
+
+    while (true) {
+        ssize_t r = recv(socket_fd, buffer_.data() + end_,
+                         buffer_.size() - end_, 0);
+        recv_calls_++;
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0)
+            return errors::make_error_code(errors::error_code_enum::peer_recv);
+        if (r == 0)
+            return errors::make_error_code(
+                errors::error_code_enum::peer_disconnected);
+        end_ += static_cast<size_t>(r);
+        return {};
+    }
+}
+
+}  // namespace bittorrent
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "message.hpp"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <vector>
+
+namespace bittorrent {
+
+// A message framed in the buffer of a MessageReader, valid until the next
+// fill or read
+struct MessageView {
+    // length prefix: id and payload, 0 for a keep-alive
+    uint32_t length;
+    // unset for a keep-alive
+    uint8_t id;
+    std::span<uint8_t const> payload;
+
+    bool keep_alive() const { return length == 0; }
+    message_type type() const { return static_cast<message_type>(id); }
+};
+
+// Receive buffer of a peer connection. Each recv takes as much as the socket
+// has, and the complete messages in the buffer are framed in place, so a
+// run of small messages, or a piece message of a 16 KiB block, costs about
+// one syscall and no allocation.
+class MessageReader {
+   public:
+    // several piece messages of 16 KiB blocks
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+    // longer messages are rejected, the largest is a bitfield (16M pieces)
+    static constexpr size_t MAX_MESSAGE_SIZE = 2 * 1024 * 1024 + 1;
+
+    explicit MessageReader(size_t capacity = DEFAULT_CAPACITY);
+
+    // Next message already in the buffer, nullopt if it is not complete yet
+    std::optional<MessageView> next(std::error_code& ec);
+    // Next message, received from `socket_fd` until it is complete
+    std::optional<MessageView> read(int socket_fd, std::error_code& ec);
+
+    // Same as read, except that only the 13-byte header of a piece message
+    // is framed: the payload of the view holds its index and begin, and the
+    // pending_block() bytes of the block must then be taken with read_block
+    // or skip_block before anything else is read.
+    std::optional<MessageView> read_until_block(int socket_fd,
+                                                std::error_code& ec);
+    // Size of the block after a header framed by read_until_block
+    size_t pending_block() const { return pending_block_; }
+    // Writes the pending block to `destination`. Its bytes already received
+    // with the header are copied from the buffer, the rest is received
+    // straight into `destination`.
+    std::error_code read_block(int socket_fd, uint8_t* destination);
+    // Drops the pending block
+    std::error_code skip_block(int socket_fd);
+
+    // One recv from `socket_fd` into the free space of the buffer, which is
+    // compacted (or grown for a long message) first if needed. Views framed
+    // before are invalidated.
+    std::error_code fill(int socket_fd);
+
+    // Received bytes not framed yet
+    size_t buffered() const { return end_ - begin_; }
+    uint64_t recv_calls() const { return recv_calls_; }
+    // Block bytes received straight into their destination by read_block,
+    // and copied there from the buffer
+    uint64_t block_bytes_direct() const { return block_bytes_direct_; }
+    uint64_t block_bytes_copied() const { return block_bytes_copied_; }
+
+   private:
+    std::optional<MessageView> frame(bool split_blocks, std::error_code& ec);
+
+    std::vector<uint8_t> buffer_;
+    // unframed bytes are [begin_, end_)
+    size_t begin_ = 0;
+    size_t end_ = 0;
+    size_t pending_block_ = 0;
+    uint64_t recv_calls_ = 0;
+    uint64_t block_bytes_direct_ = 0;
+    uint64_t block_bytes_copied_ = 0;
+};
+
+}  // namespace bittorrent
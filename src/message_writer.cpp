@@ -0,0 +1,179 @@
+#include "message_writer.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace bittorrent {
+
+static uint8_t id_of(message_type type) { return static_cast<uint8_t>(type); }
+
+// The message that cancels `id` out: interested and not interested, choke
+// and unchoke
+static int opposite(uint8_t id) {
+    switch (static_cast<message_type>(id)) {
+        case message_type::choke:
+            return id_of(message_type::unchoke);
+        case message_type::unchoke:
+            return id_of(message_type::choke);
+        case message_type::interested:
+            return id_of(message_type::not_interested);
+        case message_type::not_interested:
+            return id_of(message_type::interested);
+        default:
+            return -1;
+    }
+}
+
+MessageWriter::Entry* MessageWriter::find(
+    uint8_t id, std::vector<uint8_t> const& payload) {
+    for (Entry& entry : entries_) {
+        if (entry.dropped || entry.keep_alive || entry.id != id ||
+            entry.large_payload >= 0 || entry.size != 5 + payload.size())
+            continue;
+        if (std::equal(payload.begin(), payload.end(),
+                       buffer_.begin() + entry.offset + 5))
+            return &entry;
+    }
+    return nullptr;
+}
+
+void MessageWriter::drop(Entry& entry) {
+    entry.dropped = true;
+    pending_--;
+    messages_dropped_++;
+}
+
+void MessageWriter::queue(Message message) {
+    uint8_t const id = id_of(message.type);
+    switch (message.type) {
+        case message_type::have:
+        case message_type::request:
+            if (find(id, message.payload)) {
+                messages_dropped_++;
+                return;
+            }
+            break;
+        case message_type::cancel:
+            if (Entry* request = find(id_of(message_type::request),
+                                      message.payload)) {
+                drop(*request);
+                messages_dropped_++;
+                return;
+            }
+            break;
+        default:
+            // only the last of a state change is sent
+            if (int other = opposite(id); other >= 0) {
+                for (Entry& entry : entries_)
+                    if (!entry.dropped && !entry.keep_alive &&
+                        (entry.id == id || entry.id == other))
+                        drop(entry);
+            }
+    }
+
+    // message format: <length><message_id><payload>
+    Entry entry{buffer_.size(), 5, -1, id, false, false};
+    uint32_t length = htonl(static_cast<uint32_t>(message.payload.size() + 1));
+    uint8_t header[5];
+    std::memcpy(header, &length, 4);
+    header[4] = id;
+    buffer_.insert(buffer_.end(), header, header + 5);
+    if (message.payload.size() >= INLINE_PAYLOAD) {
+        entry.large_payload = static_cast<int>(large_payloads_.size());
+        large_payloads_.push_back(std::move(message.payload));
+    } else {
+        buffer_.insert(buffer_.end(), message.payload.begin(),
+                       message.payload.end());
+        entry.size += message.payload.size();
+    }
+    entries_.push_back(entry);
+    pending_++;
+}
+
+void MessageWriter::keep_alive() {
+    for (Entry const& entry : entries_)
+        if (entry.keep_alive && !entry.dropped) {
+            messages_dropped_++;
+            return;
+        }
+    entries_.push_back(Entry{buffer_.size(), 4, -1, 0, true, false});
+    buffer_.insert(buffer_.end(), 4, 0);
+    pending_++;
+}
+
+void MessageWriter::clear() {
+    buffer_.clear();
+    entries_.clear();
+    large_payloads_.clear();
+    pending_ = 0;
+}
+
+std::error_code MessageWriter::flush(int socket_fd) {
+    if (corked() || pending_ == 0) return {};
+
+    // keep-alives only when nothing else is sent
+    bool const only_keep_alives = std::all_of(
+        entries_.begin(), entries_.end(),
+        [](Entry const& entry) { return entry.dropped || entry.keep_alive; });
+
+    // consecutive messages of the buffer are one segment
+    std::vector<iovec>& segments = segments_;
+    segments.clear();
+    for (Entry const& entry : entries_) {
+        if (entry.dropped) continue;
+        if (entry.keep_alive && !only_keep_alives) {
+            messages_dropped_++;
+            continue;
+        }
+        uint8_t* start = buffer_.data() + entry.offset;
+        if (!segments.empty() &&
+            static_cast<uint8_t*>(segments.back().iov_base) +
+                    segments.back().iov_len ==
+                start)
+            segments.back().iov_len += entry.size;
+        else
+            segments.push_back({start, entry.size});
+        if (entry.large_payload >= 0) {
+            auto& payload = large_payloads_[entry.large_payload];
+            segments.push_back({payload.data(), payload.size()});
+        }
+        messages_sent_++;
+    }
+
+    std::error_code ec;
+    for (size_t first = 0; first < segments.size();) {
+        msghdr header{};
+        header.msg_iov = segments.data() + first;
+        header.msg_iovlen = std::min<size_t>(segments.size() - first, IOV_MAX);
+        ssize_t r = sendmsg(socket_fd, &header, MSG_NOSIGNAL);
+        send_calls_++;
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) {
+            ec = errors::make_error_code(errors::error_code_enum::peer_send);
+            break;
+        }
+        // skip what was sent, the rest of a partly sent segment is next
+        auto sent = static_cast<size_t>(r);
+        while (first < segments.size() && sent >= segments[first].iov_len)
+            sent -= segments[first++].iov_len;
+        if (sent > 0) {
+            segments[first].iov_base =
+                static_cast<uint8_t*>(segments[first].iov_base) + sent;
+            segments[first].iov_len -= sent;
+        }
+    }
+    clear();
+    return ec;
+}
+
+std::error_code MessageWriter::uncork(int socket_fd) {
+    if (corked_ > 0) corked_--;
+    return flush(socket_fd);
+}
+
+}  // namespace bittorrent
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "message.hpp"
+#include <cstdint>
+#include <sys/uio.h>
+#include <system_error>
+#include <vector>
+
+namespace bittorrent {
+
+// Send queue of a peer connection. Messages are serialized into one buffer
+// as they are queued and written together by flush, with a single sendmsg
+// for the whole queue. Messages made redundant by a later one are dropped
+// before they reach the socket:
+// - a keep-alive, when anything else is sent with it
+// - an interested (choke) by a later not interested (unchoke), and back
+// - a have or a request already queued
+// - a request by its cancel, both are dropped
+class MessageWriter {
+   public:
+    // payloads at least this long are sent from the message, not copied
+    static constexpr size_t INLINE_PAYLOAD = 1024;
+
+    MessageWriter() = default;
+
+    // The payload is moved into the queue until it is flushed
+    void queue(Message message);
+    void keep_alive();
+
+    // Writes the queued messages to `socket_fd`, unless corked. The queue is
+    // emptied, even on error.
+    std::error_code flush(int socket_fd);
+
+    // While corked, flush leaves the messages queued. Corks nest.
+    void cork() { corked_++; }
+    // Flushes once the last cork is removed
+    std::error_code uncork(int socket_fd);
+    bool corked() const { return corked_ > 0; }
+
+    // Messages queued and not dropped
+    size_t pending() const { return pending_; }
+    uint64_t send_calls() const { return send_calls_; }
+    uint64_t messages_sent() const { return messages_sent_; }
+    uint64_t messages_dropped() const { return messages_dropped_; }
+
+   private:
+    struct Entry {
+        // header, and the payload unless it is in large_payload
+        size_t offset;
+        size_t size;
+        // index in large_payloads_, or -1
+        int large_payload;
+        // unset for a keep-alive
+        uint8_t id;
+        bool keep_alive;
+        bool dropped;
+    };
+
+    // The queued entry with the same id and payload, if any
+    Entry* find(uint8_t id, std::vector<uint8_t> const& payload);
+    void drop(Entry& entry);
+    void clear();
+
+    std::vector<uint8_t> buffer_;
+    std::vector<Entry> entries_;
+    std::vector<std::vector<uint8_t>> large_payloads_;
+    // iovecs of the last flush, kept for their capacity
+    std::vector<iovec> segments_;
+    size_t pending_ = 0;
+    unsigned corked_ = 0;
+    uint64_t send_calls_ = 0;
+    uint64_t messages_sent_ = 0;
+    uint64_t messages_dropped_ = 0;
+};
+
+}  // namespace bittorrent
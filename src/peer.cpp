@@ -2,9 +2,13 @@
 #include "error.hpp"
 #include "lib/utils.hpp"
 #include "message.hpp"
+#include "piece_hasher.hpp"
 #include "spdlog/spdlog.h"
 #include "torrent.hpp"
+#include <algorithm>
 #include <arpa/inet.h>
+#include <bit>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -23,33 +27,26 @@ constexpr char const* PEER_ID = "00112233445566778899";
 
 // ===== Helper functions =====
 
-static std::vector<u_int8_t> recv_all(int socket_fd, size_t size,
-                                      std::error_code& ec) {
-    std::vector<u_int8_t> buffer(size);
-    size_t received = 0;
-    while (received < size) {
-        ssize_t r =
-            recv(socket_fd, buffer.data() + received, size - received, 0);
-        if (r < 0) {
-            ec = errors::make_error_code(errors::error_code_enum::peer_recv);
-            return {};
-        }
-        received += r;
-    }
-    return buffer;
-}
-
 static std::error_code recv_all(int socket_fd, size_t size, u_int8_t* buffer) {
     size_t received = 0;
     while (received < size) {
         ssize_t r = recv(socket_fd, buffer + received, size - received, 0);
         if (r < 0)
             return errors::make_error_code(errors::error_code_enum::peer_recv);
+        if (r == 0)
+            return errors::make_error_code(
+                errors::error_code_enum::peer_disconnected);
         received += r;
     }
     return {};
 }
 
+static uint32_t load_uint32(uint8_t const* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
 static std::error_code send_all(int socket_fd, size_t size, u_int8_t* buffer) {
     size_t sent = 0;
     while (sent < size) {
@@ -68,8 +65,8 @@ Peer::Peer(std::string ip, uint16_t port, Torrent const& torrent)
 
 Peer::~Peer() { this->closeSocket(); }
 
-static std::string handshake_message(std::vector<uint8_t> const& info_hash_raw,
-                                     std::string const& peer_id) {
+static std::string handshake_message(Sha1Digest const& info_hash_raw,
+                                     std::string const& peer_id, bool v2) {
     auto digest_str =
         std::string(reinterpret_cast<char const*>(info_hash_raw.data()),
                     info_hash_raw.size() * sizeof(uint8_t));
@@ -80,6 +77,8 @@ static std::string handshake_message(std::vector<uint8_t> const& info_hash_raw,
         // and not c style string
         // string_literals ensures std::string{str, len} is used
         digest_str + peer_id;
+    // last reserved byte: supports v2 torrents (BEP 52)
+    if (v2) handshake_message[27] |= 0x10;
     return handshake_message;
 }
 
@@ -141,9 +140,10 @@ static std::pair<std::string, std::vector<uint8_t>> parse_peer_id(
             std::vector<uint8_t>(peer_id_raw.begin(), peer_id_raw.end())};
 }
 
-std::error_code Peer::handshake(std::vector<uint8_t> const& info_hash_raw) {
+std::error_code Peer::handshake(Sha1Digest const& info_hash_raw) {
     // Send the message to server:
-    std::string message = handshake_message(info_hash_raw, PEER_ID);
+    std::string message =
+        handshake_message(info_hash_raw, PEER_ID, torrent.has_v2());
 
     std::error_code ec = send_all(socket_fd, message.size(),
                                   reinterpret_cast<u_int8_t*>(message.data()));
@@ -164,48 +164,41 @@ std::error_code Peer::handshake(std::vector<uint8_t> const& info_hash_raw) {
     return {};
 }
 
-std::optional<Message> Peer::read_message_raw(std::error_code& ec) {
-    // message format: <length><message_id><payload>
-
-    uint8_t length[4];
-    ec = recv_all(socket_fd, sizeof(length), length);
-    if (ec) return {};
-
-    uint32_t message_length =
-        ntohl(*reinterpret_cast<uint32_t*>(length)) - 1;  // payload length
-
-    std::vector<u_int8_t> message_id_buffer = recv_all(socket_fd, 1, ec);
-    if (ec) return {};
-    uint8_t message_id = message_id_buffer[0];
-
-    Message message(static_cast<message_type>(message_id));
-
-    // keepalive message
-    if (message_length == 0) return message;
-
-    std::vector<uint8_t> payload = recv_all(socket_fd, message_length, ec);
+std::optional<MessageView> Peer::read_message(std::error_code& ec) {
+    return reader_.read(socket_fd, ec);
+}
 
-    if (message_id > static_cast<std::underlying_type_t<message_type>>(
-                         message_type::cancel)) {
+std::optional<Message> Peer::read_message_raw(std::error_code& ec) {
+    std::optional<MessageView> view;
+    do {
+        view = read_message(ec);
+        if (!view) return {};
+    } while (view->keep_alive());
+
+    if (view->id > static_cast<std::underlying_type_t<message_type>>(
+                       message_type::cancel)) {
         ec = errors::make_error_code(
             errors::error_code_enum::message_type_not_handled);
         return {};
     }
 
-    message.payload = std::move(payload);
+    return Message(view->type(), std::vector<uint8_t>(view->payload.begin(),
+                                                      view->payload.end()));
+}
 
-    return message;
+std::error_code Peer::send_message(Message message) {
+    writer_.queue(std::move(message));
+    return writer_.flush(socket_fd);
 }
 
-std::error_code Peer::send_message(Message const& message) {
-    std::vector<uint8_t> message_raw = message.serialize();
+std::error_code Peer::send_keep_alive() {
+    writer_.keep_alive();
+    return writer_.flush(socket_fd);
+}
 
-    std::error_code ec =
-        send_all(socket_fd, message_raw.size(), message_raw.data());
-    if (ec) return ec;
+void Peer::cork() { writer_.cork(); }
 
-    return {};
-}
+std::error_code Peer::uncork() { return writer_.uncork(socket_fd); }
 
 std::error_code Peer::interested_unchoke() {
     if (socket_fd == -1)
@@ -272,98 +265,401 @@ std::error_code Peer::download_file(std::string const& file_path) {
 
 std::vector<uint8_t> Peer::download_piece(size_t piece_index,
                                           std::error_code& ec) {
-    if (socket_fd == -1) {
-        ec = errors::make_error_code(
-            errors::error_code_enum::peer_no_connection);
-        return {};
-    }
+    return receive_piece(piece_index, true, ec);
+}
+
+std::vector<uint8_t> Peer::fetch_piece(size_t piece_index,
+                                       std::error_code& ec) {
+    return receive_piece(piece_index, false, ec);
+}
 
-    auto pieces = torrent.piece_hashes();
+std::vector<uint8_t> Peer::receive_piece(size_t piece_index, bool verify,
+                                         std::error_code& ec) {
+    ec = queue_piece(piece_index, verify);
+    if (ec) return {};
+    std::optional<DownloadedPiece> piece = next_piece(ec);
+    if (!piece) return {};
+    return std::move(piece->data);
+}
 
-    if (piece_index >= torrent.piece_hashes().size()) {
-        ec = errors::make_error_code(
+std::error_code Peer::queue_piece(size_t piece_index, bool verify) {
+    if (socket_fd == -1)
+        return errors::make_error_code(
+            errors::error_code_enum::peer_no_connection);
+
+    // v2 pieces for v2 and hybrid torrents
+    std::optional<Torrent::V2Piece> v2_piece;
+    size_t const piece_count = torrent.has_v2() ? torrent.v2_piece_count()
+                                                : torrent.piece_hashes().size();
+    if (piece_index >= piece_count)
+        return errors::make_error_code(
             errors::error_code_enum::piece_invalid_index);
+
+    // get piece length
+    size_t piece_length = torrent.piece_length;
+    if (torrent.has_v2()) {
+        v2_piece = torrent.v2_piece(piece_index);
+        piece_length = v2_piece->size;
+    } else if (piece_index == piece_count - 1) {
+        piece_length = torrent.length - piece_index * torrent.piece_length;
+    }
+
+    PieceDownload& download = downloads_.emplace_back();
+    download.index = piece_index;
+    download.length = piece_length;
+    download.verify = verify;
+    if (!verify || !v2_piece) return {};
+
+    if (v2_piece->hash)
+        download.verifier.emplace(*v2_piece->hash, v2_piece->size,
+                                  v2_piece->width);
+    // a single block is its own hash
+    if (v2_piece->width == 1 && v2_piece->hash) {
+        download.verifier->set_leaves(std::span(&*v2_piece->hash, 1));
         return {};
     }
 
-    if (is_choked) {
-        ec = interested_unchoke();
-        if (ec) return {};
+    // the leaves of the subtree of the piece; without piece layer, with
+    // the uncles proving it up to the pieces root
+    Torrent::TreeFile const& file = torrent.file_tree[v2_piece->file];
+    uint32_t proof_layers = 0;
+    if (!v2_piece->hash) {
+        size_t const file_pieces =
+            (file.length + torrent.piece_length - 1) / torrent.piece_length;
+        proof_layers = std::countr_zero(v2_piece->width) +
+                       std::countr_zero(merkle::tree_width(file_pieces));
     }
+    download.hashes = PieceDownload::hash_state::needed;
+    download.hash_request = {
+        file.pieces_root, 0,
+        static_cast<uint32_t>(v2_piece->offset / merkle::BLOCK_SIZE),
+        static_cast<uint32_t>(v2_piece->width), proof_layers};
+    return {};
+}
 
-    // which block in piece
-    uint32_t block_index = 0;
-    uint32_t block_offset = 0;           // begin
-    uint32_t block_length = BLOCK_SIZE;  // length
+size_t Peer::queued_pieces() const { return downloads_.size(); }
 
-    // get piece length
-    uint32_t piece_length = torrent.piece_length;
-    if (piece_index == pieces.size() - 1)
-        piece_length = torrent.length % torrent.piece_length;
+void Peer::set_request_depth_limits(size_t min_depth, size_t max_depth) {
+    depth_.set_limits(min_depth, max_depth);
+}
 
-    spdlog::debug("Peer {}: Downloading piece {}, piece_length {}", ip_, piece_index, piece_length);
+void Peer::set_request_depth(size_t depth) { depth_.set_limits(depth, depth); }
+
+PeerStats Peer::stats() const {
+    PeerStats stats = stats_;
+    stats.request_depth = depth_.depth();
+    stats.min_request_depth = depth_.min_depth();
+    stats.max_request_depth = depth_.max_depth();
+    stats.min_rtt = depth_.min_rtt();
+    stats.smoothed_rtt = depth_.smoothed_rtt();
+    stats.delivery_rate = depth_.delivery_rate();
+    stats.send_calls = writer_.send_calls();
+    stats.recv_calls = reader_.recv_calls();
+    return stats;
+}
 
-    // std::cout << "Piece length: " << piece_length << std::endl;
+std::error_code Peer::request_blocks() {
+    if (is_choked) return {};
 
-    std::vector<uint8_t> piece_data(piece_length);
+    // the requests go out together
+    writer_.cork();
+    size_t const depth = depth_.depth();
+    auto const now = RequestDepth::Clock::now();
+    std::error_code ec;
+    auto full = [&] {
+        return stats_.requests_in_flight + hash_requests_ >= depth;
+    };
+    for (PieceDownload& download : downloads_) {
+        if (full()) break;
+        if (download.hashes == PieceDownload::hash_state::needed) {
+            ec = send_message(
+                Message::make_hash_request(download.hash_request));
+            if (ec) break;
+            download.hashes = PieceDownload::hash_state::requested;
+            hash_requests_++;
+            continue;
+        }
+        if (download.hashes == PieceDownload::hash_state::requested) continue;
+
+        if (download.blocks.empty()) {
+            download.data.resize(download.length);
+            // hashes the blocks while the others are downloaded, unless
+            // each is checked against its leaf hash
+            if (download.verify && !download.verifier)
+                download.hasher.emplace(download.data.data(), download.length);
+            download.blocks.resize((download.length + BLOCK_SIZE - 1) /
+                                   BLOCK_SIZE);
+            download.requested_at.resize(download.blocks.size());
+        }
 
-    while (block_index * BLOCK_SIZE < piece_length) {
-        // std::cout << "Downloading piece " << piece_index << " block "
-        //           << block_index << std::endl;
-        // std::cout << "block_offset: " << block_offset << std::endl;
-        // std::cout << "block length: " << block_length << std::endl;
+        while (download.next_block < download.blocks.size() && !full()) {
+            auto& state = download.blocks[download.next_block];
+            size_t begin = download.next_block * BLOCK_SIZE;
+            download.next_block++;
+            if (state != PieceDownload::block_state::missing) continue;
+
+            ec = send_message(Message::make_request(
+                download.index, begin,
+                std::min(BLOCK_SIZE, download.length - begin)));
+            if (ec) break;
+            state = PieceDownload::block_state::requested;
+            download.requested_at[begin / BLOCK_SIZE] = now;
+            stats_.requests_sent++;
+            stats_.requests_in_flight++;
+        }
+        if (ec) break;
+    }
+    stats_.max_requests_in_flight =
+        std::max(stats_.max_requests_in_flight, stats_.requests_in_flight);
 
-        // last block size
-        if (block_offset + BLOCK_SIZE > piece_length)
-            block_length = piece_length - block_offset;
+    std::error_code flush_ec = writer_.uncork(socket_fd);
+    return ec ? ec : flush_ec;
+}
 
-        // make request
-        auto message =
-            Message::make_request(piece_index, block_offset, block_length);
-        ec = send_message(message);
-        if (ec) return {};
+std::error_code Peer::receive_block(MessageView const& view,
+                                    size_t& position) {
+    position = downloads_.size();
+    size_t const size = reader_.pending_block();
+    if (view.payload.size() < 8)
+        return errors::make_error_code(
+            errors::error_code_enum::piece_invalid_block);
+
+    // payload format: <index><begin><block>
+    uint32_t index = ntohl(load_uint32(view.payload.data()));
+    uint32_t begin = ntohl(load_uint32(view.payload.data() + 4));
+
+    // the started pieces come first
+    size_t found = 0;
+    while (found < downloads_.size() && !downloads_[found].blocks.empty() &&
+           downloads_[found].index != index)
+        found++;
+    if (found == downloads_.size() || downloads_[found].blocks.empty()) {
+        spdlog::debug("Peer {}: block of piece {} not requested, dropped", ip_,
+                      index);
+        return reader_.skip_block(socket_fd);
+    }
 
-        // receive block piece
-        auto get_message = read_message_raw(ec);
-        if (get_message.has_value() == false) return {};
-        message = get_message.value();
+    PieceDownload& download = downloads_[found];
+    if (begin % BLOCK_SIZE != 0 || begin >= download.length ||
+        size != std::min(BLOCK_SIZE, download.length - begin)) {
+        // the next message starts after the block
+        std::error_code ec = reader_.skip_block(socket_fd);
+        if (ec) return ec;
+        return errors::make_error_code(
+            errors::error_code_enum::piece_invalid_block);
+    }
 
-        // check message
-        if (message.type == message_type::choke) break;
+    auto& state = download.blocks[begin / BLOCK_SIZE];
+    if (state == PieceDownload::block_state::received)
+        return reader_.skip_block(socket_fd);
 
-        if (message.type != message_type::piece) {
-            std::cerr << "not piece message received" << std::endl;
-            break;
+    // the header is framed in the receive buffer, the block then goes
+    // straight to its place in the piece
+    std::error_code ec =
+        reader_.read_block(socket_fd, download.data.data() + begin);
+    if (ec) return ec;
+
+    if (state == PieceDownload::block_state::requested) {
+        stats_.requests_in_flight--;
+        depth_.add_block(size, download.requested_at[begin / BLOCK_SIZE],
+                         RequestDepth::Clock::now());
+    }
+    state = PieceDownload::block_state::received;
+    download.received += size;
+    stats_.blocks_received++;
+    stats_.bytes_received += size;
+    spdlog::debug("Peer {}: Piece {}, block {}, block length {}, downloaded",
+                  ip_, index, begin / BLOCK_SIZE, size);
+
+    if (download.verifier &&
+        download.verifier->add_block(begin / BLOCK_SIZE,
+                                     download.data.data() + begin,
+                                     size) == BlockVerifier::Status::bad) {
+        spdlog::debug("Peer {}: Piece {}, block {} does not match its hash",
+                      ip_, index, begin / BLOCK_SIZE);
+        return errors::make_error_code(
+            errors::error_code_enum::piece_hash_mismatch);
+    }
+    if (download.hasher) {
+        ec = download.hasher->add_block(begin, size);
+        if (ec) return ec;
+    }
+    if (download.received == download.length) position = found;
+    return {};
+}
+
+std::optional<DownloadedPiece> Peer::finish_piece(size_t position,
+                                                  std::error_code& ec) {
+    PieceDownload download = std::move(downloads_[position]);
+    downloads_.erase(downloads_.begin() + position);
+    stats_.pieces_received++;
+
+    // v2: the blocks were checked as they arrived, or are together now
+    if (download.verifier) {
+        if (download.verifier->passed() != true) {
+            ec = errors::make_error_code(
+                errors::error_code_enum::piece_hash_mismatch);
+            return {};
         }
+        spdlog::debug("Peer {}: Piece {} downloaded", ip_, download.index);
+        return DownloadedPiece{download.index, std::move(download.data)};
+    }
 
-        Block block = message.parse_block();
+    if (!download.hasher) {
+        spdlog::debug("Peer {}: Piece {} downloaded, not verified", ip_,
+                      download.index);
+        return DownloadedPiece{download.index, std::move(download.data)};
+    }
 
-        spdlog::debug("Peer {}: Piece {}, block {}, block length {}, downloaded", ip_, piece_index,
-                      block_index, block_length);
-        std::copy(block.data.begin(), block.data.end(),
-                  piece_data.begin() + block.begin);
+    // check piece hash, only the blocks received after a gap are left
+    Sha1Digest piece_hash = download.hasher->digest(ec);
+    if (ec) return {};
 
-        block_index++;
-        block_offset += BLOCK_SIZE;
+    if (piece_hash != torrent.piece_hashes()[download.index]) {
+        ec = errors::make_error_code(
+            errors::error_code_enum::piece_hash_mismatch);
+        return {};
     }
 
-    // check piece hash
-    std::vector<uint8_t> piece_hash =
-        utils::sha1_hash(piece_data.data(), piece_data.size());
+    spdlog::debug("Peer {}: Piece {} downloaded", ip_, download.index);
+    return DownloadedPiece{download.index, std::move(download.data)};
+}
+
+std::deque<Peer::PieceDownload>::iterator Peer::find_hash_request(
+    std::span<uint8_t const> payload) {
+    std::optional<HashRequest> request = HashRequest::parse(payload);
+    if (!request) return downloads_.end();
+    return std::find_if(
+        downloads_.begin(), downloads_.end(), [&](PieceDownload const& d) {
+            return d.hashes == PieceDownload::hash_state::requested &&
+                   d.hash_request == *request;
+        });
+}
+
+std::error_code Peer::receive_hashes(MessageView const& view) {
+    auto download = find_hash_request(view.payload);
+    if (download == downloads_.end()) {
+        spdlog::debug("Peer {}: hashes not requested, dropped", ip_);
+        return {};
+    }
+    download->hashes = PieceDownload::hash_state::ready;
+    hash_requests_--;
+
+    // payload format: <request><nodes><uncles>
+    HashRequest const& request = download->hash_request;
+    std::span<Sha256Digest const> hashes = sha256_digests_view(
+        std::string_view(reinterpret_cast<char const*>(view.payload.data()),
+                         view.payload.size())
+            .substr(HashRequest::SIZE));
+    size_t const width = request.length;
+    size_t const subtree_layers = std::countr_zero(width);
+    size_t const uncles = request.proof_layers > subtree_layers
+                              ? request.proof_layers - subtree_layers
+                              : 0;
+    if (hashes.size() != width + uncles)
+        return errors::make_error_code(
+            errors::error_code_enum::piece_invalid_hashes);
+
+    // without piece layer, the hash of the piece is proved by the uncles
+    if (!download->verifier) {
+        Sha256Digest piece_hash =
+            merkle::root(hashes.first(width), width, Sha256Digest{});
+        if (!merkle::verify_proof(piece_hash, request.index / width,
+                                  hashes.subspan(width), request.pieces_root))
+            return errors::make_error_code(
+                errors::error_code_enum::piece_invalid_hashes);
+        download->verifier.emplace(piece_hash, download->length, width);
+    }
+    // the nodes past the last block are padding
+    if (!download->verifier->set_leaves(
+            hashes.first(download->verifier->block_count())))
+        return errors::make_error_code(
+            errors::error_code_enum::piece_invalid_hashes);
+    spdlog::debug("Peer {}: Piece {}, leaf hashes received", ip_,
+                  download->index);
+    return {};
+}
 
-    std::vector<uint8_t> expected_piece_hash =
-        std::vector<uint8_t>(torrent.pieces.begin() + piece_index * 20,
-                             torrent.pieces.begin() + (piece_index + 1) * 20);
+std::error_code Peer::reject_hashes(MessageView const& view) {
+    auto download = find_hash_request(view.payload);
+    if (download == downloads_.end()) return {};
+    download->hashes = PieceDownload::hash_state::ready;
+    hash_requests_--;
+
+    // checked against the hash of the piece once every block is received
+    spdlog::debug("Peer {}: Piece {}, hash request rejected", ip_,
+                  download->index);
+    if (download->verifier) return {};
+    return errors::make_error_code(
+        errors::error_code_enum::piece_hashes_rejected);
+}
 
-    if (piece_hash != expected_piece_hash) {
+std::optional<DownloadedPiece> Peer::next_piece(std::error_code& ec) {
+    if (socket_fd == -1) {
         ec = errors::make_error_code(
-            errors::error_code_enum::piece_hash_mismatch);
+            errors::error_code_enum::peer_no_connection);
         return {};
     }
+    if (downloads_.empty()) return {};
 
-    spdlog::debug("Peer {}: Piece {} downloaded", ip_, piece_index);
+    if (is_choked) {
+        ec = interested_unchoke();
+        if (ec) return {};
+    }
+
+    while (!ec) {
+        ec = request_blocks();
+        if (ec) break;
+
+        std::optional<MessageView> view =
+            reader_.read_until_block(socket_fd, ec);
+        if (!view) break;
+        if (view->keep_alive()) continue;
+
+        switch (view->type()) {
+            case message_type::piece: {
+                size_t position;
+                ec = receive_block(*view, position);
+                if (!ec && position < downloads_.size())
+                    return finish_piece(position, ec);
+                break;
+            }
+            case message_type::choke:
+                // the peer drops our requests, they are sent again once
+                // unchoked; blocks still on their way are kept
+                is_choked = true;
+                stats_.requests_in_flight = 0;
+                hash_requests_ = 0;
+                for (PieceDownload& download : downloads_) {
+                    if (download.hashes ==
+                        PieceDownload::hash_state::requested)
+                        download.hashes = PieceDownload::hash_state::needed;
+                    for (auto& state : download.blocks)
+                        if (state == PieceDownload::block_state::requested)
+                            state = PieceDownload::block_state::missing;
+                    download.next_block = 0;
+                }
+                break;
+            case message_type::unchoke:
+                is_choked = false;
+                break;
+            case message_type::hashes:
+                ec = receive_hashes(*view);
+                break;
+            case message_type::hash_reject:
+                ec = reject_hashes(*view);
+                break;
+            default:
+                // have, bitfield, and requests: nothing is seeded
+                break;
+        }
+    }
 
-    return piece_data;
+    // the state of the connection is unknown, the pieces are dropped
+    downloads_.clear();
+    stats_.requests_in_flight = 0;
+    hash_requests_ = 0;
+    return {};
 }
 
 }  // namespace bittorrent
\ No newline at end of file
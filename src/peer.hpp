@@ -1,8 +1,18 @@
 #pragma once
 
+#include "merkle.hpp"
 #include "message.hpp"
+#include "message_reader.hpp"
+#include "message_writer.hpp"
+#include "piece_hasher.hpp"
+#include "request_depth.hpp"
+#include "sha1_digest.hpp"
+#include <array>
+#include <chrono>
 #include <cstdint>
+#include <deque>
 #include <optional>
+#include <span>
 #include <string>
 #include <system_error>
 #include <vector>
@@ -11,8 +21,40 @@ namespace bittorrent {
 
 class Torrent;
 
+// A piece downloaded by Peer::next_piece
+struct DownloadedPiece {
+    size_t index;
+    std::vector<uint8_t> data;
+};
+
+struct PeerStats {
+    // block requests kept in flight, and its limits
+    size_t request_depth = 0;
+    size_t min_request_depth = 0;
+    size_t max_request_depth = 0;
+    size_t requests_in_flight = 0;
+    size_t max_requests_in_flight = 0;
+    uint64_t requests_sent = 0;
+    uint64_t blocks_received = 0;
+    // block bytes
+    uint64_t bytes_received = 0;
+    uint64_t pieces_received = 0;
+    uint64_t send_calls = 0;
+    uint64_t recv_calls = 0;
+    // measured by the request depth, zero until a block is received
+    std::chrono::nanoseconds min_rtt{0};
+    std::chrono::nanoseconds smoothed_rtt{0};
+    // bytes per second
+    double delivery_rate = 0;
+};
+
 class Peer {
    public:
+    // Limits of the request depth: 64 KiB in flight to start with, and up
+    // to 8 MiB (80 MB/s on a 100 ms round trip)
+    static constexpr size_t MIN_REQUEST_DEPTH = 4;
+    static constexpr size_t MAX_REQUEST_DEPTH = 512;
+
    Peer() = default;
     Peer(std::string ip, uint16_t port, Torrent const& torrent);
     ~Peer();
@@ -20,16 +62,51 @@ class Peer {
     std::error_code establish_connection();
     std::error_code close_connection();
 
-    std::error_code handshake(std::vector<uint8_t> const& info_hash_raw);
+    std::error_code handshake(Sha1Digest const& info_hash_raw);
     std::error_code download_file(std::string const& file_path);
+    // One piece, not to be mixed with queue_piece
     std::vector<uint8_t> download_piece(size_t piece_index,
                                         std::error_code& ec);
+    // Same as download_piece, without checking the hash of the piece
+    // (left to a VerifyPool)
+    std::vector<uint8_t> fetch_piece(size_t piece_index, std::error_code& ec);
+
+    // Pipelined download: the blocks of the queued pieces are requested in
+    // order, with up to request_depth() requests in flight, across piece
+    // boundaries. The depth follows the bandwidth-delay product of the
+    // connection (see RequestDepth).
+    // Without `verify`, the hash of the piece is left to the caller. With
+    // it, the pieces of a v2 torrent are checked block by block: their leaf
+    // hashes are requested first (hash request), and a block not matching
+    // its hash fails the piece as it arrives. If the peer rejects the
+    // request, the blocks are checked together once received.
+    std::error_code queue_piece(size_t piece_index, bool verify = true);
+    // Receives blocks until a queued piece is complete, requesting the next
+    // ones meanwhile. nullopt, without error, once nothing is queued.
+    std::optional<DownloadedPiece> next_piece(std::error_code& ec);
+    // Pieces queued and not returned by next_piece yet
+    size_t queued_pieces() const;
+
+    // Limits of the request depth, applied from the next requests
+    void set_request_depth_limits(size_t min_depth, size_t max_depth);
+    // A fixed depth, at least 1
+    void set_request_depth(size_t depth);
+    size_t request_depth() const { return depth_.depth(); }
+    PeerStats stats() const;
 
     std::error_code recv_bitfield();
     std::error_code interested_unchoke();
 
+    // Next message other than a keep-alive, copied out of the receive buffer
     std::optional<Message> read_message_raw(std::error_code& ec);
-    std::error_code send_message(Message const& message);
+    // Next message, in the receive buffer until the next read
+    std::optional<MessageView> read_message(std::error_code& ec);
+    // Queues `message` and flushes the send queue, unless corked
+    std::error_code send_message(Message message);
+    std::error_code send_keep_alive();
+    // Between cork and uncork, messages are queued and then sent together
+    void cork();
+    std::error_code uncork();
 
     int socket_fd;
 
@@ -44,6 +121,55 @@ class Peer {
     Torrent const& torrent;
 
    private:
+    // A queued piece, its buffer allocated once its first block is requested
+    struct PieceDownload {
+        size_t index = 0;
+        size_t length = 0;
+        bool verify = true;
+        std::vector<uint8_t> data;
+        std::optional<PieceHasher> hasher;
+        // v2: the blocks are requested once the leaf hashes of the piece
+        // are received or rejected. Without piece layer, the hash of the
+        // piece itself comes with them, checked against the pieces root.
+        enum class hash_state : uint8_t { ready, needed, requested };
+        hash_state hashes = hash_state::ready;
+        HashRequest hash_request{};
+        std::optional<BlockVerifier> verifier;
+        enum class block_state : uint8_t { missing, requested, received };
+        std::vector<block_state> blocks;
+        // of the blocks requested
+        std::vector<RequestDepth::Clock::time_point> requested_at;
+        // blocks before this one are requested or received
+        size_t next_block = 0;
+        size_t received = 0;
+    };
+
+    std::vector<uint8_t> receive_piece(size_t piece_index, bool verify,
+                                       std::error_code& ec);
+    // Requests blocks until request_depth() are in flight
+    std::error_code request_blocks();
+    // Writes the block of a piece message to its piece. `position` is set
+    // to the piece in downloads_ if it is now complete.
+    std::error_code receive_block(MessageView const& view, size_t& position);
+    // Complete piece at `position` of downloads_, removed
+    std::optional<DownloadedPiece> finish_piece(size_t position,
+                                                std::error_code& ec);
+    // Download whose hash request in flight starts `payload`, or end()
+    std::deque<PieceDownload>::iterator find_hash_request(
+        std::span<uint8_t const> payload);
+    // Leaf hashes of a piece (hashes message), or their rejection
+    std::error_code receive_hashes(MessageView const& view);
+    std::error_code reject_hashes(MessageView const& view);
+
+    MessageReader reader_;
+    MessageWriter writer_;
+
+    std::deque<PieceDownload> downloads_;
+    // hash requests in flight, each taking the place of a block request
+    size_t hash_requests_ = 0;
+    RequestDepth depth_{MIN_REQUEST_DEPTH, MAX_REQUEST_DEPTH};
+    PeerStats stats_;
+
     std::error_code createSocket();
     std::error_code closeSocket();
     std::error_code connect();
@@ -0,0 +1,50 @@
+#include "piece_hasher.hpp"
+#include "error.hpp"
+#include <algorithm>
+
+namespace bittorrent {
+
+PieceHasher::PieceHasher(uint8_t const* piece, size_t length)
+    : piece_(piece), length_(length) {}
+
+void PieceHasher::hash_until(size_t end) {
+    sha1_.processBytes(piece_ + hashed_, end - hashed_);
+    hashed_ = end;
+}
+
+std::error_code PieceHasher::add_block(size_t begin, size_t size) {
+    if (begin > length_ || size > length_ - begin)
+        return errors::make_error_code(
+            errors::error_code_enum::piece_invalid_block);
+
+    size_t end = begin + size;
+    if (end <= hashed_) return {};
+
+    if (begin > hashed_) {
+        // hold it until the gap before it is filled
+        size_t& pending_end = pending_[begin];
+        pending_end = std::max(pending_end, end);
+        return {};
+    }
+
+    hash_until(end);
+    // the blocks held after this one may now be contiguous
+    while (!pending_.empty() && pending_.begin()->first <= hashed_) {
+        if (pending_.begin()->second > hashed_)
+            hash_until(pending_.begin()->second);
+        pending_.erase(pending_.begin());
+    }
+    return {};
+}
+
+Sha1Digest PieceHasher::digest(std::error_code& ec) {
+    Sha1Digest result{};
+    if (!complete()) {
+        ec = errors::make_error_code(errors::error_code_enum::piece_incomplete);
+        return result;
+    }
+    sha1_.getDigestBytes(result.data());
+    return result;
+}
+
+}  // namespace bittorrent
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "lib/sha1.hpp"
+#include "sha1_digest.hpp"
+#include <cstdint>
+#include <map>
+#include <system_error>
+
+namespace bittorrent {
+
+// Running SHA1 of a piece, fed with its blocks as they are written to the
+// piece buffer. Blocks are hashed in order; the ones that arrive ahead of a
+// gap are only recorded, and hashed from the buffer once the gap is filled,
+// so the digest is ready as soon as the last block lands.
+class PieceHasher {
+   public:
+    // `piece` must stay valid, and hold the received blocks, until complete
+    PieceHasher(uint8_t const* piece, size_t length);
+
+    // Block of `size` bytes at offset `begin`, already in the piece buffer.
+    // Blocks already received are ignored.
+    std::error_code add_block(size_t begin, size_t size);
+
+    // Every byte of the piece was hashed
+    bool complete() const { return hashed_ == length_; }
+    // Bytes hashed so far, the received blocks after a gap are not counted
+    size_t hashed() const { return hashed_; }
+
+    // SHA1 of the piece, piece_incomplete if a block is missing
+    Sha1Digest digest(std::error_code& ec);
+
+   private:
+    void hash_until(size_t end);
+
+    uint8_t const* piece_;
+    size_t length_;
+    size_t hashed_ = 0;
+    sha1::SHA1 sha1_;
+    // received ranges after the hashed part, begin -> end
+    std::map<size_t, size_t> pending_;
+};
+
+}  // namespace bittorrent
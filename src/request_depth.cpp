@@ -0,0 +1,89 @@
+#include "request_depth.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace bittorrent {
+
+RequestDepth::RequestDepth(size_t min_depth, size_t max_depth)
+    : min_depth_(0), max_depth_(0), depth_(0) {
+    set_limits(min_depth, max_depth);
+    depth_ = min_depth_;
+}
+
+void RequestDepth::set_limits(size_t min_depth, size_t max_depth) {
+    min_depth_ = std::max<size_t>(1, min_depth);
+    max_depth_ = std::max(min_depth_, max_depth);
+    depth_ = std::clamp(depth_, min_depth_, max_depth_);
+}
+
+double RequestDepth::delivery_rate() const {
+    return rate_count_ == 0
+               ? 0
+               : *std::max_element(rates_.begin(),
+                                   rates_.begin() +
+                                       std::min(rate_count_, RATE_SAMPLES));
+}
+
+void RequestDepth::add_block(size_t size, Clock::time_point requested,
+                             Clock::time_point now) {
+    block_size_ = std::max(block_size_, size);
+
+    // round trip
+    auto rtt = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now - requested);
+    if (rtt.count() > 0) {
+        smoothed_rtt_ = smoothed_rtt_.count() == 0
+                            ? rtt
+                            : (smoothed_rtt_ * 7 + rtt) / 8;
+        if (probing_rtt_) {
+            // the queue at the peer drained before this one was requested
+            if (requested >= probe_start_) {
+                probing_rtt_ = false;
+                min_rtt_ = rtt;
+                min_rtt_time_ = now;
+                update_depth();
+            }
+        } else if (min_rtt_.count() == 0 || rtt <= min_rtt_) {
+            min_rtt_ = rtt;
+            min_rtt_time_ = now;
+        } else if (now - min_rtt_time_ > RTT_WINDOW) {
+            // the round trips measured now include the time the requests
+            // wait at the peer: with one product in flight instead of GAIN,
+            // the queue drains and the link stays busy
+            probing_rtt_ = true;
+            probe_start_ = now;
+            depth_ = std::max(min_depth_,
+                              static_cast<size_t>(depth_ / GAIN));
+        }
+    }
+
+    // delivery rate, over intervals of a round trip; the first block only
+    // starts the first one
+    if (!interval_started_) {
+        interval_started_ = true;
+        interval_start_ = now;
+        interval_delivered_ = 0;
+        return;
+    }
+    interval_delivered_ += size;
+    std::chrono::duration<double> elapsed = now - interval_start_;
+    if (elapsed.count() <= 0 || elapsed < min_rtt_) return;
+
+    rates_[rate_count_++ % RATE_SAMPLES] =
+        interval_delivered_ / elapsed.count();
+    interval_start_ = now;
+    interval_delivered_ = 0;
+    update_depth();
+}
+
+void RequestDepth::update_depth() {
+    if (probing_rtt_) return;
+    std::chrono::duration<double> rtt = min_rtt_;
+    double bdp = delivery_rate() * rtt.count();
+    double blocks = std::ceil(GAIN * bdp / static_cast<double>(block_size_));
+    blocks = std::clamp(blocks, static_cast<double>(min_depth_),
+                        static_cast<double>(max_depth_));
+    depth_ = static_cast<size_t>(blocks);
+}
+
+}  // namespace bittorrent
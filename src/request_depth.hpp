@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace bittorrent {
+
+// Number of block requests a peer connection keeps in flight, sized to the
+// bandwidth-delay product of the connection as it is measured:
+// - the round trip is the shortest one of a block, from its request to its
+//   last byte, so that the time requests spend queued behind each other at
+//   the peer does not count. After RTT_WINDOW without a shorter one, the
+//   depth is divided by GAIN until a block requested from then on arrives,
+//   and its round trip is taken instead.
+// - the delivery rate is the highest one measured over the last
+//   RATE_SAMPLES intervals of at least a round trip each
+// The depth is GAIN times the product, in blocks: while the pipeline is
+// what limits the rate, each round trip doubles it, and once the link is,
+// the rate stops growing and so does the depth.
+class RequestDepth {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr double GAIN = 2;
+    static constexpr size_t RATE_SAMPLES = 8;
+    static constexpr std::chrono::seconds RTT_WINDOW{10};
+
+    // The depth starts at `min_depth`, then stays in [min_depth, max_depth]
+    RequestDepth(size_t min_depth, size_t max_depth);
+
+    // Limits, the same for a fixed depth
+    void set_limits(size_t min_depth, size_t max_depth);
+    size_t min_depth() const { return min_depth_; }
+    size_t max_depth() const { return max_depth_; }
+
+    // A block of `size` bytes requested at `requested` arrived at `now`
+    void add_block(size_t size, Clock::time_point requested,
+                   Clock::time_point now);
+
+    size_t depth() const { return depth_; }
+    // Zero until measured
+    std::chrono::nanoseconds min_rtt() const { return min_rtt_; }
+    std::chrono::nanoseconds smoothed_rtt() const { return smoothed_rtt_; }
+    // The pipeline is drained to measure the round trip again
+    bool probing_rtt() const { return probing_rtt_; }
+    // Bytes per second
+    double delivery_rate() const;
+
+   private:
+    void update_depth();
+
+    size_t min_depth_;
+    size_t max_depth_;
+    size_t depth_;
+    // largest block received, the depth is counted in those
+    size_t block_size_ = 0;
+
+    std::chrono::nanoseconds min_rtt_{0};
+    Clock::time_point min_rtt_time_;
+    std::chrono::nanoseconds smoothed_rtt_{0};
+    bool probing_rtt_ = false;
+    Clock::time_point probe_start_;
+
+    // bytes received since the start of the current rate interval
+    uint64_t interval_delivered_ = 0;
+    Clock::time_point interval_start_;
+    bool interval_started_ = false;
+    // bytes per second, the last RATE_SAMPLES intervals
+    std::array<double, RATE_SAMPLES> rates_{};
+    size_t rate_count_ = 0;
+};
+
+}  // namespace bittorrent
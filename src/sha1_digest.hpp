@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace bittorrent {
+
+// SHA1 digest, as found in metainfo files (info hash, piece hashes).
+// std::array compares and orders in constant expressions.
+using Sha1Digest = std::array<uint8_t, 20>;
+
+// Lowercase hex digits of `bytes`, e.g. of a digest
+template <size_t N>
+constexpr std::array<char, 2 * N> to_hex_chars(
+    std::array<uint8_t, N> const& bytes) {
+    constexpr char hex[] = "0123456789abcdef";
+    std::array<char, 2 * N> result{};
+    for (size_t i = 0; i < N; i++) {
+        result[i * 2] = hex[bytes[i] >> 4];
+        result[i * 2 + 1] = hex[bytes[i] & 0xF];
+    }
+    return result;
+}
+
+template <size_t N>
+std::string to_hex(std::array<uint8_t, N> const& bytes) {
+    auto chars = to_hex_chars(bytes);
+    return std::string(chars.begin(), chars.end());
+}
+
+// Any number of bytes, e.g. a bitfield
+inline std::string to_hex(std::span<uint8_t const> bytes) {
+    std::string result;
+    result.reserve(bytes.size() * 2);
+    for (uint8_t byte : bytes) {
+        auto chars = to_hex_chars(std::array{byte});
+        result.append(chars.begin(), chars.end());
+    }
+    return result;
+}
+
+// Digest from 40 hex digits (any case), nullopt otherwise
+constexpr std::optional<Sha1Digest> digest_from_hex(std::string_view hex) {
+    constexpr auto value = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    if (hex.size() != 40) return {};
+    Sha1Digest result{};
+    for (size_t i = 0; i < result.size(); i++) {
+        int high = value(hex[i * 2]);
+        int low = value(hex[i * 2 + 1]);
+        if (high < 0 || low < 0) return {};
+        result[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+    return result;
+}
+
+// Digests stored back to back, as in the `pieces` field of the info
+// dictionary, viewed in place. A partial digest at the end is left out.
+inline std::span<Sha1Digest const> digests_view(std::string_view concatenated) {
+    static_assert(sizeof(Sha1Digest) == 20 && alignof(Sha1Digest) == 1);
+    return {reinterpret_cast<Sha1Digest const*>(concatenated.data()),
+            concatenated.size() / sizeof(Sha1Digest)};
+}
+
+}  // namespace bittorrent
@@ -1,12 +1,16 @@
 #include "torrent.hpp"
-#include "bencode.hpp"
+#include "bencode_parser.hpp"
+#include "bencode_schema.hpp"
 #include "error.hpp"
 #include "httplib.h"
 #include "lib/sha1.hpp"
+#include "lib/sha256.hpp"
 #include "lib/utils.hpp"
 #include "peer.hpp"
 #include "spdlog/spdlog.h"
 #include "tracker_info.hpp"
+#include "verify_pool.hpp"
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -16,83 +20,323 @@
 
 namespace bittorrent {
 
+// downloaded pieces waiting to be hashed, at most
+constexpr size_t VERIFY_QUEUE_CAPACITY = 8;
+
+namespace {
+
+// Fields of the metainfo file used by Torrent
+// https://www.bittorrent.org/beps/bep_0003.html#metainfo-files
+struct Metainfo {
+    // missing from trackerless torrents
+    std::optional<std::string_view> announce;
+    // https://www.bittorrent.org/beps/bep_0012.html
+    std::optional<std::vector<std::vector<std::string_view>>> announce_list;
+    // encoded info dictionary, hashed as is
+    bencode::LazyValue info;
+    // v2: pieces root -> piece layer
+    std::optional<bencode::LazyValue> piece_layers;
+};
+
+struct File {
+    // "p" for padding files (BEP 47)
+    std::optional<std::string_view> attr;
+    size_t length;
+    // components, the last one is the file name
+    std::vector<std::string_view> path;
+};
+
+// v2 file, the value of the "" key in the file tree
+struct TreeFile {
+    size_t length;
+    std::optional<std::string_view> pieces_root;
+};
+
+struct Info {
+    // v2: nested dicts of path components
+    std::optional<bencode::LazyValue> file_tree;
+    // v1 multi-file torrents
+    std::optional<std::vector<File>> files;
+    // v1 single-file torrents
+    std::optional<size_t> length;
+    std::optional<int64_t> meta_version;
+    std::string_view name;
+    size_t piece_length;
+    // v1
+    std::optional<std::string_view> pieces;
+};
+
+}  // namespace
+
+template <>
+struct bencode::Schema<Metainfo> {
+    static constexpr auto fields = std::tuple{
+        bencode::field("announce", &Metainfo::announce),
+        bencode::field("announce-list", &Metainfo::announce_list),
+        bencode::field("info", &Metainfo::info),
+        bencode::field("piece layers", &Metainfo::piece_layers)};
+};
+
+template <>
+struct bencode::Schema<File> {
+    static constexpr auto fields =
+        std::tuple{bencode::field("attr", &File::attr),
+                   bencode::field("length", &File::length),
+                   bencode::field("path", &File::path)};
+};
+
+template <>
+struct bencode::Schema<TreeFile> {
+    static constexpr auto fields =
+        std::tuple{bencode::field("length", &TreeFile::length),
+                   bencode::field("pieces root", &TreeFile::pieces_root)};
+};
+
+template <>
+struct bencode::Schema<Info> {
+    static constexpr auto fields =
+        std::tuple{bencode::field("file tree", &Info::file_tree),
+                   bencode::field("files", &Info::files),
+                   bencode::field("length", &Info::length),
+                   bencode::field("meta version", &Info::meta_version),
+                   bencode::field("name", &Info::name),
+                   bencode::field("piece length", &Info::piece_length),
+                   bencode::field("pieces", &Info::pieces)};
+};
+
+// A path component that stays in the directory of the torrent
+static bool is_safe_path_component(std::string_view component) {
+    return !component.empty() && component != "." && component != ".." &&
+           component.find_first_of(std::string_view("/\\\0", 3)) ==
+               std::string_view::npos;
+}
+
+// deepest directory nesting accepted in a file tree
+constexpr int FILE_TREE_MAX_DEPTH = 64;
+
+// Appends the files of the file tree `node` (a dict of path components) to
+// `files`, in key order
+static void parse_file_tree(std::string_view node,
+                            std::filesystem::path const& prefix, int depth,
+                            std::vector<Torrent::TreeFile>& files,
+                            std::error_code& ec) {
+    auto dict = bencode::LazyDict::parse(node, ec);
+    if (ec) return;
+    if (depth > FILE_TREE_MAX_DEPTH || dict->size() == 0) {
+        ec = errors::make_error_code(errors::error_code_enum::parse_torrent);
+        return;
+    }
+
+    for (auto const& [name, value] : dict->entries()) {
+        // a file, whose path is the keys leading to it
+        if (name.empty()) {
+            auto file = bencode::decode<TreeFile>(value.raw(), ec);
+            if (ec) return;
+            size_t root_size = file->length > 0 ? 32 : 0;
+            if (prefix.empty() ||
+                file->pieces_root.value_or("").size() != root_size) {
+                ec = errors::make_error_code(
+                    errors::error_code_enum::parse_torrent);
+                return;
+            }
+            Torrent::TreeFile entry{prefix, file->length, {}, {}};
+            std::copy(file->pieces_root.value_or("").begin(),
+                      file->pieces_root.value_or("").end(),
+                      entry.pieces_root.begin());
+            files.push_back(std::move(entry));
+            continue;
+        }
+
+        if (!is_safe_path_component(name) ||
+            value.type() != bencode::node_type::dict) {
+            ec = errors::make_error_code(
+                errors::error_code_enum::parse_torrent);
+            return;
+        }
+        parse_file_tree(value.raw(), prefix / name, depth + 1, files, ec);
+        if (ec) return;
+    }
+}
+
+// Points the files to their piece layer, checked against their pieces root
+static std::error_code attach_piece_layers(
+    std::optional<bencode::LazyValue> const& piece_layers, size_t piece_length,
+    std::vector<Torrent::TreeFile>& files) {
+    if (!piece_layers) return {};
+    std::error_code ec;
+    auto layers = bencode::LazyDict::parse(piece_layers->raw(), ec);
+    if (ec) return ec;
+
+    for (Torrent::TreeFile& file : files) {
+        if (file.length <= piece_length) continue;
+        auto layer = layers->find_string(std::string_view(
+            reinterpret_cast<char const*>(file.pieces_root.data()),
+            file.pieces_root.size()));
+        // may be fetched from peers instead
+        if (!layer) continue;
+
+        size_t pieces = (file.length + piece_length - 1) / piece_length;
+        file.piece_layer = sha256_digests_view(*layer);
+        if (layer->size() != pieces * sizeof(Sha256Digest) ||
+            merkle::root_from_piece_layer(file.piece_layer, piece_length) !=
+                file.pieces_root)
+            return errors::make_error_code(
+                errors::error_code_enum::parse_torrent);
+    }
+    return {};
+}
+
 std::unique_ptr<Torrent> Torrent::parse_torrent(
     std::filesystem::path const& file_path, std::error_code& ec) {
     // parsing metainfo torrent
     // https://www.bittorrent.org/beps/bep_0003.html#metainfo-files
-    // read file
-    std::ifstream f(file_path);
-    if (!f.good()) {
+    std::ifstream f(file_path, std::ios::binary);
+    std::error_code size_ec;
+    uintmax_t size = std::filesystem::file_size(file_path, size_ec);
+    if (!f.good() || size_ec) {
         ec = errors::make_error_code(errors::error_code_enum::parse_torrent);
         return {};
     }
-    std::stringstream buffer;
-    buffer << f.rdbuf();
 
-    // parse bencoded dict
-    auto encoded_value = Bencode::decode_bencoded_value(buffer.str(), ec);
+    std::unique_ptr<Torrent> torrent = std::make_unique<Torrent>();
+    torrent->metainfo_.resize(size);
+    f.read(torrent->metainfo_.data(), size);
+    torrent->metainfo_.resize(f.gcount());
+
+    // only the bound keys are decoded, other values (e.g. the list of files)
+    // are skipped over, and the pieces are not copied
+    auto metainfo = bencode::decode<Metainfo>(torrent->metainfo_, ec);
+    if (ec) return {};
+    auto info = bencode::decode<Info>(metainfo->info.raw(), ec);
     if (ec) return {};
-    auto dict = encoded_value;
 
-    std::unique_ptr<Torrent> torrent = std::make_unique<Torrent>();
-    torrent->announce = dict["announce"];
-    torrent->length = dict["info"]["length"];
-    torrent->name = dict["info"]["name"];
-    torrent->piece_length = dict["info"]["piece length"];
-    torrent->pieces = dict["info"]["pieces"];
+    // v1: length for single-file torrents, files otherwise, and whole
+    // hashes. v2: a file tree, and pieces of a power of two of blocks.
+    torrent->has_v1_ = info->pieces.has_value();
+    torrent->meta_version = static_cast<int>(info->meta_version.value_or(1));
+    bool v1_valid = (info->length || info->files) &&
+                    info->pieces.value_or("").size() % 20 == 0;
+    bool v2_valid = info->file_tree.has_value() &&
+                    info->piece_length >= merkle::BLOCK_SIZE &&
+                    (info->piece_length & (info->piece_length - 1)) == 0;
+    if ((torrent->meta_version != 1 && torrent->meta_version != 2) ||
+        (torrent->has_v1() && !v1_valid) ||
+        (torrent->has_v2() && !v2_valid) ||
+        (!torrent->has_v1() && !torrent->has_v2())) {
+        ec = errors::make_error_code(errors::error_code_enum::parse_torrent);
+        return {};
+    }
 
-    return torrent;
-}
+    if (torrent->has_v2()) {
+        parse_file_tree(info->file_tree->raw(), {}, 0, torrent->file_tree, ec);
+        if (ec) return {};
+        ec = attach_piece_layers(metainfo->piece_layers, info->piece_length,
+                                 torrent->file_tree);
+        if (ec) return {};
+        size_t piece = 0;
+        for (TreeFile& file : torrent->file_tree) {
+            file.first_piece = piece;
+            piece +=
+                (file.length + info->piece_length - 1) / info->piece_length;
+        }
 
-static std::vector<uint32_t> sha1_hash(std::string const& data) {
-    sha1::SHA1 s;
-    s.processBytes(data.c_str(), data.size());
-    std::vector<uint32_t> digest(5);
-    s.getDigest(digest.data());
-    return digest;
-}
+        sha256::SHA256()
+            .processBytes(metainfo->info.raw().data(),
+                          metainfo->info.raw().size())
+            .getDigestBytes(torrent->info_hash_v2_raw_.data());
+    }
 
-static std::vector<uint8_t> hex_to_bytes(std::string const& hex) {
-    std::vector<uint8_t> bytes;
+    // SHA1 of the info dictionary, as encoded in the file; v2-only torrents
+    // are known by their truncated SHA-256
+    if (torrent->has_v1()) {
+        sha1::SHA1 info_sha1;
+        info_sha1.processBytes(metainfo->info.raw().data(),
+                               metainfo->info.raw().size());
+        info_sha1.getDigestBytes(torrent->info_hash_raw_.data());
+    } else {
+        std::copy_n(torrent->info_hash_v2_raw_.begin(),
+                    torrent->info_hash_raw_.size(),
+                    torrent->info_hash_raw_.begin());
+    }
 
-    for (unsigned int i = 0; i < hex.length(); i += 2) {
-        std::string byteString = hex.substr(i, 2);
-        char byte = (char)strtol(byteString.c_str(), NULL, 16);
-        bytes.push_back(byte);
+    torrent->announce = metainfo->announce.value_or("");
+    for (auto const& tier : metainfo->announce_list.value_or(
+             std::vector<std::vector<std::string_view>>{}))
+        torrent->announce_list.emplace_back(tier.begin(), tier.end());
+    if (!torrent->has_v1()) {
+        torrent->length = 0;
+        for (TreeFile const& file : torrent->file_tree)
+            torrent->length += file.length;
+        torrent->file_count = torrent->file_tree.size();
+    } else if (info->length.has_value()) {
+        torrent->length = *info->length;
+    } else {
+        torrent->length = 0;
+        for (File const& file : *info->files) {
+            if (file.path.empty() ||
+                !std::all_of(file.path.begin(), file.path.end(),
+                             is_safe_path_component)) {
+                ec = errors::make_error_code(
+                    errors::error_code_enum::parse_torrent);
+                return {};
+            }
+            std::filesystem::path path;
+            for (std::string_view component : file.path) path /= component;
+            torrent->files.push_back(
+                {std::move(path), file.length,
+                 file.attr.value_or("").find('p') != std::string_view::npos});
+            torrent->length += file.length;
+        }
+        torrent->file_count = info->files->size();
+    }
+    // one hash per piece, the last one may be shorter
+    if (torrent->has_v1() &&
+        (info->piece_length == 0 ||
+         info->pieces->size() / 20 !=
+             torrent->length / info->piece_length +
+                 (torrent->length % info->piece_length != 0))) {
+        ec = errors::make_error_code(errors::error_code_enum::parse_torrent);
+        return {};
     }
+    torrent->name = info->name;
+    torrent->piece_length = info->piece_length;
+    torrent->pieces = info->pieces.value_or("");
 
-    return bytes;
+    return torrent;
 }
 
-std::vector<uint8_t> Torrent::info_hash_raw() const {
-    std::string digest_str = info_hash();
-    return hex_to_bytes(digest_str);
-}
+std::string Torrent::info_hash() const { return to_hex(info_hash_raw_); }
 
-std::string Torrent::info_hash() const {
-    nlohmann::json info = {
-        {"length", length},
-        {"name", name},
-        {"piece length", piece_length},
-        {"pieces", pieces},
-    };
-    auto encoded_info = Bencode::encode_bencoded_value(info);
-    auto digest = sha1_hash(encoded_info);
-    char sha[48];
-    snprintf(sha, 45, "%08x%08x%08x%08x%08x", digest[0], digest[1], digest[2],
-             digest[3], digest[4]);
-    return sha;
+size_t Torrent::v2_piece_count() const {
+    if (file_tree.empty()) return 0;
+    TreeFile const& last = file_tree.back();
+    return last.first_piece + (last.length + piece_length - 1) / piece_length;
 }
 
-std::vector<std::string> Torrent::piece_hashes() const {
-    std::vector<std::string> result;
-    auto it = pieces.begin();
-    while (it != pieces.end()) {
-        std::string piece_hash(it, it + 20);
-        it += 20;
-        result.push_back(piece_hash);
+std::optional<Torrent::V2Piece> Torrent::v2_piece(size_t index) const {
+    if (index >= v2_piece_count()) return {};
+    // the last file starting at or before the piece, empty files before it
+    // have the same first piece
+    auto file = std::upper_bound(file_tree.begin(), file_tree.end(), index,
+                                 [](size_t i, TreeFile const& f) {
+                                     return i < f.first_piece;
+                                 }) -
+                1;
+
+    V2Piece piece;
+    piece.file = file - file_tree.begin();
+    piece.offset = (index - file->first_piece) * piece_length;
+    piece.size = std::min<uint64_t>(piece_length, file->length - piece.offset);
+    if (file->length <= piece_length) {
+        piece.width = merkle::tree_width(
+            (file->length + merkle::BLOCK_SIZE - 1) / merkle::BLOCK_SIZE);
+        piece.hash = file->pieces_root;
+    } else {
+        piece.width = piece_length / merkle::BLOCK_SIZE;
+        if (!file->piece_layer.empty())
+            piece.hash = file->piece_layer[index - file->first_piece];
     }
-    return result;
+    return piece;
 }
 
 std::optional<TrackerInfo> Torrent::discover_peers(std::error_code& ec) const {
@@ -110,8 +354,8 @@ std::optional<TrackerInfo> Torrent::discover_peers(std::error_code& ec) const {
     std::string rest_url = matches[6].str();
     std::string tracker_url = rest_url;
 
-    std::vector<uint8_t> digest = info_hash_raw();
-    auto digest_str = std::string(reinterpret_cast<char*>(digest.data()),
+    auto const& digest = info_hash_raw();
+    auto digest_str = std::string(reinterpret_cast<char const*>(digest.data()),
                                   digest.size() * sizeof(uint8_t));
     std::string digest_2 = utils::url_encode(digest_str);
     tracker_url += "?info_hash=" + digest_2;
@@ -139,23 +383,34 @@ std::optional<TrackerInfo> Torrent::discover_peers(std::error_code& ec) const {
     int compact = 1;
     tracker_url += "&compact=" + std::to_string(compact);
 
+    // the response is parsed as it is received
+    TrackerResponseHandler handler;
+    bencode::StreamParser parser(handler);
+    std::error_code parse_ec;
+
     httplib::Client cli(base_url);
-    auto res = cli.Get(tracker_url);
+    auto res = cli.Get(tracker_url, [&](char const* data, size_t length) {
+        spdlog::debug("Torrent: Tracker response: {} bytes", length);
+        parser.feed(std::string_view(data, length), parse_ec);
+        if (!parse_ec) parse_ec = handler.error();
+        return !parse_ec;
+    });
+    if (parse_ec) {
+        ec = parse_ec;
+        return {};
+    }
     if (!res) {
         ec = errors::make_error_code(
             errors::error_code_enum::discover_peers_http);
         return {};
     }
 
-    spdlog::debug("Torrent: Tracker response: {}", res->body);
-
-    auto tracker_response = Bencode::decode_bencoded_value(res->body, ec);
+    parser.finish(ec);
+    if (ec) return {};
+    std::optional<TrackerInfo> tracker_info = handler.result(ec);
     if (ec) return {};
 
-    TrackerInfo tracker_info =
-        TrackerInfo::parse_tracker_response(tracker_response);
-    
-    spdlog::debug("Torrent: Number of peers: {}", tracker_info.peers.size());
+    spdlog::debug("Torrent: Number of peers: {}", tracker_info->peers.size());
 
     return tracker_info;
 }
@@ -169,7 +424,7 @@ void Torrent::connect_peers() {
 
     TrackerInfo info = tracker_info.value();
 
-    std::vector<uint8_t> digest = info_hash_raw();
+    auto const& digest = info_hash_raw();
 
     for (std::string const& peer : info.peers) {
         std::string peer_ip = peer.substr(0, peer.find(':'));
@@ -197,16 +452,15 @@ void Torrent::connect_peers() {
     return;
 }
 
-std::vector<Torrent::piece> Torrent::compute_pieces_to_download(
+std::vector<Torrent::piece_index> Torrent::compute_pieces_to_download(
     std::string const& out_file_path) {
-    std::vector<piece> result;
-    std::vector<std::string> hashes = piece_hashes();
+    std::vector<piece_index> result;
+    size_t const piece_count =
+        has_v2() ? v2_piece_count() : piece_hashes().size();
 
     // file does not exist, all pieces must be downloaded
     if (!std::filesystem::exists(out_file_path)) {
-        for (size_t i = 0; i < hashes.size(); i++)
-            result.push_back(
-                {i, std::vector<uint8_t>(hashes[i].begin(), hashes[i].end())});
+        for (size_t i = 0; i < piece_count; i++) result.push_back(i);
         return result;
     }
 
@@ -218,10 +472,7 @@ std::vector<Torrent::piece> Torrent::compute_pieces_to_download(
     // buffer.reserve(piece_length);
 
     // for now, request to ALWAYS download all pieces
-    for (size_t i = 0; i < hashes.size(); i++) {
-        result.push_back(
-            {i, std::vector<uint8_t>(hashes[i].begin(), hashes[i].end())});
-    }
+    for (size_t i = 0; i < piece_count; i++) result.push_back(i);
 
     return result;
 }
@@ -239,21 +490,87 @@ std::error_code Torrent::download_file(std::string const& out_file_path) {
         }
     }
 
-    std::vector<Torrent::piece> pieces_to_download =
-        compute_pieces_to_download(out_file_path);
-
     std::error_code ec;
+    std::vector<piece_index> pieces_to_download =
+        compute_pieces_to_download(out_file_path);
 
     Peer& p = *peers[0];
     std::ofstream f(out_file_path, std::ios::binary);
-    for (size_t i = 0; i < pieces_to_download.size(); i++) {
-        std::vector<uint8_t> piece_data =
-            p.download_piece(pieces_to_download[i].first, ec);
-        if (ec) return ec;
-        f.write(reinterpret_cast<char*>(piece_data.data()), piece_data.size());
+
+    // v2 pieces are checked by the peer as their blocks arrive, and written
+    // at their offset in their file. v1 pieces are hashed by the pool while
+    // the next ones are downloaded, and written once verified. Either may
+    // be written out of order.
+    bool const v2 = has_v2();
+    std::vector<uint64_t> file_offsets;
+    for (uint64_t offset = 0; TreeFile const& file : file_tree) {
+        file_offsets.push_back(offset);
+        offset += file.length;
     }
+    auto write = [&](size_t index, std::vector<uint8_t> const& data) {
+        uint64_t position = index * piece_length;
+        if (v2) {
+            auto piece = v2_piece(index);
+            position = file_offsets[piece->file] + piece->offset;
+        }
+        f.seekp(position);
+        f.write(reinterpret_cast<char const*>(data.data()), data.size());
+    };
 
-    return {};
+    VerifyPool pool(0, VERIFY_QUEUE_CAPACITY);
+    auto write_piece = [&](VerifyEvent const& event) -> std::error_code {
+        if (!event.passed)
+            return errors::make_error_code(
+                errors::error_code_enum::piece_hash_mismatch);
+        write(event.piece_index, event.data);
+        return {};
+    };
+
+    // the blocks of the next pieces are requested while a piece completes,
+    // their buffers are only allocated once requested
+    p.set_request_depth_limits(min_request_depth, max_request_depth);
+    for (piece_index index : pieces_to_download) {
+        ec = p.queue_piece(index, v2);
+        if (ec) break;
+    }
+    while (!ec) {
+        std::optional<DownloadedPiece> piece = p.next_piece(ec);
+        if (!piece) break;
+        if (v2) {
+            write(piece->index, piece->data);
+            continue;
+        }
+
+        pool.submit(piece->index, std::move(piece->data),
+                    piece_hashes()[piece->index]);
+        while (auto event = pool.poll())
+            if (!ec) ec = write_piece(*event);
+    }
+    while (auto event = pool.wait())
+        if (!ec) ec = write_piece(*event);
+
+    PeerStats peer_stats = p.stats();
+    spdlog::debug(
+        "Torrent: {} pieces from peer {}, {} requests, request depth {}, "
+        "max in flight {}, min rtt {} us, delivery rate {:.0f} B/s, "
+        "{} send calls, {} recv calls",
+        peer_stats.pieces_received, p.ip_, peer_stats.requests_sent,
+        peer_stats.request_depth, peer_stats.max_requests_in_flight,
+        peer_stats.min_rtt.count() / 1000, peer_stats.delivery_rate,
+        peer_stats.send_calls, peer_stats.recv_calls);
+
+    VerifyPoolStats stats = pool.stats();
+    spdlog::debug(
+        "Torrent: {} pieces verified, {} failed, max queue depth {}, "
+        "average latency {} us, max latency {} us",
+        stats.passed + stats.failed, stats.failed, stats.max_queue_depth,
+        stats.passed + stats.failed == 0
+            ? 0
+            : stats.total_latency.count() / 1000 /
+                  static_cast<long>(stats.passed + stats.failed),
+        stats.max_latency.count() / 1000);
+
+    return ec;
 }
 
 }  // namespace bittorrent
\ No newline at end of file
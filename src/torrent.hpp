@@ -1,12 +1,17 @@
 #pragma once
 
 #include "error.hpp"
-#include "lib/nlohmann/json.hpp"
 #include "tracker_info.hpp"
+#include "merkle.hpp"
 #include "peer.hpp"
+#include "sha1_digest.hpp"
+#include <array>
 #include <filesystem>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -25,36 +30,116 @@ class Torrent {
     static std::unique_ptr<Torrent> parse_torrent(
         std::filesystem::path const& file_path, std::error_code& ec);
 
-    // Returns SHA1 of the info dictionary
-    std::vector<uint8_t> info_hash_raw() const;
+    // Returns SHA1 of the info dictionary, computed when parsing. For a
+    // v2-only torrent its SHA-256 truncated to 20 bytes instead, as in
+    // tracker requests and handshakes (BEP 52).
+    Sha1Digest const& info_hash_raw() const {
+        return info_hash_raw_;
+    }
     std::string info_hash() const;
+    // SHA-256 of the info dictionary, for v2 torrents
+    Sha256Digest const& info_hash_v2_raw() const { return info_hash_v2_raw_; }
 
-    // Returns a vector of 20-byte SHA1 hashes
-    std::vector<std::string> piece_hashes() const;
+    // v1 piece hashes (pieces) and v2 file tree; both for hybrid torrents
+    bool has_v1() const { return has_v1_; }
+    bool has_v2() const { return meta_version == 2; }
+
+    // SHA1 of each piece, viewed in the metainfo
+    std::span<Sha1Digest const> piece_hashes() const {
+        return digests_view(pieces);
+    }
 
     // Request tracker for peers
     std::optional<TrackerInfo> discover_peers(std::error_code& ec) const;
 
-    // URL to tracker
+    // URL to tracker, empty for trackerless torrents
     std::string announce;
+    // tiers of tracker URLs (BEP 12), empty if the metainfo has none
+    std::vector<std::vector<std::string>> announce_list;
 
     void connect_peers();
 
-    using piece_hash = std::vector<uint8_t>;
     using piece_index = size_t;
-    using piece = std::pair<piece_index, piece_hash>;
-    std::vector<piece> compute_pieces_to_download(
+    // the v2 pieces of v2 and hybrid torrents, v1 pieces otherwise
+    std::vector<piece_index> compute_pieces_to_download(
         std::string const& out_file_path);
 
     std::error_code download_file(std::string const& out_file_path);
 
     // INFO
+    // total length of the files
     size_t length;
+    // 1 for single-file torrents
+    size_t file_count = 1;
+    struct FileEntry {
+        // relative to the directory of the torrent
+        std::filesystem::path path;
+        size_t length;
+        // padding file of a hybrid torrent (BEP 47), its data is zeroes
+        bool padding = false;
+    };
+    // files of multi-file torrents, in the order of their data in the
+    // pieces; empty for single-file torrents
+    std::vector<FileEntry> files;
     std::string name;
     size_t piece_length;
-    std::string pieces;
+    // concatenated 20-byte SHA1 hashes, view into the metainfo
+    std::string_view pieces;
+
+    // BitTorrent v2 (BEP 52)
+    // https://www.bittorrent.org/beps/bep_0052.html
+    // 1 for v1 torrents, 2 for v2 and hybrid ones
+    int meta_version = 1;
+    struct TreeFile {
+        // relative to the directory of the torrent; for a single-file
+        // torrent the file name
+        std::filesystem::path path;
+        size_t length;
+        // root of the merkle tree of the file, zeroes for an empty file
+        Sha256Digest pieces_root;
+        // hash of each piece of the file, view into the metainfo. Empty for
+        // files of at most one piece, or if the metainfo has no piece layers
+        std::span<Sha256Digest const> piece_layer;
+        // index of its first v2 piece
+        size_t first_piece = 0;
+    };
+    // files of the file tree, in order
+    std::vector<TreeFile> file_tree;
+
+    // v2 pieces: those of each file in turn, every file starting a new
+    // piece (empty files have none). They are the v1 pieces of a hybrid
+    // torrent, whose files are padded to piece boundaries.
+    struct V2Piece {
+        // index in file_tree
+        size_t file;
+        // of the piece in its file
+        uint64_t offset;
+        uint64_t size;
+        // leaves of the subtree of the piece: piece_length / 16 KiB, or
+        // fewer for a file of at most one piece
+        size_t width;
+        // root of that subtree: the node of the piece layer, or the pieces
+        // root of a file of at most one piece. Unset without piece layer.
+        std::optional<Sha256Digest> hash;
+    };
+    size_t v2_piece_count() const;
+    // nullopt past the last piece
+    std::optional<V2Piece> v2_piece(size_t index) const;
 
     std::vector<std::unique_ptr<Peer>> peers;
+    // limits of the block requests kept in flight per peer by
+    // download_file, the same for a fixed number
+    size_t min_request_depth = Peer::MIN_REQUEST_DEPTH;
+    size_t max_request_depth = Peer::MAX_REQUEST_DEPTH;
+
+   private:
+    // contents of the metainfo file
+    std::string metainfo_;
+
+    // SHA1 of the encoded info dictionary, as found in the metainfo file
+    Sha1Digest info_hash_raw_;
+    Sha256Digest info_hash_v2_raw_{};
+    bool has_v1_ = false;
 };
 
 }  // namespace bittorrent
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "torrent_index.hpp"
+#include "torrent.hpp"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+namespace bittorrent {
+
+static IndexEntry index_torrent(std::filesystem::path const& path) {
+    IndexEntry entry;
+    entry.path = path;
+
+    auto torrent = Torrent::parse_torrent(path, entry.ec);
+    if (!torrent) return entry;
+
+    entry.info_hash = torrent->info_hash_raw();
+    entry.total_size = torrent->length;
+    entry.piece_length = torrent->piece_length;
+    entry.piece_count = torrent->pieces.size() / 20;
+    entry.file_count = torrent->file_count;
+
+    auto add_tracker = [&](std::string const& url) {
+        if (!url.empty() &&
+            std::find(entry.trackers.begin(), entry.trackers.end(), url) ==
+                entry.trackers.end())
+            entry.trackers.push_back(url);
+    };
+    add_tracker(torrent->announce);
+    for (auto const& tier : torrent->announce_list)
+        for (std::string const& url : tier) add_tracker(url);
+    return entry;
+}
+
+std::vector<IndexEntry> index_torrents(
+    std::vector<std::filesystem::path> const& paths, unsigned threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(threads, std::max<size_t>(paths.size(), 1));
+
+    // workers take the next file to parse, reading and parsing in parallel
+    std::vector<IndexEntry> entries(paths.size());
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i = next++; i < paths.size(); i = next++)
+            entries[i] = index_torrent(paths[i]);
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; i++) workers.emplace_back(work);
+    work();
+    for (std::thread& worker : workers) worker.join();
+
+    return entries;
+}
+
+// ===== CSV =====
+
+static void write_csv_field(std::string const& field, std::ostream& out) {
+    if (field.find_first_of(",\"\n\r") == std::string::npos) {
+        out << field;
+        return;
+    }
+    out << '"';
+    for (char c : field) {
+        if (c == '"') out << '"';
+        out << c;
+    }
+    out << '"';
+}
+
+void write_index_csv(std::vector<IndexEntry> const& entries,
+                     std::ostream& out) {
+    out << "path,info_hash,total_size,piece_length,piece_count,file_count,"
+           "trackers\n";
+    for (IndexEntry const& entry : entries) {
+        if (entry.ec) continue;
+
+        std::string trackers;
+        for (std::string const& url : entry.trackers) {
+            if (!trackers.empty()) trackers += ' ';
+            trackers += url;
+        }
+
+        write_csv_field(entry.path.string(), out);
+        out << ',' << to_hex(entry.info_hash) << ',' << entry.total_size << ','
+            << entry.piece_length << ',' << entry.piece_count << ','
+            << entry.file_count << ',';
+        write_csv_field(trackers, out);
+        out << '\n';
+    }
+}
+
+// ===== Binary =====
+
+template <typename T>
+static void write_le(T value, std::ostream& out) {
+    char bytes[sizeof(T)];
+    for (size_t i = 0; i < sizeof(T); i++)
+        bytes[i] = static_cast<char>(static_cast<uint64_t>(value) >> (i * 8));
+    out.write(bytes, sizeof(T));
+}
+
+// u16 size + bytes, longer strings are truncated
+static void write_short_string(std::string const& str, std::ostream& out) {
+    uint16_t size = static_cast<uint16_t>(
+        std::min<size_t>(str.size(), std::numeric_limits<uint16_t>::max()));
+    write_le(size, out);
+    out.write(str.data(), size);
+}
+
+void write_index_binary(std::vector<IndexEntry> const& entries,
+                        std::ostream& out) {
+    uint32_t count = std::count_if(entries.begin(), entries.end(),
+                                   [](IndexEntry const& e) { return !e.ec; });
+    out.write("BTIX", 4);
+    write_le(uint32_t{1}, out);
+    write_le(count, out);
+
+    for (IndexEntry const& entry : entries) {
+        if (entry.ec) continue;
+        out.write(reinterpret_cast<char const*>(entry.info_hash.data()),
+                  entry.info_hash.size());
+        write_le(uint64_t{entry.total_size}, out);
+        write_le(uint64_t{entry.piece_length}, out);
+        write_le(static_cast<uint32_t>(entry.piece_count), out);
+        write_le(static_cast<uint32_t>(entry.file_count), out);
+        write_short_string(entry.path.string(), out);
+
+        uint16_t trackers = static_cast<uint16_t>(std::min<size_t>(
+            entry.trackers.size(), std::numeric_limits<uint16_t>::max()));
+        write_le(trackers, out);
+        for (uint16_t i = 0; i < trackers; i++)
+            write_short_string(entry.trackers[i], out);
+    }
+}
+
+}  // namespace bittorrent
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "sha1_digest.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace bittorrent {
+
+// Summary of one .torrent file, as stored in an index
+struct IndexEntry {
+    std::filesystem::path path;
+    // set if the file could not be parsed, other fields are then unset
+    std::error_code ec;
+
+    Sha1Digest info_hash{};
+    uint64_t total_size = 0;
+    uint64_t piece_length = 0;
+    uint64_t piece_count = 0;
+    uint64_t file_count = 0;
+    // announce URL then the announce-list ones, without duplicates
+    std::vector<std::string> trackers;
+};
+
+// Parses the torrent files with `threads` workers (0: one per core), each
+// reading and parsing its own files. Entries are in the order of `paths`.
+std::vector<IndexEntry> index_torrents(
+    std::vector<std::filesystem::path> const& paths, unsigned threads = 0);
+
+// One line per parsed torrent, after a header line:
+// path,info_hash,total_size,piece_length,piece_count,file_count,trackers
+// Trackers are separated by spaces; fields are quoted when needed.
+void write_index_csv(std::vector<IndexEntry> const& entries, std::ostream& out);
+
+// Compact binary index, little endian:
+//   "BTIX", u32 version (1), u32 number of entries, then for each entry:
+//   20-byte info hash, u64 total size, u64 piece length, u32 piece count,
+//   u32 file count, u16 path size + path, u16 number of trackers, and for
+//   each tracker u16 size + URL.
+// Entries that could not be parsed are left out.
+void write_index_binary(std::vector<IndexEntry> const& entries,
+                        std::ostream& out);
+
+}  // namespace bittorrent
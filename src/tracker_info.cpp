@@ -1,35 +1,123 @@
 #include "tracker_info.hpp"
+#include <cstdint>
 
 namespace bittorrent {
 
-TrackerInfo TrackerInfo::parse_tracker_response(nlohmann::json& tracker_response) {
-    TrackerInfo tracker_info;
-
-    tracker_info.interval = tracker_response["interval"];
-
-    auto peers = tracker_response["peers"];
-    if (!peers.is_string()) {
-        // TODO: error handling
-        return tracker_info;
-    }
-    auto peers_str = peers.get<std::string>();
-
+// compact format: 4 bytes of ipv4 address, 2 bytes of port, big endian
+static std::vector<std::string> parse_compact_peers(
+    std::string_view peers_str) {
+    std::vector<std::string> peers;
     size_t number_of_peers = peers_str.size() / 6;
     for (size_t i = 0; i < number_of_peers; i++) {
-        std::string ip_raw = peers_str.substr(i * 6, 4);
+        std::string_view ip_raw = peers_str.substr(i * 6, 4);
         std::string ip = std::to_string(static_cast<unsigned char>(ip_raw[0])) + "." +
                          std::to_string(static_cast<unsigned char>(ip_raw[1])) + "." +
                          std::to_string(static_cast<unsigned char>(ip_raw[2])) + "." +
                          std::to_string(static_cast<unsigned char>(ip_raw[3]));
-        std::string port_raw = peers_str.substr(i * 6 + 4, 2);
+        std::string_view port_raw = peers_str.substr(i * 6 + 4, 2);
         uint16_t port =
             (static_cast<uint16_t>(static_cast<unsigned char>(port_raw[0])
                                    << 8)) |
             static_cast<uint16_t>(static_cast<unsigned char>(port_raw[1]));
-        tracker_info.peers.push_back(ip + ":" + std::to_string(port));
+        peers.push_back(ip + ":" + std::to_string(port));
     }
+    return peers;
+}
 
-    return tracker_info;
+void TrackerResponseHandler::fail(errors::error_code_enum e) {
+    if (!error_) error_ = errors::make_error_code(e);
+}
+
+void TrackerResponseHandler::begin_dict() {
+    // a peer of the list
+    if (in_peer_list_ && depth_ == 2) {
+        peer_key_.clear();
+        peer_ip_.reset();
+        peer_port_.reset();
+    } else if (depth_ == 1 && (key_ == "peers" || key_ == "interval")) {
+        fail(errors::error_code_enum::bencode_schema_type_mismatch);
+    }
+    depth_++;
+}
+
+void TrackerResponseHandler::begin_list() {
+    if (depth_ == 0 || (depth_ == 1 && key_ == "interval") ||
+        (in_peer_list_ && depth_ == 2)) {
+        fail(errors::error_code_enum::bencode_schema_type_mismatch);
+    } else if (depth_ == 1 && key_ == "peers") {
+        has_peers_ = true;
+        in_peer_list_ = true;
+    }
+    depth_++;
+}
+
+void TrackerResponseHandler::end() {
+    if (in_peer()) {
+        if (!peer_ip_ || !peer_port_)
+            fail(errors::error_code_enum::bencode_schema_missing_key);
+        else
+            tracker_info_.peers.push_back(*peer_ip_ + ":" +
+                                          std::to_string(*peer_port_));
+    } else if (in_peer_list_ && depth_ == 2) {
+        in_peer_list_ = false;
+    }
+    depth_--;
 }
-}  // namespace bittorrent
 
+void TrackerResponseHandler::key(std::string_view key) {
+    if (depth_ == 1) key_ = key;
+    if (in_peer()) peer_key_ = key;
+}
+
+void TrackerResponseHandler::string(std::string_view value) {
+    if (depth_ == 0 || (depth_ == 1 && key_ == "interval") ||
+        (in_peer_list_ && depth_ == 2) || (in_peer() && peer_key_ == "port")) {
+        fail(errors::error_code_enum::bencode_schema_type_mismatch);
+    } else if (depth_ == 1 && key_ == "peers") {
+        has_peers_ = true;
+        tracker_info_.peers = parse_compact_peers(value);
+    } else if (in_peer() && peer_key_ == "ip") {
+        peer_ip_ = value;
+    }
+}
+
+void TrackerResponseHandler::integer(int64_t value) {
+    if (depth_ == 0 || (depth_ == 1 && key_ == "peers") ||
+        (in_peer_list_ && depth_ == 2) || (in_peer() && peer_key_ == "ip")) {
+        fail(errors::error_code_enum::bencode_schema_type_mismatch);
+    } else if (depth_ == 1 && key_ == "interval") {
+        if (value < 0)
+            fail(errors::error_code_enum::bencode_schema_type_mismatch);
+        else
+            tracker_info_.interval = value;
+    } else if (in_peer() && peer_key_ == "port") {
+        if (value < 0 || value > UINT16_MAX)
+            fail(errors::error_code_enum::bencode_schema_type_mismatch);
+        else
+            peer_port_ = static_cast<uint16_t>(value);
+    }
+}
+
+std::optional<TrackerInfo> TrackerResponseHandler::result(
+    std::error_code& ec) {
+    if (!error_ && !has_peers_)
+        fail(errors::error_code_enum::bencode_schema_missing_key);
+    if (error_) {
+        ec = error_;
+        return {};
+    }
+    return std::move(tracker_info_);
+}
+
+std::optional<TrackerInfo> TrackerInfo::parse_tracker_response(
+    std::string_view tracker_response, std::error_code& ec) {
+    TrackerResponseHandler handler;
+    bencode::StreamParser parser(handler);
+    parser.feed(tracker_response, ec);
+    if (ec) return {};
+    parser.finish(ec);
+    if (ec) return {};
+    return handler.result(ec);
+}
+
+}  // namespace bittorrent
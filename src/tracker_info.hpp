@@ -1,7 +1,10 @@
 #pragma once
 
-#include "lib/nlohmann/json.hpp"
+#include "bencode_parser.hpp"
+#include <optional>
 #include <string>
+#include <string_view>
+#include <system_error>
 #include <vector>
 
 namespace bittorrent {
@@ -10,15 +13,53 @@ class TrackerInfo {
    public:
     TrackerInfo() = default;
 
-    static TrackerInfo parse_tracker_response(nlohmann::json& tracker_response);
+    static std::optional<TrackerInfo> parse_tracker_response(
+        std::string_view tracker_response, std::error_code& ec);
 
     // interval at which the client should wait between sending regular requests
     // to the tracker
-    size_t interval;
+    size_t interval = 0;
 
     // list of peers
-    // ipv4:port
+    // ip:port
     std::vector<std::string> peers;
 };
 
-}  // namespace bittorrent
\ No newline at end of file
+// Builds a TrackerInfo from the events of a bencode::StreamParser, so the
+// tracker response can be parsed while it is received. Peers are either
+// compact (a string) or a list of dicts with an ip and a port.
+// https://www.bittorrent.org/beps/bep_0003.html#trackers
+// https://www.bittorrent.org/beps/bep_0023.html
+class TrackerResponseHandler : public bencode::Handler {
+   public:
+    void begin_dict() override;
+    void begin_list() override;
+    void end() override;
+    void key(std::string_view key) override;
+    void string(std::string_view value) override;
+    void integer(int64_t value) override;
+
+    // Set once a value has the wrong type, parsing can stop
+    std::error_code error() const { return error_; }
+
+    // The response once parsed: fails if it has no peers, or a value of the
+    // wrong type
+    std::optional<TrackerInfo> result(std::error_code& ec);
+
+   private:
+    void fail(errors::error_code_enum e);
+    bool in_peer() const { return in_peer_list_ && depth_ == 3; }
+
+    TrackerInfo tracker_info_;
+    std::error_code error_;
+    size_t depth_ = 0;
+    // last key of the top-level dict, and of the current peer dict
+    std::string key_;
+    std::string peer_key_;
+    bool has_peers_ = false;
+    bool in_peer_list_ = false;
+    std::optional<std::string> peer_ip_;
+    std::optional<uint16_t> peer_port_;
+};
+
+}  // namespace bittorrent
@@ -0,0 +1,267 @@
+#include "verify.hpp"
+#include "lib/sha1.hpp"
+#include "lib/utils.hpp"
+#include "mapped_file.hpp"
+#include "merkle.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <optional>
+#include <thread>
+
+namespace bittorrent {
+
+namespace {
+
+// A file of the torrent and where its data is in the pieces
+struct FileData {
+    // unset if the file could not be mapped
+    std::optional<MappedFile> file;
+    uint64_t offset;
+    uint64_t length;
+    // padding file (BEP 47), read as zeroes and never opened
+    bool padding = false;
+};
+
+class ContentLayout {
+   public:
+    ContentLayout(Torrent const& torrent, std::filesystem::path const& path,
+                  VerifyReport& report) {
+        if (torrent.has_v2()) {
+            // v2 pieces: each file starts a new piece, the rest of its last
+            // piece is padding
+            bool single_file = torrent.file_tree.size() == 1 &&
+                               torrent.file_tree[0].path == torrent.name;
+            for (Torrent::TreeFile const& entry : torrent.file_tree) {
+                add_file(single_file ? path : path / entry.path,
+                         entry.length, false, report);
+                uint64_t tail = entry.length % torrent.piece_length;
+                if (tail != 0)
+                    add_file({}, torrent.piece_length - tail, true, report);
+            }
+        } else if (torrent.files.empty()) {
+            add_file(path, torrent.length, false, report);
+        } else {
+            for (Torrent::FileEntry const& entry : torrent.files)
+                add_file(path / entry.path, entry.length, entry.padding,
+                         report);
+        }
+    }
+
+    // Data of [begin, end), copied to `buffer` if it spans several files.
+    // nullptr if part of it is missing.
+    uint8_t const* data(uint64_t begin, uint64_t end, uint8_t* buffer) const {
+        auto file = containing(begin);
+        if (end <= file->offset + file->length && !file->padding)
+            return direct(*file, begin, end);
+
+        for (uint64_t position = begin; position < end; ++file) {
+            if (file == files_.end()) return nullptr;
+            uint64_t segment_end =
+                std::min(end, file->offset + file->length);
+            if (segment_end <= position) continue;
+            if (file->padding) {
+                std::memset(buffer + (position - begin), 0,
+                            segment_end - position);
+                position = segment_end;
+                continue;
+            }
+            uint8_t const* segment = direct(*file, position, segment_end);
+            if (segment == nullptr) return nullptr;
+            std::memcpy(buffer + (position - begin), segment,
+                        segment_end - position);
+            position = segment_end;
+        }
+        return buffer;
+    }
+
+    // Requests or releases the pages of [begin, end)
+    void advise(uint64_t begin, uint64_t end, bool need) const {
+        for (auto file = containing(begin);
+             file != files_.end() && file->offset < end; ++file) {
+            if (!file->file) continue;
+            uint64_t from = std::max(begin, file->offset) - file->offset;
+            uint64_t to = std::min(end, file->offset + file->length) -
+                          file->offset;
+            if (to <= from) continue;
+            if (need)
+                file->file->will_need(from, to - from);
+            else
+                file->file->dont_need(from, to - from);
+        }
+    }
+
+   private:
+    void add_file(std::filesystem::path const& path, uint64_t length,
+                  bool padding, VerifyReport& report) {
+        FileData entry{{}, offset_, length, padding};
+        offset_ += length;
+        if (length > 0 && !padding) {
+            std::error_code ec;
+            entry.file = MappedFile::open(path, ec);
+            if (ec) report.file_errors.emplace_back(path, ec);
+        }
+        files_.push_back(std::move(entry));
+    }
+
+    // the last file starting at or before `position`, empty files before a
+    // file starting at the same offset are skipped
+    std::vector<FileData>::const_iterator containing(uint64_t position) const {
+        auto it = std::upper_bound(
+            files_.begin(), files_.end(), position,
+            [](uint64_t p, FileData const& f) { return p < f.offset; });
+        return it == files_.begin() ? it : it - 1;
+    }
+
+    static uint8_t const* direct(FileData const& file, uint64_t begin,
+                                 uint64_t end) {
+        // missing, or shorter than in the torrent
+        if (!file.file || file.file->size() < end - file.offset)
+            return nullptr;
+        return file.file->data() + (begin - file.offset);
+    }
+
+    std::vector<FileData> files_;
+    uint64_t offset_ = 0;
+};
+
+}  // namespace
+
+VerifyReport verify_content(Torrent const& torrent,
+                            std::filesystem::path const& path,
+                            unsigned threads, size_t readahead) {
+    auto start = std::chrono::steady_clock::now();
+
+    VerifyReport report;
+    bool const v2 = torrent.has_v2();
+    std::span<Sha1Digest const> hashes = torrent.piece_hashes();
+    size_t const piece_count = v2 ? torrent.v2_piece_count() : hashes.size();
+    uint64_t const piece_length = torrent.piece_length;
+    // v2 pieces are laid out as if every file was padded to a whole piece
+    uint64_t const total = v2 ? piece_count * piece_length : torrent.length;
+    report.piece_count = piece_count;
+
+    ContentLayout layout(torrent, path, report);
+
+    // a batch of pieces is hashed at once, batches are taken in order
+    size_t const batch_count =
+        (piece_count + sha1::MAX_BATCH - 1) / sha1::MAX_BATCH;
+    uint64_t const batch_bytes = sha1::MAX_BATCH * piece_length;
+    size_t const readahead_batches =
+        std::max<size_t>(1, readahead / std::max<uint64_t>(batch_bytes, 1));
+    auto batch_range = [&](size_t batch) {
+        uint64_t begin = std::min(total, batch * batch_bytes);
+        return std::pair{begin, std::min(total, begin + batch_bytes)};
+    };
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(threads, std::max<size_t>(batch_count, 1));
+
+    // PIECE_UNCHECKED: a v2 piece without piece layer, whose hash is in
+    // roots until the pieces root of its file is checked
+    constexpr uint8_t PIECE_UNCHECKED = 2;
+    std::vector<uint8_t> passed(piece_count, 0);
+    std::vector<Sha256Digest> roots(v2 ? piece_count : 0);
+    std::atomic<uint64_t> bytes_hashed{0};
+    std::atomic<size_t> next{0};
+    layout.advise(0, batch_range(readahead_batches - 1).second, true);
+
+    auto work = [&] {
+        // pieces spanning several files are copied here
+        std::vector<std::vector<uint8_t>> buffers(sha1::MAX_BATCH);
+        std::vector<uint8_t const*> data;
+        std::vector<size_t> indexes;
+        std::vector<Sha1Digest> digests(sha1::MAX_BATCH);
+
+        for (size_t batch = next++; batch < batch_count; batch = next++) {
+            auto [ahead_begin, ahead_end] =
+                batch_range(batch + readahead_batches);
+            layout.advise(ahead_begin, ahead_end, true);
+
+            data.clear();
+            indexes.clear();
+            uint64_t hashed = 0;
+            size_t first = batch * sha1::MAX_BATCH;
+            size_t last = std::min(piece_count, first + sha1::MAX_BATCH);
+            for (size_t i = first; i < last; i++) {
+                std::optional<Torrent::V2Piece> v2_piece;
+                if (v2) v2_piece = torrent.v2_piece(i);
+                uint64_t begin = i * piece_length;
+                uint64_t end = v2 ? begin + v2_piece->size
+                                  : std::min(total, begin + piece_length);
+                if (begin >= end) continue;
+                std::vector<uint8_t>& buffer = buffers[i - first];
+                if (buffer.size() < end - begin) buffer.resize(end - begin);
+                uint8_t const* piece = layout.data(begin, end, buffer.data());
+                if (piece == nullptr) continue;
+
+                hashed += end - begin;
+                // the merkle tree of the blocks of a v2 piece
+                if (v2) {
+                    Sha256Digest root =
+                        merkle::root(merkle::leaves(piece, end - begin),
+                                     v2_piece->width, Sha256Digest{});
+                    if (v2_piece->hash) {
+                        passed[i] = root == *v2_piece->hash;
+                    } else {
+                        roots[i] = root;
+                        passed[i] = PIECE_UNCHECKED;
+                    }
+                    continue;
+                }
+                // a shorter last piece is hashed on its own
+                if (end - begin != piece_length) {
+                    passed[i] = utils::sha1_digest(piece, end - begin) ==
+                                hashes[i];
+                    continue;
+                }
+                data.push_back(piece);
+                indexes.push_back(i);
+            }
+
+            utils::sha1_hash_batch(data.data(), data.size(), piece_length,
+                                   digests.data());
+            for (size_t j = 0; j < indexes.size(); j++)
+                passed[indexes[j]] = digests[j] == hashes[indexes[j]];
+            bytes_hashed += hashed;
+
+            auto [begin, end] = batch_range(batch);
+            layout.advise(begin, end, false);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; i++) workers.emplace_back(work);
+    work();
+    for (std::thread& worker : workers) worker.join();
+
+    // the pieces of a file without piece layer pass together, if they
+    // hash to its pieces root
+    for (Torrent::TreeFile const& file : torrent.file_tree) {
+        if (!v2 || !file.piece_layer.empty() || file.length <= piece_length)
+            continue;
+        size_t const first = file.first_piece;
+        size_t const last = first + (file.length + piece_length - 1) /
+                                        piece_length;
+        bool ok = std::all_of(passed.begin() + first, passed.begin() + last,
+                              [](uint8_t p) { return p == PIECE_UNCHECKED; }) &&
+                  merkle::root_from_piece_layer(
+                      std::span(roots).subspan(first, last - first),
+                      piece_length) == file.pieces_root;
+        std::fill(passed.begin() + first, passed.begin() + last, ok);
+    }
+
+    report.bitfield.assign((piece_count + 7) / 8, 0);
+    for (size_t i = 0; i < piece_count; i++) {
+        if (passed[i])
+            report.bitfield[i / 8] |= static_cast<uint8_t>(0x80 >> (i % 8));
+        else
+            report.mismatches.push_back(i);
+    }
+    report.bytes_hashed = bytes_hashed;
+    report.elapsed = std::chrono::steady_clock::now() - start;
+    return report;
+}
+
+}  // namespace bittorrent
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "torrent.hpp"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace bittorrent {
+
+// Result of checking the data of a torrent against its piece hashes
+struct VerifyReport {
+    size_t piece_count = 0;
+    // bit i is set if piece i matches its hash, from the high bit of the
+    // first byte as in the bitfield message
+    std::vector<uint8_t> bitfield;
+    // pieces that do not match, or whose data is missing, in order
+    std::vector<size_t> mismatches;
+    // files that could not be mapped, their pieces are mismatches
+    std::vector<std::pair<std::filesystem::path, std::error_code>> file_errors;
+    // size of the pieces that were hashed
+    uint64_t bytes_hashed = 0;
+    std::chrono::duration<double> elapsed{0};
+
+    bool has_piece(size_t index) const {
+        return (bitfield[index / 8] >> (7 - index % 8)) & 1;
+    }
+};
+
+// Hashes every piece of the data at `path` (the file of a single-file
+// torrent, the directory holding the files of a multi-file one) with
+// `threads` workers (0: one per core). The files are memory mapped; the
+// pages of the next `readahead` bytes are requested ahead of the workers
+// and the hashed ones are released from the mapping.
+// The pieces of v2 and hybrid torrents are checked per file against their
+// merkle trees (Torrent::v2_piece): the piece layer, or the pieces root of
+// the file without one. Those of v1 torrents against their SHA1.
+VerifyReport verify_content(Torrent const& torrent,
+                            std::filesystem::path const& path,
+                            unsigned threads = 0,
+                            size_t readahead = 64 * 1024 * 1024);
+
+}  // namespace bittorrent
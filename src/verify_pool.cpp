@@ -0,0 +1,118 @@
+#include "verify_pool.hpp"
+#include "lib/sha1.hpp"
+#include "lib/utils.hpp"
+#include <algorithm>
+
+namespace bittorrent {
+
+VerifyPool::VerifyPool(unsigned threads, size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; i++)
+        workers_.emplace_back([this] { work(); });
+}
+
+VerifyPool::~VerifyPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    job_ready_.notify_all();
+    queue_not_full_.notify_all();
+    for (std::thread& worker : workers_) worker.join();
+}
+
+void VerifyPool::submit(size_t piece_index, std::vector<uint8_t> data,
+                        Sha1Digest const& expected) {
+    std::unique_lock lock(mutex_);
+    queue_not_full_.wait(
+        lock, [this] { return jobs_.size() < capacity_ || stopping_; });
+    jobs_.push_back({piece_index, std::move(data), expected,
+                     std::chrono::steady_clock::now()});
+    pending_++;
+    stats_.submitted++;
+    stats_.queue_depth = jobs_.size();
+    stats_.max_queue_depth = std::max(stats_.max_queue_depth, jobs_.size());
+    lock.unlock();
+    job_ready_.notify_one();
+}
+
+std::optional<VerifyEvent> VerifyPool::poll() {
+    std::lock_guard lock(mutex_);
+    if (results_.empty()) return {};
+    VerifyEvent event = std::move(results_.front());
+    results_.pop_front();
+    pending_--;
+    return event;
+}
+
+std::optional<VerifyEvent> VerifyPool::wait() {
+    std::unique_lock lock(mutex_);
+    result_ready_.wait(lock,
+                       [this] { return !results_.empty() || pending_ == 0; });
+    if (results_.empty()) return {};
+    VerifyEvent event = std::move(results_.front());
+    results_.pop_front();
+    pending_--;
+    return event;
+}
+
+VerifyPoolStats VerifyPool::stats() const {
+    std::lock_guard lock(mutex_);
+    return stats_;
+}
+
+void VerifyPool::work() {
+    std::vector<Job> batch;
+    std::vector<uint8_t const*> buffers;
+    std::vector<Sha1Digest> digests;
+
+    while (true) {
+        std::unique_lock lock(mutex_);
+        job_ready_.wait(lock, [this] { return !jobs_.empty() || stopping_; });
+        if (stopping_) return;
+
+        // the first piece, and the ones of the same size queued behind it
+        batch.clear();
+        size_t size = jobs_.front().data.size();
+        for (auto it = jobs_.begin();
+             it != jobs_.end() && batch.size() < sha1::MAX_BATCH;) {
+            if (it->data.size() != size) {
+                ++it;
+                continue;
+            }
+            batch.push_back(std::move(*it));
+            it = jobs_.erase(it);
+        }
+        stats_.queue_depth = jobs_.size();
+        stats_.in_flight += batch.size();
+        lock.unlock();
+        queue_not_full_.notify_all();
+
+        auto start = std::chrono::steady_clock::now();
+        buffers.clear();
+        for (Job const& job : batch) buffers.push_back(job.data.data());
+        digests.resize(batch.size());
+        utils::sha1_hash_batch(buffers.data(), batch.size(), size,
+                               digests.data());
+        auto end = std::chrono::steady_clock::now();
+
+        lock.lock();
+        stats_.in_flight -= batch.size();
+        stats_.hash_time += end - start;
+        for (size_t i = 0; i < batch.size(); i++) {
+            bool passed = digests[i] == batch[i].expected;
+            auto latency = end - batch[i].submitted;
+            (passed ? stats_.passed : stats_.failed)++;
+            stats_.total_latency += latency;
+            stats_.max_latency = std::max<std::chrono::nanoseconds>(
+                stats_.max_latency, latency);
+            results_.push_back({batch[i].piece_index, passed,
+                                std::move(batch[i].data), latency});
+        }
+        lock.unlock();
+        result_ready_.notify_all();
+    }
+}
+
+}  // namespace bittorrent
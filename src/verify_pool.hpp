@@ -0,0 +1,96 @@
+#pragma once
+
+#include "sha1_digest.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace bittorrent {
+
+// Outcome of the verification of a piece
+struct VerifyEvent {
+    size_t piece_index;
+    bool passed;
+    std::vector<uint8_t> data;
+    // from submit() to the end of hashing
+    std::chrono::nanoseconds latency;
+};
+
+struct VerifyPoolStats {
+    // pieces waiting for a worker
+    size_t queue_depth = 0;
+    size_t max_queue_depth = 0;
+    // pieces being hashed
+    size_t in_flight = 0;
+    size_t submitted = 0;
+    size_t passed = 0;
+    size_t failed = 0;
+    // submit to result, over the passed and failed pieces
+    std::chrono::nanoseconds total_latency{0};
+    std::chrono::nanoseconds max_latency{0};
+    // time spent hashing, summed over the workers
+    std::chrono::nanoseconds hash_time{0};
+};
+
+// Checks the SHA1 of downloaded pieces on worker threads, so that the
+// thread reading the sockets does not stall while a piece is hashed.
+// The queue is bounded: submit() blocks while `capacity` pieces are
+// waiting, which also bounds the memory held by the pool. Workers take the
+// pieces of the same size waiting in the queue together and hash them in
+// parallel SIMD lanes (see utils::sha1_hash_batch).
+class VerifyPool {
+   public:
+    // `threads` workers (0: one per core)
+    VerifyPool(unsigned threads, size_t capacity);
+    ~VerifyPool();
+
+    VerifyPool(VerifyPool const&) = delete;
+    VerifyPool& operator=(VerifyPool const&) = delete;
+
+    // Queues a piece to check against `expected`, blocks while the queue is
+    // full
+    void submit(size_t piece_index, std::vector<uint8_t> data,
+                Sha1Digest const& expected);
+
+    // Next result, if one is ready
+    std::optional<VerifyEvent> poll();
+    // Waits for the next result, nullopt once every submitted piece has
+    // been returned
+    std::optional<VerifyEvent> wait();
+
+    VerifyPoolStats stats() const;
+
+   private:
+    struct Job {
+        size_t piece_index;
+        std::vector<uint8_t> data;
+        Sha1Digest expected;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    void work();
+
+    size_t capacity_;
+    std::vector<std::thread> workers_;
+
+    mutable std::mutex mutex_;
+    // signaled when a job is queued or on shutdown
+    std::condition_variable job_ready_;
+    // signaled when a job is taken from the queue
+    std::condition_variable queue_not_full_;
+    // signaled when a result is ready
+    std::condition_variable result_ready_;
+    std::deque<Job> jobs_;
+    std::deque<VerifyEvent> results_;
+    // submitted pieces whose result has not been returned yet
+    size_t pending_ = 0;
+    bool stopping_ = false;
+    VerifyPoolStats stats_;
+};
+
+}  // namespace bittorrent
@@ -0,0 +1,162 @@
+// Bencode decoding and encoding benchmark on synthetic inputs.
+// Reports throughput and heap allocations per operation, to compare
+// decoders and catch regressions.
+// Usage: bencode_bench [iterations]
+#include "bencode.hpp"
+#include "bencode_document.hpp"
+#include "bencode_lazy.hpp"
+#include "bencode_parser.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <system_error>
+
+using namespace bittorrent;
+using json = nlohmann::json;
+
+// ===== Allocation counting =====
+
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// ===== Inputs =====
+
+static std::string bencode_string(std::string const& str) {
+    return std::to_string(str.size()) + ":" + str;
+}
+
+static std::string random_bytes(size_t size) {
+    std::string bytes(size, '\0');
+    uint32_t state = 2463534242;
+    for (char& c : bytes) {
+        // xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        c = static_cast<char>(state);
+    }
+    return bytes;
+}
+
+// Multi-file metainfo with `files_count` files and `pieces_count` pieces
+static std::string make_torrent(size_t files_count, size_t pieces_count) {
+    std::string files = "l";
+    for (size_t i = 0; i < files_count; i++) {
+        files += "d6:lengthi" + std::to_string(1000 + i * 37) + "e4:pathl" +
+                 bencode_string("dir" + std::to_string(i % 100)) +
+                 bencode_string("file" + std::to_string(i) + ".bin") + "ee";
+    }
+    files += "e";
+
+    return "d8:announce" + bencode_string("http://tracker.example/announce") +
+           "4:infod5:files" + files + "4:name" + bencode_string("dataset") +
+           "12:piece lengthi262144e6:pieces" +
+           bencode_string(random_bytes(pieces_count * 20)) + "ee";
+}
+
+// Tracker response with `peers_count` compact peers
+static std::string make_tracker_response(size_t peers_count) {
+    return "d8:intervali1800e5:peers" +
+           bencode_string(random_bytes(peers_count * 6)) + "e";
+}
+
+// ===== Benchmark =====
+
+// Prints throughput over `bytes` per run and allocations per run
+template <typename F>
+static void run(std::string const& name, size_t bytes, int iterations, F f) {
+    f();  // warm up
+    size_t allocations_before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) f();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    size_t allocs = allocations.load() - allocations_before;
+
+    double megabytes = bytes * static_cast<double>(iterations) / 1e6;
+    std::printf("  %-20s %10.1f MB/s %12.1f allocs/op\n", name.c_str(),
+                megabytes / elapsed.count(),
+                static_cast<double>(allocs) / iterations);
+}
+
+static void bench(std::string const& name, std::string const& input,
+                  int iterations) {
+    std::printf("%s (%zu bytes)\n", name.c_str(), input.size());
+
+    run("json decode", input.size(), iterations, [&] {
+        std::error_code ec;
+        auto value = Bencode::decode_bencoded_value(input, ec);
+        if (ec) std::abort();
+    });
+
+    run("document decode", input.size(), iterations, [&] {
+        std::error_code ec;
+        auto document = bencode::Document::parse(input, ec);
+        if (ec) std::abort();
+    });
+
+    run("indexed decode", input.size(), iterations, [&] {
+        std::error_code ec;
+        auto document = bencode::Document::parse_indexed(input, ec);
+        if (ec) std::abort();
+    });
+
+    // what `info` needs from a torrent: the other values are skipped
+    if (input.find("4:info") != std::string::npos) {
+        run("lazy info fields", input.size(), iterations, [&] {
+            std::error_code ec;
+            auto metainfo = bencode::LazyDict::parse(input, ec);
+            auto info = metainfo->find_dict("info", ec);
+            if (ec || !metainfo->find_string("announce") ||
+                !info->find_string("name") ||
+                !info->find_integer("piece length"))
+                std::abort();
+        });
+    }
+
+    run("stream decode", input.size(), iterations, [&] {
+        std::error_code ec;
+        bencode::Handler handler;
+        bencode::StreamParser parser(handler);
+        parser.feed(input, ec);
+        parser.finish(ec);
+        if (ec) std::abort();
+    });
+
+    std::error_code ec;
+    json value = Bencode::decode_bencoded_value(input, ec);
+
+    run("json encode", input.size(), iterations, [&] {
+        std::string encoded = Bencode::encode_bencoded_value(value);
+        if (encoded.size() != input.size()) std::abort();
+    });
+
+    std::string buffer;
+    run("json encode, reused", input.size(), iterations, [&] {
+        buffer.clear();
+        Bencode::encode_bencoded_value(value, buffer);
+        if (buffer.size() != input.size()) std::abort();
+    });
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20;
+
+    bench("torrent, 10000 files, 100000 pieces", make_torrent(10000, 100000),
+          iterations);
+    bench("file list, 100000 files", make_torrent(100000, 0), iterations);
+    bench("tracker response, 10000 peers", make_tracker_response(10000),
+          iterations);
+    return 0;
+}
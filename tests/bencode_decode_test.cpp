@@ -28,6 +28,23 @@ TEST_CASE("Decoding strings", "[bencode][decode]") {
     val = Bencode::decode_bencoded_value("0:", ec);
     CHECK_FALSE(ec);
     CHECK(val == json(""));
+
+    // length past the end of the input
+    ec = {};
+    val = Bencode::decode_bencoded_value("5:abc", ec);
+    CHECK(ec);
+
+    ec = {};
+    val = Bencode::decode_bencoded_value("99999999999999999999:a", ec);
+    CHECK(ec);
+
+    ec = {};
+    val = Bencode::decode_bencoded_value("l3:abe", ec);
+    CHECK(ec);
+
+    ec = {};
+    val = Bencode::decode_bencoded_value("3a:abc", ec);
+    CHECK(ec);
 }
 
 TEST_CASE("Decoding integers", "[bencode][decode]") {
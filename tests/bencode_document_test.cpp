@@ -0,0 +1,154 @@
+#include "bencode.hpp"
+#include "bencode_document.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace bittorrent;
+using json = nlohmann::json;
+
+static json to_json(bencode::Value const& value) {
+    switch (value.type()) {
+        case bencode::node_type::integer:
+            return json(value.integer());
+        case bencode::node_type::string:
+            return json(std::string(value.string()));
+        case bencode::node_type::list: {
+            json list = json::array();
+            for (bencode::Value v : value) list.push_back(to_json(v));
+            return list;
+        }
+        case bencode::node_type::dict: {
+            json dict = json::object();
+            for (auto it = value.begin(); it != value.end(); ++it) {
+                std::string key((*it).string());
+                ++it;
+                dict[key] = to_json(*it);
+            }
+            return dict;
+        }
+    }
+    return {};
+}
+
+// Decodes with both decoders and checks they agree
+static void check_same_as_json_decoder(std::string const& encoded) {
+    INFO(encoded);
+    std::error_code ec;
+    auto expected = Bencode::decode_bencoded_value(encoded, ec);
+    REQUIRE_FALSE(ec);
+    auto document = bencode::Document::parse(encoded, ec);
+    REQUIRE_FALSE(ec);
+    CHECK(to_json(document.root()) == expected);
+}
+
+TEST_CASE("Document decodes like the json decoder", "[bencode][document]") {
+    check_same_as_json_decoder("5:hello");
+    check_same_as_json_decoder("0:");
+    check_same_as_json_decoder("i3e");
+    check_same_as_json_decoder("i-52e");
+    check_same_as_json_decoder("i4294967300e");
+    check_same_as_json_decoder("i0e");
+    check_same_as_json_decoder("le");
+    check_same_as_json_decoder("l5:helloli52eee");
+    check_same_as_json_decoder("lli4eei5ee");
+    check_same_as_json_decoder("de");
+    check_same_as_json_decoder("d5:helloli42ei-5eee");
+    check_same_as_json_decoder(
+        "d9:publisher3:bob17:publisher-webpage15:www.example.com18:publisher."
+        "location4:homee");
+}
+
+TEST_CASE("Document strings are views into the source", "[bencode][document]") {
+    std::error_code ec;
+    std::string encoded = "d4:spaml1:a1:bee";
+    auto document = bencode::Document::parse(encoded, ec);
+    REQUIRE_FALSE(ec);
+
+    auto spam = document.root().find("spam");
+    REQUIRE(spam.has_value());
+    CHECK(spam->is_list());
+    CHECK(spam->size() == 2);
+    CHECK(spam->raw() == "l1:a1:be");
+    CHECK((*spam->begin()).string().data() == encoded.data() + 10);
+    CHECK_FALSE(document.root().find("eggs").has_value());
+}
+
+TEST_CASE("Document rejects invalid input", "[bencode][document]") {
+    std::error_code ec;
+    for (std::string encoded :
+         {"", "i-0e", "i03e", "ie", "i-e", "i42", "i42abce",
+          "i99999999999999999999e", "li523e", "lli42ei42ee", "d1:ae",
+          "di1ei2ee", "d5:helloli42i-5eee", "5:abc", "x", "3a:abc"}) {
+        INFO(encoded);
+        ec = {};
+        bencode::Document::parse(encoded, ec);
+        CHECK(ec);
+    }
+}
+
+TEST_CASE("Document dict lookup and dump", "[bencode][document]") {
+    std::error_code ec;
+    // keys not in sorted order, duplicated key
+    std::string encoded = "d5:helloi52e3:foo3:bar3:cow3:moo3:fooi1ee";
+    auto document = bencode::Document::parse(encoded, ec);
+    REQUIRE_FALSE(ec);
+
+    bencode::Value dict = document.root();
+    CHECK(dict.find_integer("hello") == 52);
+    CHECK(dict.find_string("cow") == "moo");
+    CHECK(dict.find_integer("foo") == 1);
+    CHECK_FALSE(dict.find_string("hello").has_value());
+    CHECK_FALSE(dict.find("zzz").has_value());
+    CHECK(dict.dump() == R"({"cow":"moo","foo":1,"hello":52})");
+
+    document = bencode::Document::parse("l3:a\"bi-3ed0:leee", ec);
+    REQUIRE_FALSE(ec);
+    CHECK(document.root().dump() == R"(["a\"b",-3,{"":[]}])");
+}
+
+TEST_CASE("SIMD structural index matches the scalar one",
+          "[bencode][document][simd]") {
+    std::string input;
+    uint32_t state = 1;
+    for (size_t i = 0; i < 1000; i++) {
+        state = state * 1103515245 + 12345;
+        input.push_back("ie:dl0123456789xyz"[(state >> 16) % 18]);
+    }
+
+    for (auto level : {bencode::simd_level::sse2, bencode::simd_level::avx2}) {
+        if (!bencode::is_supported(level)) continue;
+        // every length, to cover the scalar tails
+        for (size_t size = 0; size <= 200; size++) {
+            std::string_view part = std::string_view(input).substr(size, size);
+            bencode::StructuralIndex expected, got;
+            bencode::find_structurals(part, expected,
+                                      bencode::simd_level::scalar);
+            bencode::find_structurals(part, got, level);
+            CHECK(got.colons == expected.colons);
+            CHECK(got.ends == expected.ends);
+        }
+    }
+}
+
+TEST_CASE("Indexed decoder matches the scalar decoder",
+          "[bencode][document][simd]") {
+    for (std::string encoded : std::vector<std::string>{
+             "5:hello", "i-52e", "l5:helloli52eee", "d5:helloli42ei-5eee",
+             "d3:key40:ee:ee:ee:ee:ee:ee:ee:ee:ee:ee:ee:ee:ee:e3:zzzi1ee",
+             "", "i03e", "i42", "d1:ae", "5:abc", "12e3:", "i1:2e",
+             "l" + std::string(100, 'l')}) {
+        for (auto level : {bencode::simd_level::scalar,
+                           bencode::simd_level::sse2,
+                           bencode::simd_level::avx2}) {
+            INFO(encoded << " level " << static_cast<int>(level));
+            std::error_code expected_ec, ec;
+            auto expected = bencode::Document::parse(encoded, expected_ec);
+            auto got = bencode::Document::parse_indexed(encoded, ec, level);
+            CHECK(ec == expected_ec);
+            if (!ec && !expected_ec)
+                CHECK(got.root().dump() == expected.root().dump());
+        }
+    }
+}
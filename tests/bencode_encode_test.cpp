@@ -1,5 +1,7 @@
 #include "bencode.hpp"
 #include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
 #include <string>
 
@@ -30,4 +32,56 @@ TEST_CASE("Encoding random", "[bencode][encode]") {
     INFO(test.dump());
     auto val = Bencode::encode_bencoded_value(test);
     CHECK(val == "d1:11:a1:21:be");
-}
\ No newline at end of file
+}
+
+TEST_CASE("Encoding into a reused buffer", "[bencode][encode]") {
+    json test = {{"announce", "http://tracker/"},
+                 {"info", {{"length", -42}, {"name", "a"}}},
+                 {"list", {1, "two", json::array()}}};
+    std::string expected =
+        "d8:announce15:http://tracker/4:infod6:lengthi-42e4:name1:ae"
+        "4:listli1e3:twoleee";
+    CHECK(Bencode::encoded_size(test) == expected.size());
+    CHECK(Bencode::encode_bencoded_value(test) == expected);
+
+    std::string buffer = "prefix";
+    Bencode::encode_bencoded_value(test, buffer);
+    CHECK(buffer == "prefix" + expected);
+
+    buffer.clear();
+    Bencode::encode_bencoded_value(json(0), buffer);
+    CHECK(buffer == "i0e");
+}
+
+TEST_CASE("Encoding with the streaming writer", "[bencode][encode]") {
+    std::string out;
+    bencode::StringSink sink(out);
+    bencode::Writer writer(sink);
+    writer.begin_dict()
+        .string("a")
+        .integer(INT64_MIN)
+        .string("b")
+        .begin_list()
+        .string("")
+        .end()
+        .end();
+    CHECK(out == "d1:ai-9223372036854775808e1:bl0:ee");
+    CHECK(bencode::Writer::integer_size(INT64_MIN) == 22);
+    CHECK(bencode::Writer::string_size(std::string(100, 'x')) == 104);
+}
+
+TEST_CASE("Encoding into a file descriptor", "[bencode][encode]") {
+    std::FILE* file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    {
+        bencode::FdSink sink(fileno(file));
+        Bencode::encode_bencoded_value(json({"spam", std::string(70000, 'x')}),
+                                       sink);
+        CHECK_FALSE(sink.flush());
+    }
+    std::rewind(file);
+    std::string got(8, '\0');
+    CHECK(std::fread(got.data(), 1, got.size(), file) == got.size());
+    CHECK(got == "l4:spam7");
+    std::fclose(file);
+}
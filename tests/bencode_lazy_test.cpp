@@ -0,0 +1,97 @@
+#include "bencode_lazy.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <system_error>
+
+using namespace bittorrent;
+
+TEST_CASE("skip_value returns the end of a value", "[bencode][lazy]") {
+    std::error_code ec;
+    CHECK(bencode::skip_value("5:hello", 0, ec) == 7);
+    CHECK(bencode::skip_value("i-42e", 0, ec) == 5);
+    CHECK(bencode::skip_value("le", 0, ec) == 2);
+    CHECK(bencode::skip_value("l5:helloi1ee4:rest", 0, ec) == 12);
+    CHECK(bencode::skip_value("d1:ad1:bl1:eeee", 0, ec) == 15);
+    CHECK(bencode::skip_value("xx3:abc", 2, ec) == 7);
+    // string contents are not looked at
+    CHECK(bencode::skip_value("10:eeeeeeeeee", 0, ec) == 13);
+    CHECK_FALSE(ec);
+}
+
+TEST_CASE("skip_value rejects invalid values", "[bencode][lazy]") {
+    for (std::string input :
+         {"", "5:abc", "5hello", "i-0e", "i12", "iabce", "l5:hello",
+          "d1:ae", "di1ei2ee", "d1:a1:b", "x"}) {
+        INFO(input);
+        std::error_code ec;
+        bencode::skip_value(input, 0, ec);
+        CHECK(ec);
+    }
+}
+
+TEST_CASE("LazyDict finds values", "[bencode][lazy]") {
+    std::string input =
+        "d8:announce3:url4:infod5:filesld6:lengthi1eee4:name4:file"
+        "12:piece lengthi16384e6:pieces3:abce3:keyi7ee";
+    std::error_code ec;
+    auto dict = bencode::LazyDict::parse(input, ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(dict.has_value());
+    CHECK(dict->size() == 3);
+    CHECK(dict->raw() == input);
+    CHECK(dict->find_string("announce") == "url");
+    CHECK(dict->find_integer("key") == 7);
+    CHECK_FALSE(dict->find("missing").has_value());
+    // wrong type
+    CHECK_FALSE(dict->find_integer("announce").has_value());
+    CHECK_FALSE(dict->find_dict("key", ec).has_value());
+
+    auto info = dict->find_dict("info", ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(info.has_value());
+    CHECK(info->raw() ==
+          "d5:filesld6:lengthi1eee4:name4:file12:piece lengthi16384e"
+          "6:pieces3:abce");
+    CHECK(info->find_string("name") == "file");
+    CHECK(info->find_integer("piece length") == 16384);
+    CHECK(info->find_string("pieces") == "abc");
+    CHECK(info->find("files")->type() == bencode::node_type::list);
+    CHECK(info->find("files")->raw() == "ld6:lengthi1eee");
+}
+
+TEST_CASE("LazyDict handles unsorted and duplicated keys", "[bencode][lazy]") {
+    std::error_code ec;
+    auto dict = bencode::LazyDict::parse("d1:bi2e1:ai1e1:bi3ee", ec);
+    REQUIRE_FALSE(ec);
+    CHECK(dict->find_integer("a") == 1);
+    // the last one wins
+    CHECK(dict->find_integer("b") == 3);
+}
+
+TEST_CASE("LazyDict only parses accessed subtrees", "[bencode][lazy]") {
+    // the nested dict has an integer key, but it is well delimited
+    std::string input = "d1:ad1:xi1ei5ei6ee1:bi2ee";
+    std::error_code ec;
+    auto dict = bencode::LazyDict::parse(input, ec);
+    // invalid keys are still rejected while skipping
+    CHECK(ec);
+
+    ec.clear();
+    dict = bencode::LazyDict::parse("d1:ad1:x5:hello1:y1:ze1:bi2ee", ec);
+    REQUIRE_FALSE(ec);
+    CHECK(dict->find_integer("b") == 2);
+    auto nested = dict->find_dict("a", ec);
+    REQUIRE_FALSE(ec);
+    CHECK(nested->find_string("y") == "z");
+}
+
+TEST_CASE("LazyDict rejects invalid dicts", "[bencode][lazy]") {
+    for (std::string input :
+         {"", "le", "d", "d1:a", "d1:ae", "di1ei2ee", "d1:a5:abc"}) {
+        INFO(input);
+        std::error_code ec;
+        auto dict = bencode::LazyDict::parse(input, ec);
+        CHECK(ec);
+        CHECK_FALSE(dict.has_value());
+    }
+}
@@ -0,0 +1,150 @@
+#include "bencode.hpp"
+#include "bencode_parser.hpp"
+#include "tracker_info.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace bittorrent;
+using json = nlohmann::json;
+using namespace std::string_literals;
+
+// Builds a json value from the parser events
+class JsonHandler : public bencode::Handler {
+   public:
+    void begin_dict() override { push(json::object()); }
+    void begin_list() override { push(json::array()); }
+    void end() override { stack_.pop_back(); }
+    void key(std::string_view key) override { key_ = key; }
+    void string(std::string_view value) override { add(std::string(value)); }
+    void integer(int64_t value) override { add(value); }
+
+    json result;
+
+   private:
+    json* add(json value) {
+        if (stack_.empty()) {
+            result = std::move(value);
+            return &result;
+        }
+        json& top = *stack_.back();
+        if (top.is_array()) {
+            top.push_back(std::move(value));
+            return &top.back();
+        }
+        top[key_] = std::move(value);
+        return &top[key_];
+    }
+    void push(json value) { stack_.push_back(add(std::move(value))); }
+
+    std::vector<json*> stack_;
+    std::string key_;
+};
+
+// Parses `encoded` fed in chunks of `chunk_size` bytes
+static json parse(std::string const& encoded, size_t chunk_size,
+                  std::error_code& ec) {
+    JsonHandler handler;
+    bencode::StreamParser parser(handler);
+    for (size_t i = 0; i < encoded.size() && !ec; i += chunk_size)
+        parser.feed(std::string_view(encoded).substr(i, chunk_size), ec);
+    if (!ec) parser.finish(ec);
+    return handler.result;
+}
+
+TEST_CASE("Stream parser matches the json decoder", "[bencode][parser]") {
+    for (std::string encoded :
+         {"5:hello", "0:", "i3e", "i-52e", "i4294967300e", "le",
+          "l5:helloli52eee", "lli4eei5ee", "de", "d5:helloli42ei-5eee",
+          "d3:foo0:5:hellod3:bari1e6:pieces20:aaaaaaaaaaaaaaaaaaaaee"}) {
+        std::error_code ec;
+        auto expected = Bencode::decode_bencoded_value(encoded, ec);
+        REQUIRE_FALSE(ec);
+
+        for (size_t chunk_size : {1, 2, 3, 7, 1024}) {
+            INFO(encoded << " in chunks of " << chunk_size);
+            ec = {};
+            CHECK(parse(encoded, chunk_size, ec) == expected);
+            CHECK_FALSE(ec);
+        }
+    }
+}
+
+TEST_CASE("Stream parser rejects invalid input", "[bencode][parser]") {
+    for (std::string encoded :
+         {"", "i-0e", "i03e", "ie", "i42", "i42abce", "li523e", "lli42ei42ee",
+          "d1:ae", "di1ei2ee", "d5:helloli42i-5eee", "5:abc", "x", "3a:abc"}) {
+        for (size_t chunk_size : {1, 1024}) {
+            INFO(encoded << " in chunks of " << chunk_size);
+            std::error_code ec;
+            parse(encoded, chunk_size, ec);
+            CHECK(ec);
+        }
+    }
+}
+
+TEST_CASE("Stream parser limits string length", "[bencode][parser]") {
+    JsonHandler handler;
+    bencode::StreamParser parser(handler, 4);
+    std::error_code ec;
+    parser.feed("5:hello", ec);
+    CHECK(ec);
+}
+
+TEST_CASE("Stream parser stops after the top-level value", "[bencode][parser]") {
+    JsonHandler handler;
+    bencode::StreamParser parser(handler);
+    std::error_code ec;
+    parser.feed("li1eei2e", ec);
+    CHECK_FALSE(ec);
+    CHECK(parser.done());
+    CHECK(parser.offset() == 5);
+    CHECK(handler.result == json({1}));
+}
+
+TEST_CASE("Parsing tracker responses", "[tracker]") {
+    std::string peers = "\x7f\x00\x00\x01\x1a\xe1\xc0\xa8\x01\x02\x00\x50"s;
+    std::string response = "d8:intervali60e5:peers" +
+                            std::to_string(peers.size()) + ":" + peers + "e";
+    std::error_code ec;
+    auto tracker_info = TrackerInfo::parse_tracker_response(response, ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(tracker_info.has_value());
+    CHECK(tracker_info->interval == 60);
+    CHECK(tracker_info->peers ==
+          std::vector<std::string>{"127.0.0.1:6881", "192.168.1.2:80"});
+}
+
+TEST_CASE("Parsing tracker responses with a list of peers", "[tracker]") {
+    std::string response =
+        "d8:intervali1800e5:peersld2:ip9:127.0.0.17:peer id20:"
+        "000111222333444555664:porti6881eed2:ip11:example.org4:porti80e"
+        "5:otherleeee";
+    // a chunk at a time, as received
+    TrackerResponseHandler handler;
+    bencode::StreamParser parser(handler);
+    std::error_code ec;
+    for (size_t i = 0; i < response.size(); i += 7)
+        parser.feed(std::string_view(response).substr(i, 7), ec);
+    parser.finish(ec);
+    REQUIRE_FALSE(ec);
+    auto tracker_info = handler.result(ec);
+    REQUIRE_FALSE(ec);
+    CHECK(tracker_info->interval == 1800);
+    CHECK(tracker_info->peers ==
+          std::vector<std::string>{"127.0.0.1:6881", "example.org:80"});
+}
+
+TEST_CASE("Invalid tracker responses are rejected", "[tracker]") {
+    for (std::string response :
+         {"d8:intervali60ee", "le", "d5:peersi1ee", "d5:peersdee",
+          "d5:peersli1eee", "d5:peersld2:ip1:aeee",
+          "d5:peersld2:ip1:a4:porti65536eeee",
+          "d5:peersld2:ipi1e4:porti1eeee", "d8:interval1:a5:peers0:e"}) {
+        INFO(response);
+        std::error_code ec;
+        CHECK_FALSE(TrackerInfo::parse_tracker_response(response, ec));
+        CHECK(ec);
+    }
+}
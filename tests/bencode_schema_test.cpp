@@ -0,0 +1,130 @@
+#include "bencode_schema.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+struct File {
+    size_t length;
+    std::vector<std::string> path;
+};
+
+struct Info {
+    std::optional<std::vector<File>> files;
+    std::optional<int64_t> length;
+    std::string name;
+    uint32_t piece_length;
+};
+
+struct Metainfo {
+    std::string_view announce;
+    std::optional<std::string> comment;
+    Info info;
+    bencode::LazyValue raw_info;
+};
+
+template <>
+struct bencode::Schema<File> {
+    static constexpr auto fields =
+        std::tuple{bencode::field("length", &File::length),
+                   bencode::field("path", &File::path)};
+};
+
+template <>
+struct bencode::Schema<Info> {
+    static constexpr auto fields =
+        std::tuple{bencode::field("files", &Info::files),
+                   bencode::field("length", &Info::length),
+                   bencode::field("name", &Info::name),
+                   bencode::field("piece length", &Info::piece_length)};
+};
+
+template <>
+struct bencode::Schema<Metainfo> {
+    static constexpr auto fields =
+        std::tuple{bencode::field("announce", &Metainfo::announce),
+                   bencode::field("comment", &Metainfo::comment),
+                   bencode::field("info", &Metainfo::info)};
+};
+
+TEST_CASE("Decoding into bound structs", "[bencode][schema]") {
+    std::string input =
+        "d8:announce3:url7:privatei1e4:infod5:filesld6:lengthi5e4:pathl1:a"
+        "1:beed6:lengthi7e4:pathl1:ceee4:name4:data12:piece lengthi16384eee";
+    std::error_code ec;
+    auto metainfo = bencode::decode<Metainfo>(input, ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(metainfo.has_value());
+    CHECK(metainfo->announce == "url");
+    CHECK_FALSE(metainfo->comment.has_value());
+    CHECK(metainfo->info.name == "data");
+    CHECK(metainfo->info.piece_length == 16384);
+    CHECK_FALSE(metainfo->info.length.has_value());
+    REQUIRE(metainfo->info.files.has_value());
+    REQUIRE(metainfo->info.files->size() == 2);
+    CHECK((*metainfo->info.files)[0].length == 5);
+    CHECK((*metainfo->info.files)[0].path ==
+          std::vector<std::string>{"a", "b"});
+    CHECK((*metainfo->info.files)[1].path == std::vector<std::string>{"c"});
+}
+
+TEST_CASE("Decoding reports missing keys and type mismatches",
+          "[bencode][schema]") {
+    std::error_code ec;
+    auto metainfo =
+        bencode::decode<Metainfo>("d8:announce3:url4:infod4:name1:aee", ec);
+    CHECK(ec == error(errors::error_code_enum::bencode_schema_missing_key));
+    CHECK_FALSE(metainfo.has_value());
+
+    ec.clear();
+    metainfo = bencode::decode<Metainfo>(
+        "d8:announcei1e4:infod4:name1:a12:piece lengthi1eee", ec);
+    CHECK(ec == error(errors::error_code_enum::bencode_schema_type_mismatch));
+
+    // out of range for the member type
+    ec.clear();
+    metainfo = bencode::decode<Metainfo>(
+        "d8:announce1:a4:infod4:name1:a12:piece lengthi-1eee", ec);
+    CHECK(ec == error(errors::error_code_enum::bencode_schema_type_mismatch));
+
+    ec.clear();
+    metainfo = bencode::decode<Metainfo>(
+        "d8:announce1:a4:infod4:name1:a12:piece lengthi4294967296eee", ec);
+    CHECK(ec == error(errors::error_code_enum::bencode_schema_type_mismatch));
+
+    ec.clear();
+    metainfo = bencode::decode<Metainfo>("le", ec);
+    CHECK(ec);
+}
+
+TEST_CASE("Encoding bound structs", "[bencode][schema]") {
+    Info info{};
+    info.name = "data";
+    info.piece_length = 16384;
+    info.length = 12;
+    CHECK(bencode::encode(info) ==
+          "d6:lengthi12e4:name4:data12:piece lengthi16384ee");
+
+    info.length.reset();
+    info.files = std::vector<File>{{5, {"a", "b"}}};
+    CHECK(bencode::encode(info) ==
+          "d5:filesld6:lengthi5e4:pathl1:a1:beee4:name4:data"
+          "12:piece lengthi16384ee");
+}
+
+TEST_CASE("Encoding and decoding round-trip", "[bencode][schema]") {
+    std::string input =
+        "d8:announce3:url7:comment2:hi4:infod6:lengthi42e4:name4:data"
+        "12:piece lengthi32768eee";
+    std::error_code ec;
+    auto metainfo = bencode::decode<Metainfo>(input, ec);
+    REQUIRE_FALSE(ec);
+    CHECK(bencode::encode(*metainfo) == input);
+}
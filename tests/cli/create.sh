@@ -0,0 +1,49 @@
+echo "Testing ./bittorrent create -o <output_file> <path>"
+
+bittorrent=$1
+
+tmp=$(mktemp -d)
+
+# a file, and a directory whose pieces span several files
+mkdir -p "$tmp/data/sub"
+head -c 1000000 /dev/urandom > "$tmp/data/a.bin"
+head -c 70000 /dev/urandom > "$tmp/data/sub/b.bin"
+: > "$tmp/data/sub/empty"
+
+$bittorrent create -o "$tmp/file.torrent" --piece-length 65536 \
+    "$tmp/data/a.bin" > /dev/null &&
+    $bittorrent create -o "$tmp/dir.torrent" --piece-length 16384 -j 2 \
+        "$tmp/data" > /dev/null &&
+    $bittorrent verify "$tmp/file.torrent" "$tmp/data/a.bin" > "$tmp/file" &&
+    $bittorrent verify "$tmp/dir.torrent" "$tmp/data" > "$tmp/dir"
+
+if [ $? -ne 0 ]; then
+    echo "FAILED"
+    exit 1
+fi
+
+grep -q "^Pieces: 16/16 OK$" "$tmp/file" &&
+    grep -q "^Pieces: 66/66 OK$" "$tmp/dir" &&
+    $bittorrent info "$tmp/file.torrent" | grep -q "^Length: 1000000$"
+
+if [ $? -ne 0 ]; then
+    echo "FAILED"
+    exit 1
+fi
+
+# invalid options and inputs are reported, not aborted on
+mkdir "$tmp/nothing"
+for args in "--piece-length abc" "--piece-length 1000" "-j 2x"; do
+    $bittorrent create -o "$tmp/bad.torrent" $args "$tmp/data" \
+        > /dev/null 2> "$tmp/err"
+    status=$?
+    if [ $status -ne 1 ]; then
+        echo "FAILED: create $args exited with $status"
+        exit 1
+    fi
+done
+$bittorrent create -o "$tmp/bad.torrent" "$tmp/nothing" > /dev/null 2> "$tmp/err"
+if [ $? -ne 1 ] || ! grep -q "^Error creating torrent" "$tmp/err"; then
+    echo "FAILED"
+    exit 1
+fi
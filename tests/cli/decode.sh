@@ -0,0 +1,19 @@
+echo "Testing ./bittorrent decode <encoded_value>"
+dir=$(dirname $0)
+
+bittorrent=$1
+
+tmp=$(mktemp -d)
+
+$bittorrent decode "d3:foo3:bar5:helloli52e4:spamee" > "$tmp/got"
+
+cat <<EOF2 > $tmp/expected
+{"foo":"bar","hello":[52,"spam"]}
+EOF2
+
+diff -u $tmp/expected $tmp/got
+
+if [ $? -ne 0 ]; then
+    echo "FAILED"
+    exit 1
+fi
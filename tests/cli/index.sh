@@ -0,0 +1,29 @@
+echo "Testing ./bittorrent index <torrent files>"
+dir=$(dirname $0)
+
+bittorrent=$1
+
+sample="$dir/sample.torrent"
+
+tmp=$(mktemp -d)
+
+echo "$sample" | $bittorrent index -j 2 - > "$tmp/got"
+
+cat <<EOF2 > $tmp/expected
+path,info_hash,total_size,piece_length,piece_count,file_count,trackers
+$sample,d69f91e6b2ae4c542468d1073a71d4ea13879a7f,92063,32768,3,1,http://bittorrent-test-tracker.codecrafters.io/announce
+EOF2
+
+diff -u $tmp/expected $tmp/got
+
+if [ $? -ne 0 ]; then
+    echo "FAILED"
+    exit 1
+fi
+
+# without paths, the usage is printed and no index is written
+$bittorrent index -o "$tmp/empty.csv" 2> "$tmp/err"
+if [ $? -ne 1 ] || ! grep -q "^Usage:" "$tmp/err" || [ -e "$tmp/empty.csv" ]; then
+    echo "FAILED"
+    exit 1
+fi
@@ -0,0 +1,121 @@
+#include "create.hpp"
+#include "error.hpp"
+#include "test_helpers.hpp"
+#include "torrent.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+// Writes the metainfo of `report` and parses it back
+static std::unique_ptr<Torrent> reparse(TempDir const& dir,
+                                        CreateReport const& report) {
+    write_file(dir.path / "out.torrent", report.metainfo);
+    std::error_code ec;
+    auto torrent = Torrent::parse_torrent(dir.path / "out.torrent", ec);
+    REQUIRE_FALSE(ec);
+    return torrent;
+}
+
+TEST_CASE("Creating a single-file torrent", "[create]") {
+    TempDir dir("create_test");
+    size_t const piece_length = 16 * 1024;
+    std::string data = make_data(40 * piece_length + 123, 1);
+    write_file(dir.path / "data.bin", data);
+
+    // runs of several pieces, with more than a SIMD batch in some
+    for (size_t read_size : {size_t{1}, 3 * piece_length, 20 * piece_length}) {
+        INFO(read_size);
+        CreateOptions options;
+        options.piece_length = piece_length;
+        options.threads = 3;
+        options.read_size = read_size;
+        options.announce = "http://tracker/announce";
+        uint64_t last_progress = 0;
+        options.progress = [&](uint64_t hashed, uint64_t total) {
+            CHECK(hashed >= last_progress);
+            CHECK(total == data.size());
+            last_progress = hashed;
+        };
+
+        std::error_code ec;
+        auto report = create_torrent(dir.path / "data.bin", options, ec);
+        REQUIRE_FALSE(ec);
+        REQUIRE(report);
+        CHECK(last_progress == data.size());
+        CHECK(report->piece_count == 41);
+        CHECK(report->file_count == 1);
+        CHECK(report->total_size == data.size());
+
+        auto torrent = reparse(dir, *report);
+        CHECK(torrent->announce == "http://tracker/announce");
+        CHECK(torrent->name == "data.bin");
+        CHECK(torrent->length == data.size());
+        CHECK(torrent->files.empty());
+        CHECK(torrent->piece_length == piece_length);
+        CHECK(torrent->pieces == piece_hashes(data, piece_length));
+        CHECK(torrent->info_hash_raw() == report->info_hash);
+    }
+}
+
+TEST_CASE("Creating a multi-file torrent", "[create]") {
+    TempDir dir("create_test");
+    size_t const piece_length = 32 * 1024;
+    std::string a = make_data(50000, 2);
+    std::string b = make_data(100, 3);
+    std::string c = make_data(70000, 4);
+    write_file(dir.path / "content" / "b" / "c.bin", c);
+    write_file(dir.path / "content" / "a.bin", a);
+    write_file(dir.path / "content" / "b" / "b.bin", b);
+    write_file(dir.path / "content" / "empty", "");
+
+    CreateOptions options;
+    options.piece_length = piece_length;
+    std::error_code ec;
+    auto report = create_torrent(dir.path / "content" / "", options, ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(report);
+
+    // sorted by path, pieces spanning files
+    auto torrent = reparse(dir, *report);
+    CHECK(torrent->name == "content");
+    REQUIRE(torrent->files.size() == 4);
+    CHECK(torrent->files[0].path == "a.bin");
+    CHECK(torrent->files[1].path == std::filesystem::path("b") / "b.bin");
+    CHECK(torrent->files[2].path == std::filesystem::path("b") / "c.bin");
+    CHECK(torrent->files[3].path == "empty");
+    CHECK(torrent->files[3].length == 0);
+    CHECK(torrent->length == a.size() + b.size() + c.size());
+    CHECK(torrent->pieces == piece_hashes(a + b + c, piece_length));
+}
+
+TEST_CASE("Invalid torrent creation requests fail", "[create]") {
+    TempDir dir("create_test");
+    write_file(dir.path / "data.bin", make_data(100, 5));
+    std::error_code ec;
+
+    CreateOptions options;
+    options.piece_length = 3 * 16 * 1024;
+    CHECK_FALSE(create_torrent(dir.path / "data.bin", options, ec));
+    CHECK(ec == error(errors::error_code_enum::create_invalid_piece_length));
+
+    ec.clear();
+    std::filesystem::create_directories(dir.path / "empty");
+    CHECK_FALSE(create_torrent(dir.path / "empty", {}, ec));
+    CHECK(ec == error(errors::error_code_enum::create_no_files));
+
+    ec.clear();
+    CHECK_FALSE(create_torrent(dir.path / "missing", {}, ec));
+    CHECK(ec);
+}
+
+TEST_CASE("Default piece length grows with the data", "[create]") {
+    CHECK(default_piece_length(0) == 16 * 1024);
+    CHECK(default_piece_length(1 << 20) == 16 * 1024);
+    CHECK(default_piece_length(uint64_t{1} << 30) == 2 << 20);
+    CHECK(default_piece_length(uint64_t{1} << 40) == 16 << 20);
+}
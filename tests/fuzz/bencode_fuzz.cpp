@@ -0,0 +1,108 @@
+// libFuzzer target for the bencode decoders.
+// The json decoder, the Document (scalar and indexed), the stream parser and
+// the lazy skipping must agree on every input, and decoded values must round-trip through the
+// encoder.
+#include "bencode.hpp"
+#include "bencode_document.hpp"
+#include "bencode_lazy.hpp"
+#include "bencode_parser.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+
+using namespace bittorrent;
+using json = nlohmann::json;
+
+static json to_json(bencode::Value const& value) {
+    switch (value.type()) {
+        case bencode::node_type::integer:
+            return json(value.integer());
+        case bencode::node_type::string:
+            return json(std::string(value.string()));
+        case bencode::node_type::list: {
+            json list = json::array();
+            for (bencode::Value v : value) list.push_back(to_json(v));
+            return list;
+        }
+        case bencode::node_type::dict: {
+            json dict = json::object();
+            for (auto it = value.begin(); it != value.end(); ++it) {
+                std::string key((*it).string());
+                ++it;
+                dict[key] = to_json(*it);
+            }
+            return dict;
+        }
+    }
+    return {};
+}
+
+// Counts events, checks nesting
+class CheckingHandler : public bencode::Handler {
+   public:
+    void begin_dict() override { depth++; }
+    void begin_list() override { depth++; }
+    void end() override {
+        if (depth == 0) std::abort();
+        depth--;
+    }
+
+    size_t depth = 0;
+};
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size) {
+    std::string input(reinterpret_cast<char const*>(data), size);
+
+    std::error_code json_ec;
+    json value = Bencode::decode_bencoded_value(input, json_ec);
+
+    std::error_code document_ec;
+    auto document = bencode::Document::parse(input, document_ec);
+
+    std::error_code indexed_ec;
+    auto indexed = bencode::Document::parse_indexed(input, indexed_ec);
+    if (indexed_ec != document_ec) std::abort();
+    if (!document_ec && indexed.root().raw() != document.root().raw())
+        std::abort();
+
+    // skipping validates like decoding
+    std::error_code skip_ec;
+    size_t end = bencode::skip_value(input, 0, skip_ec);
+    if (static_cast<bool>(document_ec) != static_cast<bool>(skip_ec) ||
+        (!document_ec && end != document.root().raw().size()))
+        std::abort();
+    if (!document_ec && input[0] == 'd') {
+        std::error_code lazy_ec;
+        auto dict = bencode::LazyDict::parse(input, lazy_ec);
+        if (lazy_ec || dict->raw() != document.root().raw()) std::abort();
+    }
+
+    // split the input in two chunks
+    std::error_code stream_ec;
+    CheckingHandler handler;
+    bencode::StreamParser parser(handler);
+    parser.feed(std::string_view(input).substr(0, size / 2), stream_ec);
+    if (!stream_ec) parser.feed(std::string_view(input).substr(size / 2),
+                                stream_ec);
+    if (!stream_ec) parser.finish(stream_ec);
+
+    if (static_cast<bool>(json_ec) != static_cast<bool>(document_ec) ||
+        static_cast<bool>(json_ec) != static_cast<bool>(stream_ec))
+        std::abort();
+    if (json_ec) return 0;
+
+    if (to_json(document.root()) != value) std::abort();
+    if (handler.depth != 0) std::abort();
+    if (parser.offset() != document.root().raw().size()) std::abort();
+
+    // Re-encoding only gives back the input when dict keys are sorted and
+    // unique, as the spec requires
+    std::string encoded = Bencode::encode_bencoded_value(value);
+    if (encoded.size() != Bencode::encoded_size(value)) std::abort();
+    std::error_code ec;
+    if (Bencode::decode_bencoded_value(encoded, ec) != value || ec)
+        std::abort();
+
+    return 0;
+}
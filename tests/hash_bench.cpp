@@ -0,0 +1,161 @@
+// Piece hashing benchmark: every SHA1 kernel, piece sizes from 16 KiB to
+// 16 MiB, on 1 and N threads. Prints one CSV line per run:
+//   kernel,piece_size,threads,bytes,seconds,gb_per_s,cycles_per_byte
+// cycles_per_byte is the TSC cycles (nominal frequency) spent by each busy
+// core per byte, it is empty where there is no TSC.
+// Each thread hashes 16 disjoint pieces of its own buffer per call, 16 times
+// the piece size (256 MiB per thread at 16 MiB), so that large pieces are
+// read from memory rather than from cache. A run is at least one call.
+// Usage: hash_bench [-j threads] [-m megabytes per thread and run]
+#include "lib/sha1.hpp"
+#include "lib/utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_TSC 1
+#endif
+
+// Hashes `count` pieces of `size` bytes starting at `pieces[0..count)`
+using Kernel =
+    std::function<void(uint8_t const* const* pieces, size_t count, size_t size,
+                       bittorrent::Sha1Digest* digests)>;
+
+struct KernelInfo {
+    std::string name;
+    Kernel hash;
+};
+
+static std::vector<KernelInfo> kernels() {
+    std::vector<KernelInfo> result;
+    result.push_back({"utils::sha1_hash", [](uint8_t const* const* pieces,
+                                             size_t count, size_t size,
+                                             bittorrent::Sha1Digest* digests) {
+                          for (size_t i = 0; i < count; i++) {
+                              auto digest =
+                                  bittorrent::utils::sha1_hash(pieces[i], size);
+                              std::copy(digest.begin(), digest.end(),
+                                        digests[i].begin());
+                          }
+                      }});
+
+    for (auto [name, implementation] :
+         {std::pair{"portable", sha1::Implementation::portable},
+          std::pair{"shani", sha1::Implementation::shani},
+          std::pair{"armv8", sha1::Implementation::armv8}}) {
+        if (!sha1::isSupported(implementation)) continue;
+        result.push_back(
+            {name, [implementation](uint8_t const* const* pieces, size_t count,
+                                    size_t size,
+                                    bittorrent::Sha1Digest* digests) {
+                 for (size_t i = 0; i < count; i++)
+                     sha1::SHA1(implementation)
+                         .processBytes(pieces[i], size)
+                         .getDigestBytes(digests[i].data());
+             }});
+    }
+
+    for (auto [name, implementation] :
+         {std::pair{"batch_avx2", sha1::BatchImplementation::avx2},
+          std::pair{"batch_avx512", sha1::BatchImplementation::avx512}}) {
+        if (!sha1::isSupported(implementation)) continue;
+        result.push_back(
+            {name, [implementation](uint8_t const* const* pieces, size_t count,
+                                    size_t size,
+                                    bittorrent::Sha1Digest* digests) {
+                 sha1::hashBatch(pieces, count, size,
+                                 reinterpret_cast<uint8_t(*)[20]>(digests),
+                                 implementation);
+             }});
+    }
+    return result;
+}
+
+static uint64_t cycles() {
+#ifdef HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+int main(int argc, char* argv[]) {
+    unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+    unsigned threads = cores;
+    size_t megabytes = 256;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "-j")
+            threads = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "-m")
+            megabytes = std::max(1, std::atoi(argv[i + 1]));
+    }
+
+    // pieces hashed per call, as many as the widest batch kernel
+    size_t const batch = sha1::MAX_BATCH;
+
+    std::printf(
+        "kernel,piece_size,threads,bytes,seconds,gb_per_s,cycles_per_byte\n");
+    for (size_t size = 16 * 1024; size <= 16 * 1024 * 1024; size *= 4) {
+        // pieces[t] are the pieces of thread t, back to back in buffers[t]
+        std::vector<std::vector<uint8_t>> buffers(threads);
+        std::vector<std::vector<uint8_t const*>> pieces(threads);
+        for (unsigned t = 0; t < threads; t++) {
+            buffers[t].resize(batch * size);
+            for (size_t i = 0; i < buffers[t].size(); i++)
+                buffers[t][i] = static_cast<uint8_t>(i * 7 + (i >> 13) + t);
+            for (size_t i = 0; i < batch; i++)
+                pieces[t].push_back(buffers[t].data() + i * size);
+        }
+
+        size_t calls = std::max<size_t>(
+            1, megabytes * (size_t{1} << 20) / (size * batch));
+
+        for (KernelInfo const& kernel : kernels()) {
+            for (unsigned n : {1u, threads}) {
+                auto work = [&](unsigned t) {
+                    std::vector<bittorrent::Sha1Digest> digests(batch);
+                    for (size_t i = 0; i < calls; i++)
+                        kernel.hash(pieces[t].data(), batch, size,
+                                    digests.data());
+                };
+                work(0);  // warm up
+
+                uint64_t start_cycles = cycles();
+                auto start = std::chrono::steady_clock::now();
+                std::vector<std::thread> workers;
+                for (unsigned t = 1; t < n; t++) workers.emplace_back(work, t);
+                work(0);
+                for (std::thread& worker : workers) worker.join();
+                std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - start;
+                uint64_t elapsed_cycles = cycles() - start_cycles;
+
+                double bytes = static_cast<double>(size) * batch * calls * n;
+                std::string cycles_per_byte;
+#ifdef HAS_TSC
+                cycles_per_byte =
+                    std::to_string(elapsed_cycles * std::min(n, cores) / bytes);
+#else
+                (void)elapsed_cycles;
+#endif
+                std::printf("%s,%zu,%u,%.0f,%.6f,%.3f,%s\n",
+                            kernel.name.c_str(), size, n, bytes,
+                            elapsed.count(), bytes / elapsed.count() / 1e9,
+                            cycles_per_byte.c_str());
+                std::fflush(stdout);
+                // 1 and N are the same run
+                if (threads == 1) break;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "merkle.hpp"
+#include "test_helpers.hpp"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+TEST_CASE("Pieces root of small files", "[merkle]") {
+    constexpr size_t B = merkle::BLOCK_SIZE;
+    auto data = make_data(3 * B);
+    Sha256Digest const zero{};
+
+    CHECK(merkle::file_root(bytes(data), 0) == zero);
+    // a single block, possibly short, is its own root
+    CHECK(merkle::file_root(bytes(data), 100) ==
+          merkle::hash_leaf(bytes(data), 100));
+    CHECK(merkle::file_root(bytes(data), B) ==
+          merkle::hash_leaf(bytes(data), B));
+
+    auto a = merkle::hash_leaf(bytes(data), B);
+    auto b = merkle::hash_leaf(bytes(data) + B, B);
+    auto c = merkle::hash_leaf(bytes(data) + 2 * B, 10);
+    CHECK(merkle::file_root(bytes(data), 2 * B) == merkle::hash_parent(a, b));
+    // padded to 4 leaves with zero hashes
+    CHECK(merkle::file_root(bytes(data), 2 * B + 10) ==
+          merkle::hash_parent(merkle::hash_parent(a, b),
+                              merkle::hash_parent(c, zero)));
+}
+
+TEST_CASE("Pieces root from the piece layer", "[merkle]") {
+    constexpr size_t B = merkle::BLOCK_SIZE;
+    size_t const piece_length = 4 * B;
+    auto data = make_data(19 * B + 7);
+
+    CHECK(merkle::piece_layer(bytes(data), piece_length, piece_length)
+              .empty());
+
+    for (size_t size : {piece_length + 1, 2 * piece_length, 3 * B * 4 + 5,
+                        19 * B, 19 * B + 7}) {
+        INFO(size);
+        auto layer = merkle::piece_layer(bytes(data), size, piece_length);
+        CHECK(layer.size() == (size + piece_length - 1) / piece_length);
+        CHECK(merkle::root_from_piece_layer(layer, piece_length) ==
+              merkle::file_root(bytes(data), size));
+    }
+}
+
+TEST_CASE("Proofs of leaves", "[merkle]") {
+    constexpr size_t B = merkle::BLOCK_SIZE;
+    auto data = make_data(3 * B);
+    auto leaves = merkle::leaves(bytes(data), data.size());
+    auto root = merkle::file_root(bytes(data), data.size());
+    Sha256Digest const zero{};
+
+    std::vector<Sha256Digest> proof{leaves[1],
+                                    merkle::hash_parent(leaves[2], zero)};
+    CHECK(merkle::verify_proof(leaves[0], 0, proof, root));
+    CHECK_FALSE(merkle::verify_proof(leaves[1], 0, proof, root));
+    CHECK_FALSE(merkle::verify_proof(leaves[0], 1, proof, root));
+    CHECK_FALSE(merkle::verify_proof(leaves[0], 4, proof, root));
+}
+
+TEST_CASE("Blocks are checked as they arrive once leaves are known",
+          "[merkle]") {
+    constexpr size_t B = merkle::BLOCK_SIZE;
+    size_t const piece_length = 4 * B;
+    auto data = make_data(3 * B + 100);
+    auto leaves = merkle::leaves(bytes(data), data.size());
+    // last piece of a larger file, padded to the piece width
+    auto piece_hash = merkle::root(leaves, 4, Sha256Digest{});
+    using Status = BlockVerifier::Status;
+
+    SECTION("Trusted leaves") {
+        BlockVerifier verifier(piece_hash, data.size(), piece_length / B);
+        CHECK(verifier.block_count() == 4);
+        auto wrong = leaves;
+        wrong[0][0] ^= 1;
+        CHECK_FALSE(verifier.set_leaves(wrong));
+        REQUIRE(verifier.set_leaves(leaves));
+
+        auto corrupt = data;
+        corrupt[B + 5] ^= 1;
+        CHECK(verifier.add_block(1, bytes(corrupt) + B, B) == Status::bad);
+        CHECK(verifier.add_block(0, bytes(data), B) == Status::ok);
+        CHECK(verifier.add_block(1, bytes(data) + B, B) == Status::ok);
+        CHECK(verifier.add_block(3, bytes(data) + 3 * B, B) == Status::bad);
+        CHECK_FALSE(verifier.passed().has_value());
+        CHECK(verifier.add_block(3, bytes(data) + 3 * B, 100) == Status::ok);
+        CHECK(verifier.add_block(2, bytes(data) + 2 * B, B) == Status::ok);
+        CHECK(verifier.passed() == true);
+    }
+
+    SECTION("Unknown leaves") {
+        BlockVerifier verifier(piece_hash, data.size(), piece_length / B);
+        for (size_t i = 0; i < 4; i++)
+            CHECK(verifier.add_block(i, bytes(data) + i * B,
+                                     std::min(B, data.size() - i * B)) ==
+                  Status::pending);
+        CHECK(verifier.passed() == true);
+
+        BlockVerifier corrupted(piece_hash, data.size(), piece_length / B);
+        auto corrupt = data;
+        corrupt[2 * B] ^= 1;
+        for (size_t i = 0; i < 4; i++)
+            corrupted.add_block(i, bytes(corrupt) + i * B,
+                                std::min(B, data.size() - i * B));
+        CHECK(corrupted.passed() == false);
+    }
+
+    SECTION("Leaves received after some blocks") {
+        BlockVerifier verifier(piece_hash, data.size(), piece_length / B);
+        auto corrupt = data;
+        corrupt[0] ^= 1;
+        verifier.add_block(0, bytes(corrupt), B);
+        verifier.add_block(1, bytes(data) + B, B);
+        REQUIRE(verifier.set_leaves(leaves));
+        // the corrupt block is dropped, and needed again
+        CHECK(verifier.add_block(2, bytes(data) + 2 * B, B) == Status::ok);
+        CHECK(verifier.add_block(3, bytes(data) + 3 * B, 100) == Status::ok);
+        CHECK_FALSE(verifier.complete());
+        CHECK(verifier.add_block(0, bytes(data), B) == Status::ok);
+        CHECK(verifier.passed() == true);
+    }
+}
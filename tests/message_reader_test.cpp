@@ -0,0 +1,168 @@
+#include "error.hpp"
+#include "message.hpp"
+#include "message_reader.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+// Connected stream sockets, closed at the end of the test case
+struct SocketPair {
+    SocketPair() { REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0); }
+    ~SocketPair() {
+        for (int fd : fds)
+            if (fd >= 0) close(fd);
+    }
+    void send(std::vector<uint8_t> const& data) {
+        REQUIRE(::send(fds[1], data.data(), data.size(), 0) ==
+                static_cast<ssize_t>(data.size()));
+    }
+    int fds[2];
+};
+
+static std::vector<uint8_t> piece_message(uint32_t index, uint32_t begin,
+                                          size_t size) {
+    std::vector<uint8_t> payload(8 + size);
+    for (size_t i = 0; i < 4; i++) {
+        payload[i] = static_cast<uint8_t>(index >> (24 - i * 8));
+        payload[4 + i] = static_cast<uint8_t>(begin >> (24 - i * 8));
+    }
+    for (size_t i = 0; i < size; i++)
+        payload[8 + i] = static_cast<uint8_t>(i * 7 + index);
+    return Message(message_type::piece, std::move(payload)).serialize();
+}
+
+TEST_CASE("Messages received together are framed after one recv",
+          "[message_reader]") {
+    SocketPair sockets;
+    std::vector<uint8_t> data = Message(message_type::unchoke).serialize();
+    // keep-alive
+    data.insert(data.end(), {0, 0, 0, 0});
+    auto piece = piece_message(3, 16384, 16384);
+    data.insert(data.end(), piece.begin(), piece.end());
+    auto request = Message::make_request(1, 2, 3).serialize();
+    data.insert(data.end(), request.begin(), request.end());
+    sockets.send(data);
+
+    MessageReader reader;
+    std::error_code ec;
+    auto message = reader.read(sockets.fds[0], ec);
+    REQUIRE(message);
+    CHECK(message->type() == message_type::unchoke);
+    CHECK(message->payload.empty());
+
+    message = reader.read(sockets.fds[0], ec);
+    REQUIRE(message);
+    CHECK(message->keep_alive());
+
+    message = reader.read(sockets.fds[0], ec);
+    REQUIRE(message);
+    CHECK(message->type() == message_type::piece);
+    CHECK(std::equal(message->payload.begin(), message->payload.end(),
+                     piece.begin() + 5, piece.end()));
+
+    message = reader.read(sockets.fds[0], ec);
+    REQUIRE(message);
+    CHECK(message->type() == message_type::request);
+    CHECK(message->payload.size() == 12);
+
+    CHECK_FALSE(ec);
+    CHECK(reader.recv_calls() == 1);
+    CHECK(reader.buffered() == 0);
+    CHECK_FALSE(reader.next(ec));
+}
+
+TEST_CASE("Messages split across recvs are reassembled", "[message_reader]") {
+    SocketPair sockets;
+    auto piece = piece_message(1, 0, 1000);
+
+    // a small buffer, compacted between messages
+    MessageReader reader(64);
+    std::error_code ec;
+    for (int round = 0; round < 3; round++) {
+        for (size_t i = 0; i < piece.size(); i += 7) {
+            size_t end = std::min(piece.size(), i + 7);
+            sockets.send({piece.begin() + i, piece.begin() + end});
+            if (end < piece.size()) {
+                CHECK(reader.fill(sockets.fds[0]) == std::error_code{});
+                CHECK_FALSE(reader.next(ec));
+            }
+        }
+        auto message = reader.read(sockets.fds[0], ec);
+        REQUIRE(message);
+        CHECK(message->payload.size() == 1008);
+        CHECK(std::equal(message->payload.begin(), message->payload.end(),
+                         piece.begin() + 5, piece.end()));
+    }
+}
+
+TEST_CASE("Invalid lengths and closed connections are errors",
+          "[message_reader]") {
+    SocketPair sockets;
+    MessageReader reader;
+    std::error_code ec;
+
+    SECTION("Too large") {
+        sockets.send({0x10, 0, 0, 0, 7});
+        CHECK_FALSE(reader.read(sockets.fds[0], ec));
+        CHECK(ec == error(errors::error_code_enum::message_too_large));
+    }
+
+    SECTION("Closed in the middle of a message") {
+        sockets.send({0, 0, 0, 5, 4, 0});
+        close(sockets.fds[1]);
+        sockets.fds[1] = -1;
+        CHECK_FALSE(reader.read(sockets.fds[0], ec));
+        CHECK(ec == error(errors::error_code_enum::peer_disconnected));
+    }
+}
+
+TEST_CASE("Blocks of piece messages go straight to their destination",
+          "[message_reader]") {
+    SocketPair sockets;
+    auto piece = piece_message(2, 32768, 16384);
+    auto have = Message(message_type::have, {0, 0, 0, 9}).serialize();
+    std::vector<uint8_t> block(16384);
+
+    // the header and the start of the block arrive first
+    sockets.send(have);
+    sockets.send({piece.begin(), piece.begin() + 13 + 100});
+
+    MessageReader reader;
+    std::error_code ec;
+    auto message = reader.read_until_block(sockets.fds[0], ec);
+    REQUIRE(message);
+    CHECK(message->type() == message_type::have);
+
+    message = reader.read_until_block(sockets.fds[0], ec);
+    REQUIRE(message);
+    CHECK(message->type() == message_type::piece);
+    REQUIRE(message->payload.size() == 8);
+    CHECK(std::equal(message->payload.begin(), message->payload.end(),
+                     piece.begin() + 5));
+    CHECK(reader.pending_block() == 16384);
+
+    sockets.send({piece.begin() + 13 + 100, piece.end()});
+    REQUIRE(reader.read_block(sockets.fds[0], block.data()) ==
+            std::error_code{});
+    CHECK(std::equal(block.begin(), block.end(), piece.begin() + 13));
+    CHECK(reader.pending_block() == 0);
+    CHECK(reader.block_bytes_copied() == 100);
+    CHECK(reader.block_bytes_direct() == 16384 - 100);
+
+    // a block can be dropped, the next message follows
+    sockets.send(piece);
+    sockets.send(have);
+    message = reader.read_until_block(sockets.fds[0], ec);
+    REQUIRE(message);
+    REQUIRE(reader.skip_block(sockets.fds[0]) == std::error_code{});
+    message = reader.read_until_block(sockets.fds[0], ec);
+    REQUIRE(message);
+    CHECK(message->type() == message_type::have);
+    CHECK_FALSE(ec);
+}
@@ -0,0 +1,158 @@
+#include "error.hpp"
+#include "message.hpp"
+#include "message_reader.hpp"
+#include "message_writer.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+// Connected stream sockets, closed at the end of the test case
+struct SocketPair {
+    SocketPair() { REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0); }
+    ~SocketPair() {
+        for (int fd : fds)
+            if (fd >= 0) close(fd);
+    }
+    int fds[2];
+};
+
+struct Received {
+    bool keep_alive;
+    message_type type;
+    std::vector<uint8_t> payload;
+};
+
+// Messages received on `fd` until the other end is closed
+static std::vector<Received> receive_all(int fd) {
+    MessageReader reader;
+    std::vector<Received> messages;
+    std::error_code ec;
+    while (auto view = reader.read(fd, ec))
+        messages.push_back({view->keep_alive(), view->type(),
+                            {view->payload.begin(), view->payload.end()}});
+    CHECK(ec == error(errors::error_code_enum::peer_disconnected));
+    return messages;
+}
+
+TEST_CASE("Queued messages are sent with one call", "[message_writer]") {
+    SocketPair sockets;
+    MessageWriter writer;
+    writer.queue(Message::INTERESTED);
+    for (uint32_t i = 0; i < 40; i++)
+        writer.queue(Message::make_request(i / 4, i % 4 * 16384, 16384));
+    writer.queue(Message(message_type::have, {0, 0, 0, 7}));
+    // a large payload is sent from the message
+    writer.queue(Message(message_type::bitfield,
+                         std::vector<uint8_t>(MessageWriter::INLINE_PAYLOAD,
+                                              0xF0)));
+    writer.queue(Message(message_type::have, {0, 0, 0, 8}));
+    CHECK(writer.pending() == 44);
+
+    REQUIRE(writer.flush(sockets.fds[1]) == std::error_code{});
+    CHECK(writer.send_calls() == 1);
+    CHECK(writer.messages_sent() == 44);
+    CHECK(writer.pending() == 0);
+    close(sockets.fds[1]);
+    sockets.fds[1] = -1;
+
+    auto messages = receive_all(sockets.fds[0]);
+    REQUIRE(messages.size() == 44);
+    CHECK(messages[0].type == message_type::interested);
+    for (uint32_t i = 0; i < 40; i++) {
+        INFO(i);
+        auto request =
+            Message::make_request(i / 4, i % 4 * 16384, 16384).payload;
+        CHECK(messages[1 + i].type == message_type::request);
+        CHECK(messages[1 + i].payload == request);
+    }
+    CHECK(messages[42].type == message_type::bitfield);
+    CHECK(messages[42].payload.size() == MessageWriter::INLINE_PAYLOAD);
+    CHECK(messages[43].payload == std::vector<uint8_t>{0, 0, 0, 8});
+}
+
+TEST_CASE("Redundant messages are dropped before they are sent",
+          "[message_writer]") {
+    SocketPair sockets;
+    MessageWriter writer;
+
+    writer.keep_alive();
+    writer.queue(Message(message_type::interested));
+    writer.queue(Message(message_type::not_interested));
+    writer.queue(Message(message_type::interested));
+    writer.queue(Message::make_request(1, 0, 16384));
+    writer.queue(Message::make_request(1, 0, 16384));
+    writer.queue(Message::make_request(1, 16384, 16384));
+    writer.queue(Message(message_type::have, {0, 0, 0, 3}));
+    writer.queue(Message(message_type::have, {0, 0, 0, 3}));
+    // cancels a queued request, both are dropped
+    writer.queue(Message(message_type::cancel,
+                         std::move(Message::make_request(1, 0, 16384).payload)));
+    // no such request queued, sent as is
+    writer.queue(Message(message_type::cancel,
+                         std::move(Message::make_request(9, 0, 1).payload)));
+    writer.keep_alive();
+
+    REQUIRE(writer.flush(sockets.fds[1]) == std::error_code{});
+    close(sockets.fds[1]);
+    sockets.fds[1] = -1;
+
+    auto messages = receive_all(sockets.fds[0]);
+    REQUIRE(messages.size() == 4);
+    CHECK(messages[0].type == message_type::interested);
+    CHECK(messages[1].payload == Message::make_request(1, 16384, 16384).payload);
+    CHECK(messages[2].type == message_type::have);
+    CHECK(messages[3].type == message_type::cancel);
+    CHECK(writer.messages_sent() == 4);
+    CHECK(writer.messages_dropped() == 8);
+}
+
+TEST_CASE("A lone keep-alive is sent", "[message_writer]") {
+    SocketPair sockets;
+    MessageWriter writer;
+    writer.keep_alive();
+    writer.keep_alive();
+    REQUIRE(writer.flush(sockets.fds[1]) == std::error_code{});
+    close(sockets.fds[1]);
+    sockets.fds[1] = -1;
+
+    auto messages = receive_all(sockets.fds[0]);
+    REQUIRE(messages.size() == 1);
+    CHECK(messages[0].keep_alive);
+}
+
+TEST_CASE("Corked messages wait for the last uncork", "[message_writer]") {
+    SocketPair sockets;
+    MessageWriter writer;
+    writer.cork();
+    writer.cork();
+    writer.queue(Message::make_request(0, 0, 16384));
+    REQUIRE(writer.flush(sockets.fds[1]) == std::error_code{});
+    writer.queue(Message::make_request(0, 16384, 16384));
+    REQUIRE(writer.uncork(sockets.fds[1]) == std::error_code{});
+    CHECK(writer.send_calls() == 0);
+    CHECK(writer.pending() == 2);
+
+    REQUIRE(writer.uncork(sockets.fds[1]) == std::error_code{});
+    CHECK_FALSE(writer.corked());
+    CHECK(writer.send_calls() == 1);
+    CHECK(writer.pending() == 0);
+    close(sockets.fds[1]);
+    sockets.fds[1] = -1;
+    CHECK(receive_all(sockets.fds[0]).size() == 2);
+}
+
+TEST_CASE("Sending on a closed connection is an error", "[message_writer]") {
+    SocketPair sockets;
+    close(sockets.fds[0]);
+    sockets.fds[0] = -1;
+    MessageWriter writer;
+    writer.queue(Message::INTERESTED);
+    CHECK(writer.flush(sockets.fds[1]) ==
+          error(errors::error_code_enum::peer_send));
+    CHECK(writer.pending() == 0);
+}
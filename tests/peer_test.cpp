@@ -0,0 +1,442 @@
+#include "error.hpp"
+#include "merkle.hpp"
+#include "message.hpp"
+#include "message_reader.hpp"
+#include "peer.hpp"
+#include "test_helpers.hpp"
+#include "torrent.hpp"
+#include <arpa/inet.h>
+#include <bit>
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <filesystem>
+#include <netinet/in.h>
+#include <optional>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+constexpr size_t PIECE_LENGTH = 4 * 16384;
+
+static std::unique_ptr<Torrent> parse(std::string const& metainfo) {
+    auto path = temp_path("peer_test.torrent");
+    write_file(path, metainfo);
+    std::error_code ec;
+    auto torrent = Torrent::parse_torrent(path, ec);
+    std::filesystem::remove(path);
+    REQUIRE_FALSE(ec);
+    return torrent;
+}
+
+static std::unique_ptr<Torrent> make_torrent(std::string const& data) {
+    return parse("d8:announce3:abc4:infod6:lengthi" +
+                 std::to_string(data.size()) +
+                 "e4:name4:data12:piece lengthi" +
+                 std::to_string(PIECE_LENGTH) + "e6:pieces" +
+                 bencode_string(piece_hashes(data, PIECE_LENGTH)) + "ee");
+}
+
+// v2-only torrent of a single file, with its piece layer if `piece_layers`
+static std::unique_ptr<Torrent> make_v2_torrent(std::string const& data,
+                                                bool piece_layers) {
+    std::string metainfo = "d8:announce3:abc4:infod9:file treed" +
+                           v2_file_entry("data", data) +
+                           "e12:meta versioni2e4:name4:data12:piece lengthi" +
+                           std::to_string(PIECE_LENGTH) + "ee";
+    if (piece_layers)
+        metainfo += "12:piece layers" + v2_piece_layers({data}, PIECE_LENGTH);
+    return parse(metainfo + "e");
+}
+
+struct SeederOptions {
+    // flips a byte of every block sent
+    bool corrupt = false;
+    // flips a byte of the block (index, begin) only
+    std::optional<std::pair<uint32_t, uint32_t>> corrupt_block = std::nullopt;
+    // the request after that many is dropped, and the peer choked and
+    // unchoked
+    size_t choke_after = 0;
+    // sends the first block once more before it, one byte further in the
+    // piece
+    bool misplace_first = false;
+    // answers hash requests with a hash reject
+    bool reject_hashes = false;
+};
+
+// Seeds `data` to one connection on a loopback port: handshake, bitfield,
+// unchoke once interested, then a piece message for each request, and the
+// hashes of the merkle tree of `data` (a single-file v2 torrent) for each
+// hash request
+class FakeSeeder {
+   public:
+    explicit FakeSeeder(std::string data, SeederOptions options = {})
+        : data_(std::move(data)), options_(options) {
+        // the layers of the tree, from the leaves padded to a power of two
+        auto leaves = merkle::leaves(bytes(data_), data_.size());
+        leaves.resize(merkle::tree_width(leaves.size()));
+        tree_.push_back(std::move(leaves));
+        while (tree_.back().size() > 1) {
+            std::vector<Sha256Digest> parents;
+            for (size_t i = 0; i < tree_.back().size(); i += 2)
+                parents.push_back(merkle::hash_parent(tree_.back()[i],
+                                                      tree_.back()[i + 1]));
+            tree_.push_back(std::move(parents));
+        }
+
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t size = sizeof(address);
+        REQUIRE(bind(listener_, reinterpret_cast<sockaddr*>(&address),
+                     size) == 0);
+        REQUIRE(listen(listener_, 1) == 0);
+        REQUIRE(getsockname(listener_, reinterpret_cast<sockaddr*>(&address),
+                            &size) == 0);
+        port = ntohs(address.sin_port);
+        thread_ = std::thread([this] { serve(); });
+    }
+    ~FakeSeeder() {
+        finish();
+        close(listener_);
+    }
+
+    // Waits for the connection to be closed
+    void finish() {
+        shutdown(listener_, SHUT_RDWR);
+        if (thread_.joinable()) thread_.join();
+    }
+
+    uint16_t port;
+    // requests received, in order, once finished
+    std::vector<std::pair<uint32_t, uint32_t>> requests;
+    std::vector<HashRequest> hash_requests;
+
+   private:
+    void serve() {
+        int fd = accept(listener_, nullptr, nullptr);
+        if (fd < 0) return;
+        uint8_t handshake[68];
+        if (recv(fd, handshake, sizeof(handshake), MSG_WAITALL) != 68) {
+            close(fd);
+            return;
+        }
+        send_all(fd, {handshake, handshake + sizeof(handshake)});
+        send_all(fd, Message(message_type::bitfield, {0xFF}).serialize());
+
+        MessageReader reader;
+        std::error_code ec;
+        while (auto message = reader.read(fd, ec)) {
+            if (message->type() == message_type::interested)
+                send_all(fd, Message(message_type::unchoke).serialize());
+            if (message->type() == message_type::hash_request)
+                send_hashes(fd, *HashRequest::parse(message->payload));
+            if (message->type() != message_type::request) continue;
+
+            uint32_t fields[3];
+            std::memcpy(fields, message->payload.data(), sizeof(fields));
+            uint32_t index = ntohl(fields[0]);
+            uint32_t begin = ntohl(fields[1]);
+            uint32_t length = ntohl(fields[2]);
+            requests.emplace_back(index, begin);
+            if (options_.choke_after > 0 &&
+                requests.size() == options_.choke_after + 1) {
+                send_all(fd, Message(message_type::choke).serialize());
+                send_all(fd, Message(message_type::unchoke).serialize());
+                continue;
+            }
+
+            // index and begin, then the block
+            std::vector<uint8_t> payload(8 + length);
+            std::memcpy(payload.data(), message->payload.data(), 8);
+            std::memcpy(payload.data() + 8,
+                        data_.data() + index * PIECE_LENGTH + begin, length);
+            if (options_.corrupt ||
+                options_.corrupt_block == std::pair{index, begin})
+                payload.back() ^= 1;
+            if (options_.misplace_first && requests.size() == 1) {
+                std::vector<uint8_t> misplaced = payload;
+                uint32_t misplaced_begin = htonl(begin + 1);
+                std::memcpy(misplaced.data() + 4, &misplaced_begin, 4);
+                send_all(fd, Message(message_type::piece, std::move(misplaced))
+                                 .serialize());
+            }
+            send_all(fd,
+                     Message(message_type::piece, std::move(payload))
+                         .serialize());
+        }
+        close(fd);
+    }
+
+    // `length` nodes of the requested layer, then the uncles of their
+    // subtree from the layer of its root up
+    void send_hashes(int fd, HashRequest const& request) {
+        hash_requests.push_back(request);
+        std::vector<uint8_t> payload = request.serialize();
+        if (options_.reject_hashes) {
+            send_all(fd, Message(message_type::hash_reject, std::move(payload))
+                             .serialize());
+            return;
+        }
+        auto append = [&](Sha256Digest const& hash) {
+            payload.insert(payload.end(), hash.begin(), hash.end());
+        };
+        std::vector<Sha256Digest> const& base = tree_[request.base_layer];
+        for (size_t i = 0; i < request.length; i++)
+            append(base[request.index + i]);
+        size_t layer = request.base_layer + std::countr_zero(request.length);
+        size_t node = request.index / request.length;
+        for (size_t proof = std::countr_zero(request.length);
+             proof < request.proof_layers && layer + 1 < tree_.size();
+             proof++, layer++, node /= 2)
+            append(tree_[layer][node ^ 1]);
+        send_all(fd,
+                 Message(message_type::hashes, std::move(payload)).serialize());
+    }
+
+    static void send_all(int fd, std::vector<uint8_t> const& data) {
+        for (size_t sent = 0; sent < data.size();) {
+            ssize_t r = send(fd, data.data() + sent, data.size() - sent,
+                             MSG_NOSIGNAL);
+            if (r <= 0) return;
+            sent += static_cast<size_t>(r);
+        }
+    }
+
+    std::string data_;
+    SeederOptions options_;
+    std::vector<std::vector<Sha256Digest>> tree_;
+    int listener_;
+    std::thread thread_;
+};
+
+static void connect_peer(Peer& peer) {
+    REQUIRE(peer.establish_connection() == std::error_code{});
+    REQUIRE(peer.handshake(peer.torrent.info_hash_raw()) == std::error_code{});
+    REQUIRE(peer.recv_bitfield() == std::error_code{});
+    REQUIRE(peer.interested_unchoke() == std::error_code{});
+}
+
+TEST_CASE("Pieces are downloaded from a peer", "[peer]") {
+    std::string data = make_data(2 * PIECE_LENGTH + 20000);
+    auto torrent = make_torrent(data);
+    FakeSeeder seeder(data);
+    {
+        Peer peer("127.0.0.1", seeder.port, *torrent);
+        connect_peer(peer);
+
+        for (size_t index = 0; index < 3; index++) {
+            INFO(index);
+            std::error_code ec;
+            std::vector<uint8_t> piece = peer.download_piece(index, ec);
+            REQUIRE_FALSE(ec);
+            size_t begin = index * PIECE_LENGTH;
+            REQUIRE(piece.size() ==
+                    std::min(PIECE_LENGTH, data.size() - begin));
+            CHECK(std::string(piece.begin(), piece.end()) ==
+                  data.substr(begin, piece.size()));
+        }
+        // adapted between the default limits
+        PeerStats stats = peer.stats();
+        CHECK(stats.min_request_depth == Peer::MIN_REQUEST_DEPTH);
+        CHECK(stats.max_request_depth == Peer::MAX_REQUEST_DEPTH);
+        CHECK(stats.request_depth >= Peer::MIN_REQUEST_DEPTH);
+    }
+    // 4 blocks per piece, 2 in the last one
+    seeder.finish();
+    CHECK(seeder.requests.size() == 10);
+}
+
+TEST_CASE("Corrupt pieces are rejected", "[peer]") {
+    std::string data = make_data(PIECE_LENGTH);
+    auto torrent = make_torrent(data);
+    FakeSeeder seeder(data, {.corrupt = true});
+
+    Peer peer("127.0.0.1", seeder.port, *torrent);
+    connect_peer(peer);
+    std::error_code ec;
+    CHECK(peer.download_piece(0, ec).empty());
+    CHECK(ec == error(errors::error_code_enum::piece_hash_mismatch));
+
+    // fetch_piece leaves the check to the caller
+    ec.clear();
+    CHECK(peer.fetch_piece(0, ec).size() == PIECE_LENGTH);
+    CHECK_FALSE(ec);
+}
+
+TEST_CASE("Block requests are pipelined across pieces", "[peer]") {
+    std::string data = make_data(2 * PIECE_LENGTH + 20000);
+    auto torrent = make_torrent(data);
+    FakeSeeder seeder(data);
+    {
+        Peer peer("127.0.0.1", seeder.port, *torrent);
+        connect_peer(peer);
+        // more than the 4 blocks of a piece
+        peer.set_request_depth(6);
+        for (size_t index : {2, 0, 1})
+            REQUIRE(peer.queue_piece(index) == std::error_code{});
+        CHECK(peer.queued_pieces() == 3);
+
+        std::vector<size_t> order;
+        std::error_code ec;
+        while (auto piece = peer.next_piece(ec)) {
+            size_t begin = piece->index * PIECE_LENGTH;
+            CHECK(std::string(piece->data.begin(), piece->data.end()) ==
+                  data.substr(begin, piece->data.size()));
+            order.push_back(piece->index);
+        }
+        CHECK_FALSE(ec);
+        CHECK(order == std::vector<size_t>{2, 0, 1});
+
+        PeerStats stats = peer.stats();
+        CHECK(stats.request_depth == 6);
+        CHECK(stats.min_request_depth == 6);
+        CHECK(stats.max_request_depth == 6);
+        CHECK(stats.min_rtt.count() > 0);
+        CHECK(stats.smoothed_rtt >= stats.min_rtt);
+        CHECK(stats.max_requests_in_flight == 6);
+        CHECK(stats.requests_in_flight == 0);
+        CHECK(stats.requests_sent == 10);
+        CHECK(stats.blocks_received == 10);
+        CHECK(stats.bytes_received == data.size());
+        CHECK(stats.pieces_received == 3);
+        // interested, the first 6 requests together, then one request as
+        // each of the first 4 blocks arrives
+        CHECK(stats.send_calls == 6);
+    }
+    seeder.finish();
+    REQUIRE(seeder.requests.size() == 10);
+    CHECK(seeder.requests[0] == std::pair<uint32_t, uint32_t>{2, 0});
+    CHECK(seeder.requests[2] == std::pair<uint32_t, uint32_t>{0, 0});
+}
+
+TEST_CASE("Requests dropped by a choke are sent again", "[peer]") {
+    std::string data = make_data(2 * PIECE_LENGTH);
+    auto torrent = make_torrent(data);
+    FakeSeeder seeder(data, {.choke_after = 3});
+    {
+        Peer peer("127.0.0.1", seeder.port, *torrent);
+        connect_peer(peer);
+        REQUIRE(peer.queue_piece(0) == std::error_code{});
+        REQUIRE(peer.queue_piece(1) == std::error_code{});
+
+        // piece 1 may complete first, the last block of piece 0 is sent again
+        std::error_code ec;
+        std::vector<bool> received(2);
+        while (auto piece = peer.next_piece(ec)) {
+            REQUIRE(piece->index < 2);
+            CHECK(std::string(piece->data.begin(), piece->data.end()) ==
+                  data.substr(piece->index * PIECE_LENGTH, PIECE_LENGTH));
+            received[piece->index] = true;
+        }
+        CHECK_FALSE(ec);
+        CHECK(received == std::vector<bool>{true, true});
+        CHECK(peer.stats().requests_sent > 8);
+    }
+    seeder.finish();
+    CHECK(seeder.requests.size() > 8);
+}
+
+TEST_CASE("A misplaced block fails its piece and the connection goes on",
+          "[peer]") {
+    std::string data = make_data(PIECE_LENGTH);
+    auto torrent = make_torrent(data);
+    FakeSeeder seeder(data, {.misplace_first = true});
+
+    Peer peer("127.0.0.1", seeder.port, *torrent);
+    connect_peer(peer);
+    std::error_code ec;
+    CHECK(peer.download_piece(0, ec).empty());
+    CHECK(ec == error(errors::error_code_enum::piece_invalid_block));
+    CHECK(peer.queued_pieces() == 0);
+
+    // the blocks after it are framed
+    ec.clear();
+    std::vector<uint8_t> piece = peer.download_piece(0, ec);
+    REQUIRE_FALSE(ec);
+    CHECK(std::string(piece.begin(), piece.end()) == data);
+}
+
+TEST_CASE("v2 pieces are checked against hashes from the peer", "[peer]") {
+    std::string data = make_data(3 * PIECE_LENGTH + 20000);
+    // without piece layer, the hashes come with a proof up to the root
+    for (bool piece_layers : {true, false}) {
+        INFO(piece_layers);
+        auto torrent = make_v2_torrent(data, piece_layers);
+        FakeSeeder seeder(data);
+        {
+            Peer peer("127.0.0.1", seeder.port, *torrent);
+            connect_peer(peer);
+            for (size_t index = 0; index < 4; index++) {
+                INFO(index);
+                std::error_code ec;
+                std::vector<uint8_t> piece = peer.download_piece(index, ec);
+                REQUIRE_FALSE(ec);
+                CHECK(std::string(piece.begin(), piece.end()) ==
+                      data.substr(index * PIECE_LENGTH, PIECE_LENGTH));
+            }
+        }
+        // the 4 leaves of each piece
+        seeder.finish();
+        REQUIRE(seeder.hash_requests.size() == 4);
+        for (uint32_t index = 0; index < 4; index++) {
+            HashRequest const& request = seeder.hash_requests[index];
+            CHECK(request.pieces_root == torrent->file_tree[0].pieces_root);
+            CHECK(request.base_layer == 0);
+            CHECK(request.index == index * 4);
+            CHECK(request.length == 4);
+            CHECK(request.proof_layers == (piece_layers ? 0 : 4));
+        }
+    }
+}
+
+TEST_CASE("A corrupt v2 block fails its piece when it arrives", "[peer]") {
+    std::string data = make_data(PIECE_LENGTH);
+    auto torrent = make_v2_torrent(data, false);
+    FakeSeeder seeder(data, {.corrupt_block = std::pair{0u, 0u}});
+
+    Peer peer("127.0.0.1", seeder.port, *torrent);
+    connect_peer(peer);
+    std::error_code ec;
+    CHECK(peer.download_piece(0, ec).empty());
+    CHECK(ec == error(errors::error_code_enum::piece_hash_mismatch));
+    CHECK(peer.stats().blocks_received == 1);
+}
+
+TEST_CASE("Rejected hashes leave v2 pieces checked whole", "[peer]") {
+    std::string data = make_data(2 * PIECE_LENGTH);
+    auto torrent = make_v2_torrent(data, true);
+    FakeSeeder seeder(data,
+                      {.corrupt_block = std::pair{1u, 16384u},
+                       .reject_hashes = true});
+
+    Peer peer("127.0.0.1", seeder.port, *torrent);
+    connect_peer(peer);
+    std::error_code ec;
+    std::vector<uint8_t> piece = peer.download_piece(0, ec);
+    REQUIRE_FALSE(ec);
+    CHECK(std::string(piece.begin(), piece.end()) ==
+          data.substr(0, PIECE_LENGTH));
+
+    // the corrupt block is only found once the piece is complete
+    CHECK(peer.download_piece(1, ec).empty());
+    CHECK(ec == error(errors::error_code_enum::piece_hash_mismatch));
+    CHECK(peer.stats().blocks_received == 8);
+}
+
+TEST_CASE("Rejected hashes fail v2 pieces with no known hash", "[peer]") {
+    std::string data = make_data(2 * PIECE_LENGTH);
+    auto torrent = make_v2_torrent(data, false);
+    FakeSeeder seeder(data, {.reject_hashes = true});
+
+    Peer peer("127.0.0.1", seeder.port, *torrent);
+    connect_peer(peer);
+    std::error_code ec;
+    CHECK(peer.download_piece(0, ec).empty());
+    CHECK(ec == error(errors::error_code_enum::piece_hashes_rejected));
+}
@@ -0,0 +1,108 @@
+#include "piece_hasher.hpp"
+#include "error.hpp"
+#include "test_helpers.hpp"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+// begin offsets of the blocks of a piece
+static std::vector<size_t> blocks_of(size_t length, size_t block_size) {
+    std::vector<size_t> result;
+    for (size_t begin = 0; begin < length; begin += block_size)
+        result.push_back(begin);
+    return result;
+}
+
+static Sha1Digest hash_blocks(std::string const& piece,
+                              std::vector<size_t> const& order,
+                              size_t block_size) {
+    PieceHasher hasher(bytes(piece), piece.size());
+    for (size_t begin : order) {
+        REQUIRE(!hasher.complete());
+        REQUIRE(!hasher.add_block(
+            begin, std::min(block_size, piece.size() - begin)));
+    }
+    std::error_code ec;
+    auto digest = hasher.digest(ec);
+    REQUIRE(!ec);
+    return digest;
+}
+
+TEST_CASE("Blocks in order are hashed as they arrive", "[piece_hasher]") {
+    auto piece = make_data(100000);
+    PieceHasher hasher(bytes(piece), piece.size());
+    REQUIRE(!hasher.add_block(0, 16384));
+    CHECK(hasher.hashed() == 16384);
+    REQUIRE(!hasher.add_block(16384, 16384));
+    CHECK(hasher.hashed() == 32768);
+
+    auto order = blocks_of(piece.size(), 16384);
+    CHECK(hash_blocks(piece, order, 16384) == sha1_of(piece));
+}
+
+TEST_CASE("Blocks out of order are held until the gap fills",
+          "[piece_hasher]") {
+    auto piece = make_data(5 * 16384 + 100);
+    PieceHasher hasher(bytes(piece), piece.size());
+    REQUIRE(!hasher.add_block(2 * 16384, 16384));
+    REQUIRE(!hasher.add_block(3 * 16384, 16384));
+    CHECK(hasher.hashed() == 0);
+    REQUIRE(!hasher.add_block(0, 16384));
+    CHECK(hasher.hashed() == 16384);
+    REQUIRE(!hasher.add_block(16384, 16384));
+    CHECK(hasher.hashed() == 4 * 16384);
+
+    std::error_code ec;
+    hasher.digest(ec);
+    CHECK(ec == error(errors::error_code_enum::piece_incomplete));
+
+    REQUIRE(!hasher.add_block(5 * 16384, 100));
+    REQUIRE(!hasher.add_block(4 * 16384, 16384));
+    CHECK(hasher.complete());
+    ec.clear();
+    CHECK(hasher.digest(ec) == sha1_of(piece));
+    CHECK(!ec);
+
+    auto order = blocks_of(piece.size(), 16384);
+    std::reverse(order.begin(), order.end());
+    CHECK(hash_blocks(piece, order, 16384) == sha1_of(piece));
+
+    std::mt19937 random(42);
+    for (int i = 0; i < 10; i++) {
+        auto order = blocks_of(piece.size(), 1000);
+        std::shuffle(order.begin(), order.end(), random);
+        CHECK(hash_blocks(piece, order, 1000) == sha1_of(piece));
+    }
+}
+
+TEST_CASE("Duplicate and overlapping blocks are hashed once",
+          "[piece_hasher]") {
+    auto piece = make_data(4000);
+    PieceHasher hasher(bytes(piece), piece.size());
+    REQUIRE(!hasher.add_block(2000, 1000));
+    REQUIRE(!hasher.add_block(2000, 1000));
+    REQUIRE(!hasher.add_block(2500, 1500));
+    REQUIRE(!hasher.add_block(0, 1000));
+    REQUIRE(!hasher.add_block(0, 1000));
+    REQUIRE(!hasher.add_block(500, 1600));
+    CHECK(hasher.complete());
+    std::error_code ec;
+    CHECK(hasher.digest(ec) == sha1_of(piece));
+}
+
+TEST_CASE("Blocks outside of the piece are rejected", "[piece_hasher]") {
+    auto piece = make_data(1000);
+    PieceHasher hasher(bytes(piece), piece.size());
+    CHECK(hasher.add_block(1001, 0) ==
+          error(errors::error_code_enum::piece_invalid_block));
+    CHECK(hasher.add_block(900, 101) ==
+          error(errors::error_code_enum::piece_invalid_block));
+    CHECK(!hasher.add_block(900, 100));
+    CHECK(hasher.hashed() == 0);
+}
@@ -0,0 +1,208 @@
+// Download throughput from one peer against the number of block requests in
+// flight, fixed or adapted to the connection. A seeder on a loopback port
+// answers each request after a simulated round trip, and at most at a given
+// rate, so a peer that waits for every block before asking for the next one
+// is limited to one block per round trip.
+// Usage: pipeline_bench [round trip in ms] [megabytes] [seeder MB/s]
+#include "message.hpp"
+#include "message_reader.hpp"
+#include "peer.hpp"
+#include "torrent.hpp"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace bittorrent;
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t PIECE_LENGTH = 256 * 1024;
+
+static void send_all(int fd, std::vector<uint8_t> const& data) {
+    for (size_t sent = 0; sent < data.size();) {
+        ssize_t r =
+            send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (r <= 0) return;
+        sent += static_cast<size_t>(r);
+    }
+}
+
+// Serves one connection, each block `rtt` after its request, and `rate`
+// bytes per second at most (0: no limit)
+class DelayedSeeder {
+   public:
+    DelayedSeeder(std::chrono::milliseconds rtt, double rate)
+        : rtt_(rtt), block_(16 * 1024, 0x5A) {
+        if (rate > 0)
+            transfer_ = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(block_.size() / rate));
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (bind(listener_, reinterpret_cast<sockaddr*>(&address), length) !=
+                0 ||
+            listen(listener_, 1) != 0 ||
+            getsockname(listener_, reinterpret_cast<sockaddr*>(&address),
+                        &length) != 0) {
+            std::perror("listen");
+            std::exit(1);
+        }
+        port = ntohs(address.sin_port);
+        thread_ = std::thread([this] { serve(); });
+    }
+    ~DelayedSeeder() {
+        shutdown(listener_, SHUT_RDWR);
+        thread_.join();
+        close(listener_);
+    }
+
+    uint16_t port;
+
+   private:
+    struct Pending {
+        Clock::time_point due;
+        std::vector<uint8_t> message;
+    };
+
+    void serve() {
+        int fd = accept(listener_, nullptr, nullptr);
+        if (fd < 0) return;
+        uint8_t handshake[68];
+        if (recv(fd, handshake, sizeof(handshake), MSG_WAITALL) != 68) {
+            close(fd);
+            return;
+        }
+        send_all(fd, {handshake, handshake + sizeof(handshake)});
+        send_all(fd, Message(message_type::bitfield, {0xFF}).serialize());
+
+        MessageReader reader;
+        std::deque<Pending> pending;
+        while (true) {
+            int timeout = -1;
+            if (!pending.empty())
+                timeout = static_cast<int>(std::max<int64_t>(
+                    0, std::chrono::duration_cast<std::chrono::milliseconds>(
+                           pending.front().due - Clock::now())
+                           .count()));
+            pollfd event{fd, POLLIN, 0};
+            if (poll(&event, 1, timeout) < 0) break;
+
+            if (event.revents & POLLIN) {
+                if (reader.fill(fd)) break;
+                std::error_code ec;
+                while (auto message = reader.next(ec)) {
+                    if (message->type() == message_type::interested)
+                        send_all(fd,
+                                 Message(message_type::unchoke).serialize());
+                    if (message->type() != message_type::request) continue;
+                    uint32_t length;
+                    std::memcpy(&length, message->payload.data() + 8, 4);
+                    std::vector<uint8_t> payload(8 + ntohl(length));
+                    std::memcpy(payload.data(), message->payload.data(), 8);
+                    std::memcpy(payload.data() + 8, block_.data(),
+                                payload.size() - 8);
+                    Clock::time_point due = Clock::now() + rtt_;
+                    if (!pending.empty())
+                        due = std::max(due, pending.back().due + transfer_);
+                    pending.push_back(
+                        {due, Message(message_type::piece, std::move(payload))
+                                  .serialize()});
+                }
+            }
+            while (!pending.empty() && pending.front().due <= Clock::now()) {
+                send_all(fd, pending.front().message);
+                pending.pop_front();
+            }
+        }
+        close(fd);
+    }
+
+    std::chrono::milliseconds rtt_;
+    Clock::duration transfer_{0};
+    std::vector<uint8_t> block_;
+    int listener_;
+    std::thread thread_;
+};
+
+// Torrent of `size` bytes; the hashes are not checked by the benchmark
+static std::unique_ptr<Torrent> make_torrent(size_t size) {
+    size_t pieces = (size + PIECE_LENGTH - 1) / PIECE_LENGTH;
+    auto path = std::filesystem::temp_directory_path() / "pipeline_bench.torrent";
+    {
+        std::ofstream f(path, std::ios::binary);
+        f << "d4:infod6:lengthi" << size << "e4:name4:data12:piece lengthi"
+          << PIECE_LENGTH << "e6:pieces" << pieces * 20 << ":"
+          << std::string(pieces * 20, '\0') << "ee";
+    }
+    std::error_code ec;
+    auto torrent = Torrent::parse_torrent(path, ec);
+    std::filesystem::remove(path);
+    if (!torrent) {
+        std::fprintf(stderr, "torrent: %s\n", ec.message().c_str());
+        std::exit(1);
+    }
+    return torrent;
+}
+
+// A fixed depth with min_depth == max_depth
+static void run(Torrent const& torrent, std::chrono::milliseconds rtt,
+                double rate, size_t min_depth, size_t max_depth) {
+    DelayedSeeder seeder(rtt, rate);
+    Peer peer("127.0.0.1", seeder.port, torrent);
+    std::error_code ec;
+    if ((ec = peer.establish_connection()) ||
+        (ec = peer.handshake(torrent.info_hash_raw())) ||
+        (ec = peer.recv_bitfield()) || (ec = peer.interested_unchoke())) {
+        std::fprintf(stderr, "connect: %s\n", ec.message().c_str());
+        std::exit(1);
+    }
+
+    auto start = Clock::now();
+    peer.set_request_depth_limits(min_depth, max_depth);
+    for (size_t i = 0; i < torrent.piece_hashes().size(); i++)
+        peer.queue_piece(i, false);
+    size_t received = 0;
+    while (auto piece = peer.next_piece(ec)) received += piece->data.size();
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    peer.close_connection();
+
+    PeerStats stats = peer.stats();
+    std::string depth = std::to_string(min_depth);
+    if (max_depth != min_depth)
+        depth = "adaptive (" + std::to_string(stats.request_depth) + ")";
+    std::printf(
+        "  %-16s %10.2f MB/s %8.2f requests/send %8.1f ms min rtt%s\n",
+        depth.c_str(), received / elapsed.count() / 1e6,
+        static_cast<double>(stats.requests_sent) /
+            std::max<uint64_t>(1, stats.send_calls),
+        stats.min_rtt.count() / 1e6,
+        ec || received != torrent.length ? " (failed)" : "");
+}
+
+int main(int argc, char* argv[]) {
+    std::chrono::milliseconds rtt(argc > 1 ? std::atoi(argv[1]) : 20);
+    size_t size = (argc > 2 ? std::atoi(argv[2]) : 4) * size_t{1 << 20};
+    double rate = (argc > 3 ? std::atof(argv[3]) : 0) * 1e6;
+    auto torrent = make_torrent(size);
+
+    std::printf("%zu MiB, %lld ms round trip, 16 KiB blocks, requests in "
+                "flight:\n",
+                size >> 20, static_cast<long long>(rtt.count()));
+    for (size_t depth : {1, 4, 16, 64, 256})
+        run(*torrent, rtt, rate, depth, depth);
+    run(*torrent, rtt, rate, Peer::MIN_REQUEST_DEPTH, Peer::MAX_REQUEST_DEPTH);
+    return 0;
+}
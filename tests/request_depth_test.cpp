@@ -0,0 +1,127 @@
+#include "request_depth.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <deque>
+
+using namespace bittorrent;
+using namespace std::chrono_literals;
+using Clock = RequestDepth::Clock;
+
+constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+// A link with a round trip of `rtt` and `rate` bytes per second: a block
+// arrives a round trip after its request, or once the block before it went
+// through the link. Requests are sent as soon as there is room in the
+// pipeline. Returns the bytes per second received over the last half.
+static double simulate(RequestDepth& depth, std::chrono::nanoseconds rtt,
+                       double rate, size_t blocks) {
+    auto const transfer = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(BLOCK_SIZE / rate));
+    Clock::time_point now{};
+    Clock::time_point last_arrival{};
+    Clock::time_point half{};
+    std::deque<Clock::time_point> in_flight;
+    for (size_t i = 0; i < blocks; i++) {
+        while (in_flight.size() < depth.depth()) in_flight.push_back(now);
+        Clock::time_point requested = in_flight.front();
+        in_flight.pop_front();
+
+        now = std::max(requested + rtt, last_arrival + transfer);
+        last_arrival = now;
+        depth.add_block(BLOCK_SIZE, requested, now);
+        if (i == blocks / 2) half = now;
+    }
+    std::chrono::duration<double> elapsed = now - half;
+    return (blocks - blocks / 2 - 1) * BLOCK_SIZE / elapsed.count();
+}
+
+// blocks covering the bandwidth-delay product
+static double bdp_blocks(std::chrono::nanoseconds rtt, double rate) {
+    return rate * std::chrono::duration<double>(rtt).count() / BLOCK_SIZE;
+}
+
+TEST_CASE("The depth grows until the link is the limit", "[request_depth]") {
+    RequestDepth depth(4, 1024);
+    CHECK(depth.depth() == 4);
+    CHECK(depth.delivery_rate() == 0);
+
+    SECTION("Fast LAN peer") {
+        // 100 MB/s, 1 ms: 6 blocks
+        double rate = simulate(depth, 1ms, 100e6, 4000);
+        CHECK(depth.min_rtt() == 1ms);
+        CHECK(rate > 0.95 * 100e6);
+        CHECK(depth.depth() >= bdp_blocks(1ms, 100e6));
+        CHECK(depth.depth() <= 2 * bdp_blocks(1ms, 100e6) + 1);
+    }
+
+    SECTION("Slow distant peer") {
+        // 2 MB/s, 250 ms: 31 blocks
+        double rate = simulate(depth, 250ms, 2e6, 4000);
+        // measured again after 10 s, with a block or so queued at the peer
+        CHECK(depth.min_rtt() >= 250ms);
+        CHECK(depth.min_rtt() < 260ms);
+        CHECK(rate > 0.95 * 2e6);
+        CHECK(depth.depth() >= bdp_blocks(250ms, 2e6));
+        CHECK(depth.depth() <= 2 * bdp_blocks(250ms, 2e6) + 1);
+    }
+
+    // measured, and used for the depth
+    CHECK(depth.delivery_rate() > 0);
+    CHECK(depth.smoothed_rtt() >= depth.min_rtt());
+}
+
+TEST_CASE("The depth stays within its limits", "[request_depth]") {
+    SECTION("Maximum") {
+        RequestDepth depth(2, 16);
+        double rate = simulate(depth, 100ms, 1e9, 2000);
+        CHECK(depth.depth() == 16);
+        // 16 blocks per round trip
+        CHECK(rate < 1.01 * 16 * BLOCK_SIZE / 0.1);
+    }
+
+    SECTION("Minimum") {
+        RequestDepth depth(8, 64);
+        simulate(depth, 1ms, 1e6, 500);
+        CHECK(depth.depth() == 8);
+    }
+
+    SECTION("Fixed") {
+        RequestDepth depth(4, 1024);
+        simulate(depth, 50ms, 50e6, 500);
+        CHECK(depth.depth() > 32);
+        depth.set_limits(32, 32);
+        CHECK(depth.depth() == 32);
+        simulate(depth, 50ms, 50e6, 500);
+        CHECK(depth.depth() == 32);
+    }
+
+    SECTION("Invalid") {
+        RequestDepth depth(0, 0);
+        CHECK(depth.min_depth() == 1);
+        CHECK(depth.max_depth() == 1);
+    }
+}
+
+TEST_CASE("A longer round trip is taken once the window expires",
+          "[request_depth]") {
+    RequestDepth depth(4, 1024);
+    Clock::time_point start{};
+    depth.add_block(BLOCK_SIZE, start, start + 10ms);
+    CHECK(depth.min_rtt() == 10ms);
+
+    // the route changes: the shortest round trip is kept for a while
+    depth.add_block(BLOCK_SIZE, start + 1s, start + 1s + 40ms);
+    CHECK(depth.min_rtt() == 10ms);
+    CHECK_FALSE(depth.probing_rtt());
+
+    // then measured again, with the pipeline drained
+    Clock::time_point later = start + RequestDepth::RTT_WINDOW + 1s;
+    depth.add_block(BLOCK_SIZE, later, later + 40ms);
+    CHECK(depth.probing_rtt());
+    CHECK(depth.depth() == 4);
+    depth.add_block(BLOCK_SIZE, later + 10ms, later + 100ms);
+    CHECK(depth.min_rtt() == 10ms);
+    depth.add_block(BLOCK_SIZE, later + 100ms, later + 140ms);
+    CHECK_FALSE(depth.probing_rtt());
+    CHECK(depth.min_rtt() == 40ms);
+}
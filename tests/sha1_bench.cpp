@@ -0,0 +1,89 @@
+// SHA1 throughput benchmark, on buffers the size of typical pieces.
+// Usage: sha1_bench [megabytes per run]
+#include "lib/sha1.hpp"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Hashes `total` bytes in `size`-byte buffers with `f`, prints GB/s
+template <typename F>
+static void run(char const* name, std::vector<uint8_t> const& buffer,
+                size_t total, F f) {
+    uint8_t digest[20];
+    f(buffer.data(), buffer.size(), digest);  // warm up
+
+    size_t runs = std::max<size_t>(1, total / buffer.size());
+    auto start = std::chrono::steady_clock::now();
+    unsigned sink = 0;
+    for (size_t i = 0; i < runs; i++) {
+        f(buffer.data(), buffer.size(), digest);
+        sink += digest[0];
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    double gigabytes = runs * static_cast<double>(buffer.size()) / 1e9;
+    std::printf("  %-12s %8zu KiB %8.3f GB/s%s\n", name, buffer.size() / 1024,
+                gigabytes / elapsed.count(), sink == 0xFFFFFFFF ? " " : "");
+}
+
+int main(int argc, char* argv[]) {
+    size_t total = (argc > 1 ? std::atoi(argv[1]) : 256) * size_t{1 << 20};
+
+    std::printf("sha1\n");
+    for (size_t size : {16 * 1024, 256 * 1024, 4 * 1024 * 1024}) {
+        std::vector<uint8_t> buffer(size);
+        for (size_t i = 0; i < size; i++) buffer[i] = static_cast<uint8_t>(i * 7);
+
+        run("per byte", buffer, total,
+            [](uint8_t const* data, size_t size, uint8_t* digest) {
+                sha1::SHA1 sha1;
+                for (size_t i = 0; i < size; i++) sha1.processByte(data[i]);
+                sha1.getDigestBytes(digest);
+            });
+        for (auto [name, implementation] :
+             {std::pair{"portable", sha1::Implementation::portable},
+              std::pair{"shani", sha1::Implementation::shani},
+              std::pair{"armv8", sha1::Implementation::armv8}}) {
+            if (!sha1::isSupported(implementation)) continue;
+            run(name, buffer, total,
+                [implementation](uint8_t const* data, size_t size,
+                                 uint8_t* digest) {
+                    sha1::SHA1 sha1(implementation);
+                    sha1.processBytes(data, size);
+                    sha1.getDigestBytes(digest);
+                });
+        }
+    }
+
+    // a batch of 64 buffers, GB/s over all of them
+    std::printf("sha1 batch of 64\n");
+    for (size_t size : {16 * 1024, 256 * 1024}) {
+        std::vector<uint8_t> buffer(size * 64);
+        for (size_t i = 0; i < buffer.size(); i++)
+            buffer[i] = static_cast<uint8_t>(i * 7);
+        std::vector<uint8_t const*> messages;
+        for (size_t i = 0; i < 64; i++) messages.push_back(&buffer[i * size]);
+        std::vector<std::array<uint8_t, 20>> digests(64);
+
+        for (auto [name, implementation] :
+             {std::pair{"single", sha1::BatchImplementation::single},
+              std::pair{"avx2", sha1::BatchImplementation::avx2},
+              std::pair{"avx512", sha1::BatchImplementation::avx512}}) {
+            if (!sha1::isSupported(implementation)) continue;
+            run(name, buffer, total,
+                [&, implementation](uint8_t const*, size_t, uint8_t* digest) {
+                    sha1::hashBatch(
+                        messages.data(), messages.size(), size,
+                        reinterpret_cast<uint8_t(*)[20]>(digests.data()),
+                        implementation);
+                    digest[0] = digests[63][0];
+                });
+        }
+    }
+    return 0;
+}
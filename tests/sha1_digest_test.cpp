@@ -0,0 +1,45 @@
+#include "sha1_digest.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <string_view>
+
+using namespace bittorrent;
+
+// SHA1("abc")
+constexpr std::string_view abc_hex = "a9993e364706816aba3e25717850c26c9cd0d89d";
+constexpr Sha1Digest abc = {0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81,
+                            0x6a, 0xba, 0x3e, 0x25, 0x71, 0x78, 0x50,
+                            0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d};
+
+static_assert(digest_from_hex(abc_hex) == abc);
+static_assert(digest_from_hex("A9993E364706816ABA3E25717850C26C9CD0D89D") ==
+              abc);
+static_assert(std::string_view(to_hex_chars(abc).data(), 40) == abc_hex);
+static_assert(Sha1Digest{} < abc);
+
+TEST_CASE("Digests to and from hex", "[sha1_digest]") {
+    CHECK(to_hex(abc) == abc_hex);
+    CHECK(to_hex(Sha1Digest{}) == std::string(40, '0'));
+    CHECK(digest_from_hex(to_hex(abc)) == abc);
+
+    CHECK_FALSE(digest_from_hex(""));
+    CHECK_FALSE(digest_from_hex(abc_hex.substr(1)));
+    CHECK_FALSE(digest_from_hex(std::string(abc_hex) + "0"));
+    CHECK_FALSE(digest_from_hex("g9993e364706816aba3e25717850c26c9cd0d89d"));
+}
+
+TEST_CASE("Concatenated digests are viewed in place", "[sha1_digest]") {
+    std::string pieces(reinterpret_cast<char const*>(abc.data()), 20);
+    pieces += std::string(20, '\x01');
+    pieces += "partial";
+
+    auto view = digests_view(pieces);
+    REQUIRE(view.size() == 2);
+    CHECK(reinterpret_cast<char const*>(view.data()) == pieces.data());
+    CHECK(view[0] == abc);
+    Sha1Digest ones;
+    ones.fill(1);
+    CHECK(view[1] == ones);
+
+    CHECK(digests_view("").empty());
+}
@@ -0,0 +1,136 @@
+#include "lib/sha1.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static std::string hex(uint8_t const* digest) {
+    static char const digits[] = "0123456789abcdef";
+    std::string result;
+    for (size_t i = 0; i < 20; i++) {
+        result.push_back(digits[digest[i] >> 4]);
+        result.push_back(digits[digest[i] & 0xF]);
+    }
+    return result;
+}
+
+static std::string sha1_hex(std::string const& message,
+                            sha1::Implementation implementation =
+                                sha1::bestImplementation()) {
+    sha1::SHA1 sha1(implementation);
+    sha1.processBytes(message.data(), message.size());
+    uint8_t digest[20];
+    sha1.getDigestBytes(digest);
+    return hex(digest);
+}
+
+static std::vector<sha1::Implementation> supported_implementations() {
+    std::vector<sha1::Implementation> result;
+    for (auto implementation :
+         {sha1::Implementation::portable, sha1::Implementation::shani,
+          sha1::Implementation::armv8})
+        if (sha1::isSupported(implementation))
+            result.push_back(implementation);
+    return result;
+}
+
+TEST_CASE("SHA1 known answers", "[sha1]") {
+    for (auto implementation : supported_implementations()) {
+        INFO("implementation " << static_cast<int>(implementation));
+        // FIPS 180-2 examples and padding edge cases
+        CHECK(sha1_hex("", implementation) ==
+              "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+        CHECK(sha1_hex("abc", implementation) ==
+              "a9993e364706816aba3e25717850c26c9cd0d89d");
+        CHECK(sha1_hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnop"
+                       "q",
+                       implementation) ==
+              "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+        CHECK(sha1_hex("The quick brown fox jumps over the lazy dog",
+                       implementation) ==
+              "2fd4e1c67a2d28fced849ee1bb76e7391b93eb12");
+        CHECK(sha1_hex(std::string(55, 'a'), implementation) ==
+              "c1c8bbdc22796e28c0e15163d20899b65621d65a");
+        CHECK(sha1_hex(std::string(64, 'a'), implementation) ==
+              "0098ba824b5c16427bd7a1122a5a442a25ec644d");
+        CHECK(sha1_hex(std::string(1000000, 'a'), implementation) ==
+              "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    }
+}
+
+TEST_CASE("SHA1 implementations agree", "[sha1]") {
+    std::string data(70000, '\0');
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<char>(i * 131 + (i >> 8));
+
+    for (size_t size : {0, 1, 63, 64, 65, 1000, 16384, 70000}) {
+        INFO(size);
+        std::string message = data.substr(0, size);
+        std::string expected =
+            sha1_hex(message, sha1::Implementation::portable);
+        for (auto implementation : supported_implementations())
+            CHECK(sha1_hex(message, implementation) == expected);
+    }
+}
+
+TEST_CASE("SHA1 of split input matches the one-shot digest", "[sha1]") {
+    std::vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<uint8_t>(i * 31 + 7);
+
+    uint8_t expected[20];
+    sha1::SHA1().processBytes(data.data(), data.size()).getDigestBytes(
+        expected);
+
+    // unaligned heads and tails of every size
+    for (size_t chunk : {1, 3, 63, 64, 65, 127, 200}) {
+        INFO(chunk);
+        sha1::SHA1 sha1;
+        for (size_t i = 0; i < data.size(); i += chunk)
+            sha1.processBytes(data.data() + i,
+                              std::min(chunk, data.size() - i));
+        uint8_t digest[20];
+        sha1.getDigestBytes(digest);
+        CHECK(hex(digest) == hex(expected));
+    }
+
+    sha1::SHA1 bytewise;
+    for (uint8_t byte : data) bytewise.processByte(byte);
+    uint8_t digest[20];
+    bytewise.getDigestBytes(digest);
+    CHECK(hex(digest) == hex(expected));
+}
+
+TEST_CASE("SHA1 batches match the single digests", "[sha1]") {
+    std::vector<uint8_t> data(40 * 16384);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<uint8_t>(i * 131 + (i >> 9));
+
+    for (auto implementation :
+         {sha1::BatchImplementation::single, sha1::BatchImplementation::avx2,
+          sha1::BatchImplementation::avx512}) {
+        if (!sha1::isSupported(implementation)) continue;
+        for (size_t count : {1, 7, 8, 9, 16, 17, 33}) {
+            for (size_t size : {0, 55, 56, 64, 1000, 16384}) {
+                INFO("implementation " << static_cast<int>(implementation)
+                                       << " count " << count << " size "
+                                       << size);
+                // messages at uneven distances from each other
+                std::vector<uint8_t const*> messages;
+                for (size_t i = 0; i < count; i++)
+                    messages.push_back(data.data() + i * size + i * i % 13);
+
+                std::vector<uint8_t> digests(count * 20);
+                sha1::hashBatch(messages.data(), count, size,
+                                reinterpret_cast<uint8_t(*)[20]>(digests.data()),
+                                implementation);
+                for (size_t i = 0; i < count; i++) {
+                    uint8_t expected[20];
+                    sha1::SHA1().processBytes(messages[i], size).getDigestBytes(
+                        expected);
+                    CHECK(hex(digests.data() + i * 20) == hex(expected));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#include "lib/sha256.hpp"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static std::string sha256_hex(std::string const& message,
+                              sha256::Implementation implementation) {
+    static char const digits[] = "0123456789abcdef";
+    uint8_t digest[32];
+    sha256::SHA256(implementation)
+        .processBytes(message.data(), message.size())
+        .getDigestBytes(digest);
+    std::string result;
+    for (uint8_t byte : digest) {
+        result.push_back(digits[byte >> 4]);
+        result.push_back(digits[byte & 0xF]);
+    }
+    return result;
+}
+
+static std::vector<sha256::Implementation> supported_implementations() {
+    std::vector<sha256::Implementation> result;
+    for (auto implementation :
+         {sha256::Implementation::portable, sha256::Implementation::shani,
+          sha256::Implementation::armv8})
+        if (sha256::isSupported(implementation))
+            result.push_back(implementation);
+    return result;
+}
+
+TEST_CASE("SHA256 known answers", "[sha256]") {
+    for (auto implementation : supported_implementations()) {
+        INFO("implementation " << static_cast<int>(implementation));
+        // FIPS 180-2 examples and padding edge cases
+        CHECK(sha256_hex("", implementation) ==
+              "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        CHECK(sha256_hex("abc", implementation) ==
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        CHECK(sha256_hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnop"
+                         "q",
+                         implementation) ==
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        CHECK(sha256_hex(std::string(1000000, 'a'), implementation) ==
+              "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    }
+}
+
+TEST_CASE("SHA256 implementations agree", "[sha256]") {
+    std::string data(70000, '\0');
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<char>(i * 131 + (i >> 8));
+
+    for (size_t size : {0, 1, 55, 56, 63, 64, 65, 1000, 16384, 70000}) {
+        INFO(size);
+        std::string message = data.substr(0, size);
+        std::string expected =
+            sha256_hex(message, sha256::Implementation::portable);
+        for (auto implementation : supported_implementations())
+            CHECK(sha256_hex(message, implementation) == expected);
+    }
+
+    // split input
+    uint8_t expected[32], digest[32];
+    sha256::SHA256().processBytes(data.data(), 1000).getDigestBytes(expected);
+    sha256::SHA256 split;
+    for (size_t i = 0; i < 1000; i += 7)
+        split.processBytes(data.data() + i, std::min<size_t>(7, 1000 - i));
+    split.getDigestBytes(digest);
+    CHECK(std::string(digest, digest + 32) ==
+          std::string(expected, expected + 32));
+}
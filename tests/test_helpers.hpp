@@ -0,0 +1,114 @@
+#pragma once
+
+// Helpers shared by the test programs
+
+#include "error.hpp"
+#include "lib/utils.hpp"
+#include "merkle.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace bittorrent::test {
+
+// Project error codes compare to these, the enum is not registered as an
+// error code enum outside of error.cpp
+inline std::error_code error(errors::error_code_enum e) {
+    return errors::make_error_code(e);
+}
+
+inline std::string bencode_string(std::string const& s) {
+    return std::to_string(s.size()) + ":" + s;
+}
+
+// `size` bytes of data that differ with `seed`, and from piece to piece
+inline std::string make_data(size_t size, size_t seed = 0) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++)
+        data[i] = static_cast<char>(i * 131 + seed * 7 + (i >> 11));
+    return data;
+}
+
+// `data` as the bytes the hash functions take
+inline uint8_t const* bytes(std::string const& data) {
+    return reinterpret_cast<uint8_t const*>(data.data());
+}
+
+inline Sha1Digest sha1_of(std::string const& data) {
+    return utils::sha1_digest(bytes(data), data.size());
+}
+
+// Concatenated SHA1 of the pieces of `data`, as in the pieces of a torrent
+inline std::string piece_hashes(std::string const& data, size_t piece_length) {
+    std::string result;
+    for (size_t begin = 0; begin < data.size(); begin += piece_length) {
+        size_t size = std::min(piece_length, data.size() - begin);
+        Sha1Digest digest = utils::sha1_digest(bytes(data) + begin, size);
+        result.append(reinterpret_cast<char const*>(digest.data()), 20);
+    }
+    return result;
+}
+
+// v2 file tree entry (BEP 52) of a file `name` of `data`
+inline std::string v2_file_entry(std::string const& name,
+                                 std::string const& data) {
+    std::string entry = bencode_string(name) + "d0:d6:lengthi" +
+                        std::to_string(data.size()) + "e";
+    if (!data.empty()) {
+        auto root = merkle::file_root(bytes(data), data.size());
+        entry += "11:pieces root" +
+                 bencode_string(std::string(root.begin(), root.end()));
+    }
+    return entry + "ee";
+}
+
+// Piece layers of the files of `files` larger than a piece
+inline std::string v2_piece_layers(std::vector<std::string> const& files,
+                                   size_t piece_length) {
+    std::string layers = "d";
+    for (std::string const& data : files) {
+        auto layer =
+            merkle::piece_layer(bytes(data), data.size(), piece_length);
+        if (layer.empty()) continue;
+        auto root = merkle::file_root(bytes(data), data.size());
+        layers += bencode_string(std::string(root.begin(), root.end()));
+        layers += bencode_string(
+            std::string(reinterpret_cast<char const*>(layer.data()),
+                        layer.size() * sizeof(Sha256Digest)));
+    }
+    return layers + "e";
+}
+
+// Writes `content` to `path`, creating its directories
+inline void write_file(std::filesystem::path const& path,
+                       std::string const& content) {
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream f(path, std::ios::binary);
+    f << content;
+}
+
+// Path `name` in the temporary directory, unique to this process so that
+// concurrent runs of a test do not share it
+inline std::filesystem::path temp_path(std::string const& name) {
+    return std::filesystem::temp_directory_path() /
+           (name + "-" + std::to_string(getpid()));
+}
+
+// A test directory, removed at the end of the test case
+struct TempDir {
+    explicit TempDir(std::string const& name) : path(temp_path(name)) {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+    ~TempDir() { std::filesystem::remove_all(path); }
+    TempDir(TempDir const&) = delete;
+    TempDir& operator=(TempDir const&) = delete;
+
+    std::filesystem::path path;
+};
+
+}  // namespace bittorrent::test
@@ -0,0 +1,82 @@
+#include "test_helpers.hpp"
+#include "torrent_index.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+// Writes `count` torrents with different lengths to `dir`, and an invalid
+// one. The length of the i-th one is i, in pieces of 16 bytes.
+static std::vector<std::filesystem::path> write_torrents(
+    std::filesystem::path const& dir, size_t count) {
+    std::vector<std::filesystem::path> paths;
+    for (size_t i = 0; i < count; i++) {
+        paths.push_back(dir / (std::to_string(i) + ".torrent"));
+        std::ofstream f(paths.back(), std::ios::binary);
+        f << "d8:announce3:abc13:announce-listll3:abc3:defee4:infod6:length"
+          << "i" << i << "e4:name1:a12:piece lengthi16e6:pieces"
+          << bencode_string(std::string((i + 15) / 16 * 20, 'x')) << "ee";
+    }
+    paths.push_back(dir / "invalid.torrent");
+    std::ofstream(paths.back()) << "d8:announce";
+    return paths;
+}
+
+TEST_CASE("Indexing torrents in parallel", "[torrent][index]") {
+    TempDir dir("torrent_index_test");
+    auto paths = write_torrents(dir.path, 100);
+    auto entries = index_torrents(paths, 4);
+    REQUIRE(entries.size() == paths.size());
+
+    for (size_t i = 0; i < 100; i++) {
+        INFO(i);
+        CHECK_FALSE(entries[i].ec);
+        CHECK(entries[i].path == paths[i]);
+        CHECK(entries[i].total_size == i);
+        CHECK(entries[i].piece_length == 16);
+        CHECK(entries[i].piece_count == (i + 15) / 16);
+        CHECK(entries[i].file_count == 1);
+        CHECK(entries[i].trackers == std::vector<std::string>{"abc", "def"});
+    }
+    CHECK(entries.back().ec);
+}
+
+TEST_CASE("Writing indexes", "[torrent][index]") {
+    IndexEntry entry;
+    entry.path = "a,b.torrent";
+    entry.info_hash.fill(0xab);
+    entry.total_size = 42;
+    entry.piece_length = 16;
+    entry.piece_count = 3;
+    entry.file_count = 1;
+    entry.trackers = {"http://a", "http://b"};
+    IndexEntry failed;
+    failed.ec = std::make_error_code(std::errc::io_error);
+
+    std::ostringstream csv;
+    write_index_csv({entry, failed}, csv);
+    CHECK(csv.str() ==
+          "path,info_hash,total_size,piece_length,piece_count,file_count,"
+          "trackers\n\"a,b.torrent\","
+          "abababababababababababababababababababab"
+          ",42,16,3,1,http://a http://b\n");
+
+    std::ostringstream binary;
+    write_index_binary({entry, failed}, binary);
+    std::string expected = std::string("BTIX\x01\0\0\0\x01\0\0\0", 12) +
+                           std::string(20, '\xab') +
+                           std::string("\x2a\0\0\0\0\0\0\0", 8) +
+                           std::string("\x10\0\0\0\0\0\0\0", 8) +
+                           std::string("\x03\0\0\0", 4) +
+                           std::string("\x01\0\0\0", 4) +
+                           std::string("\x0b\0", 2) + "a,b.torrent" +
+                           std::string("\x02\0", 2) +
+                           std::string("\x08\0", 2) + "http://a" +
+                           std::string("\x08\0", 2) + "http://b";
+    CHECK(binary.str() == expected);
+}
@@ -0,0 +1,214 @@
+#include "lib/utils.hpp"
+#include "merkle.hpp"
+#include "test_helpers.hpp"
+#include "torrent.hpp"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+// removed when the program exits
+static TempDir const temp_dir("torrent_test");
+
+static std::filesystem::path write_torrent(std::string const& content) {
+    auto path = temp_dir.path / "test.torrent";
+    std::ofstream f(path, std::ios::binary);
+    f << content;
+    return path;
+}
+
+TEST_CASE("Info hash is the SHA1 of the encoded info dict", "[torrent]") {
+    // large pieces, and keys that are not stored in Torrent
+    std::string pieces(5000 * 20, 'x');
+    std::string info = "d5:filesle6:lengthi163839900e4:name" +
+                       bencode_string("sample.txt") +
+                       "12:piece lengthi32768e6:pieces" +
+                       bencode_string(pieces) + "7:privatei1e6:source3:abce";
+    std::string content = "d8:announce" + bencode_string("http://tracker/") +
+                          "4:info" + info + "e";
+
+    std::error_code ec;
+    auto torrent = Torrent::parse_torrent(write_torrent(content), ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(torrent);
+
+    auto expected = utils::sha1_hash(
+        reinterpret_cast<uint8_t const*>(info.data()), info.size());
+    CHECK(std::equal(expected.begin(), expected.end(),
+                     torrent->info_hash_raw().begin()));
+    CHECK(torrent->info_hash().size() == 40);
+    CHECK(torrent->announce == "http://tracker/");
+    CHECK(torrent->length == 163839900);
+    CHECK(torrent->name == "sample.txt");
+    CHECK(torrent->piece_length == 32768);
+    CHECK(torrent->pieces == pieces);
+    REQUIRE(torrent->piece_hashes().size() == pieces.size() / 20);
+    Sha1Digest xs;
+    xs.fill('x');
+    CHECK(torrent->piece_hashes()[4999] == xs);
+}
+
+TEST_CASE("Parsing a torrent with missing fields fails", "[torrent]") {
+    std::error_code ec;
+    auto torrent = Torrent::parse_torrent(
+        write_torrent("d8:announce3:abc4:infod6:lengthi1eee"), ec);
+    CHECK(ec);
+    CHECK_FALSE(torrent);
+}
+
+TEST_CASE("Parsing a torrent without one hash per piece fails", "[torrent]") {
+    // 3 pieces of 16 bytes for 42 bytes
+    for (auto [piece_length, hashes] :
+         {std::pair{16, 2}, {16, 4}, {0, 3}, {0, 0}}) {
+        INFO(piece_length << " " << hashes);
+        std::string content =
+            "d8:announce3:abc4:infod6:lengthi42e4:name1:a12:piece lengthi" +
+            std::to_string(piece_length) + "e6:pieces" +
+            bencode_string(std::string(hashes * 20, 'x')) + "ee";
+        std::error_code ec;
+        auto torrent = Torrent::parse_torrent(write_torrent(content), ec);
+        CHECK(ec);
+        CHECK_FALSE(torrent);
+    }
+}
+
+TEST_CASE("Parsing a multi-file torrent with backup trackers", "[torrent]") {
+    std::string content =
+        "d8:announce3:abc13:announce-listll3:abc3:defel3:ghiee4:infod5:files"
+        "ld6:lengthi10e4:pathl1:aeed6:lengthi32e4:pathl1:b1:ceee4:name3:dir"
+        "12:piece lengthi16e6:pieces" +
+        bencode_string(std::string(3 * 20, 'x')) + "ee";
+
+    std::error_code ec;
+    auto torrent = Torrent::parse_torrent(write_torrent(content), ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(torrent);
+    CHECK(torrent->length == 42);
+    CHECK(torrent->file_count == 2);
+    CHECK(torrent->announce_list ==
+          std::vector<std::vector<std::string>>{{"abc", "def"}, {"ghi"}});
+}
+
+TEST_CASE("File paths leaving the torrent directory are rejected",
+          "[torrent]") {
+    for (std::string path : {"l2:..1:ae", "le", "l0:e", "l3:a/be"}) {
+        INFO(path);
+        std::string content = "d8:announce3:abc4:infod5:filesld6:lengthi1e"
+                              "4:path" +
+                              path + "ee4:name3:dir12:piece lengthi16e"
+                                     "6:pieces20:xxxxxxxxxxxxxxxxxxxxee";
+        std::error_code ec;
+        auto torrent = Torrent::parse_torrent(write_torrent(content), ec);
+        CHECK(ec);
+        CHECK_FALSE(torrent);
+    }
+}
+
+// v2 info dict of a single file `name` of `data`, with the v1 keys if
+// `hybrid`
+static std::string v2_info(std::string const& name, std::string const& data,
+                           size_t piece_length, bool hybrid) {
+    std::string info = "d9:file treed" + v2_file_entry(name, data) + "e";
+    if (hybrid) info += "6:lengthi" + std::to_string(data.size()) + "e";
+    info += "12:meta versioni2e4:name" + bencode_string(name) +
+            "12:piece lengthi" + std::to_string(piece_length) + "e";
+    if (hybrid) {
+        size_t count = (data.size() + piece_length - 1) / piece_length;
+        info += "6:pieces" + bencode_string(std::string(count * 20, 'x'));
+    }
+    return info + "e";
+}
+
+static std::string v2_data() { return make_data(3 * merkle::BLOCK_SIZE + 100); }
+
+TEST_CASE("Parsing a v2 torrent with piece layers", "[torrent]") {
+    auto data = v2_data();
+    size_t const piece_length = 2 * merkle::BLOCK_SIZE;
+    std::string info = v2_info("a.txt", data, piece_length, false);
+    std::string content = "d8:announce3:abc4:info" + info + "12:piece layers" +
+                          v2_piece_layers({data}, piece_length) + "e";
+
+    std::error_code ec;
+    auto torrent = Torrent::parse_torrent(write_torrent(content), ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(torrent);
+    CHECK(torrent->has_v2());
+    CHECK_FALSE(torrent->has_v1());
+    CHECK(torrent->meta_version == 2);
+    CHECK(torrent->length == data.size());
+    CHECK(torrent->file_count == 1);
+    CHECK(torrent->piece_hashes().empty());
+
+    REQUIRE(torrent->file_tree.size() == 1);
+    Torrent::TreeFile const& file = torrent->file_tree[0];
+    CHECK(file.path == "a.txt");
+    CHECK(file.length == data.size());
+    CHECK(file.pieces_root == merkle::file_root(bytes(data), data.size()));
+    auto layer = merkle::piece_layer(bytes(data), data.size(), piece_length);
+    CHECK(std::equal(file.piece_layer.begin(), file.piece_layer.end(),
+                     layer.begin(), layer.end()));
+
+    Sha256Digest info_hash = merkle::hash_leaf(
+        reinterpret_cast<uint8_t const*>(info.data()), info.size());
+    CHECK(torrent->info_hash_v2_raw() == info_hash);
+    // known by its truncated v2 info hash to trackers and peers
+    CHECK(std::equal(torrent->info_hash_raw().begin(),
+                     torrent->info_hash_raw().end(), info_hash.begin()));
+}
+
+TEST_CASE("Parsing a hybrid torrent", "[torrent]") {
+    auto data = v2_data();
+    size_t const piece_length = 2 * merkle::BLOCK_SIZE;
+    std::string content = "d8:announce3:abc4:info" +
+                          v2_info("a.txt", data, piece_length, true) + "e";
+
+    std::error_code ec;
+    auto torrent = Torrent::parse_torrent(write_torrent(content), ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(torrent);
+    CHECK(torrent->has_v1());
+    CHECK(torrent->has_v2());
+    CHECK(torrent->length == data.size());
+    CHECK(torrent->piece_hashes().size() == 2);
+    REQUIRE(torrent->file_tree.size() == 1);
+    // without piece layers, to be fetched from peers
+    CHECK(torrent->file_tree[0].piece_layer.empty());
+}
+
+TEST_CASE("Invalid v2 torrents are rejected", "[torrent]") {
+    auto data = v2_data();
+    size_t const piece_length = 2 * merkle::BLOCK_SIZE;
+
+    SECTION("Piece layer not matching the pieces root") {
+        std::string layers = v2_piece_layers({data}, piece_length);
+        layers[layers.size() - 2] ^= 1;
+        std::string content = "d8:announce3:abc4:info" +
+                              v2_info("a.txt", data, piece_length, false) +
+                              "12:piece layers" + layers + "e";
+        std::error_code ec;
+        CHECK_FALSE(Torrent::parse_torrent(write_torrent(content), ec));
+        CHECK(ec);
+    }
+
+    SECTION("Piece length not a power of two") {
+        std::string content = "d8:announce3:abc4:info" +
+                              v2_info("a.txt", data, 3 * 16384, false) + "e";
+        std::error_code ec;
+        CHECK_FALSE(Torrent::parse_torrent(write_torrent(content), ec));
+        CHECK(ec);
+    }
+
+    SECTION("Path leaving the torrent directory") {
+        std::string content = "d8:announce3:abc4:info" +
+                              v2_info("..", data, piece_length, false) + "e";
+        std::error_code ec;
+        CHECK_FALSE(Torrent::parse_torrent(write_torrent(content), ec));
+        CHECK(ec);
+    }
+}
@@ -0,0 +1,54 @@
+#include "verify_pool.hpp"
+#include "lib/utils.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+TEST_CASE("Verify pool reports passed and failed pieces", "[verify_pool]") {
+    VerifyPool pool(2, 4);
+    // pieces of the same size, batched by the workers, and a last shorter one
+    size_t const count = 40;
+    for (size_t i = 0; i < count; i++) {
+        size_t length = i == count - 1 ? 1000 : 16384;
+        std::string data = make_data(length, i);
+        std::vector<uint8_t> piece(data.begin(), data.end());
+        Sha1Digest expected = utils::sha1_digest(piece.data(), piece.size());
+        // every 5th piece is corrupted
+        if (i % 5 == 0) piece[i % length] ^= 1;
+        pool.submit(i, std::move(piece), expected);
+    }
+
+    std::set<size_t> seen;
+    while (auto event = pool.wait()) {
+        INFO(event->piece_index);
+        CHECK(seen.insert(event->piece_index).second);
+        CHECK(event->passed == (event->piece_index % 5 != 0));
+        CHECK(event->data.size() ==
+              (event->piece_index == count - 1 ? 1000 : 16384));
+    }
+    CHECK(seen.size() == count);
+    CHECK(!pool.poll());
+
+    VerifyPoolStats stats = pool.stats();
+    CHECK(stats.submitted == count);
+    CHECK(stats.passed == count - count / 5);
+    CHECK(stats.failed == count / 5);
+    CHECK(stats.queue_depth == 0);
+    CHECK(stats.in_flight == 0);
+    CHECK(stats.max_queue_depth >= 1);
+    CHECK(stats.max_queue_depth <= 4);
+    CHECK(stats.max_latency <= stats.total_latency);
+}
+
+TEST_CASE("Verify pool without pieces", "[verify_pool]") {
+    VerifyPool pool(1, 1);
+    CHECK(!pool.poll());
+    CHECK(!pool.wait());
+    CHECK(pool.stats().submitted == 0);
+}
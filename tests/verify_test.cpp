@@ -0,0 +1,199 @@
+#include "merkle.hpp"
+#include "test_helpers.hpp"
+#include "torrent.hpp"
+#include "verify.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace bittorrent;
+using namespace bittorrent::test;
+
+static std::unique_ptr<Torrent> parse(std::filesystem::path const& path,
+                                      std::string const& info) {
+    write_file(path, "d8:announce3:abc4:info" + info + "e");
+    std::error_code ec;
+    auto torrent = Torrent::parse_torrent(path, ec);
+    REQUIRE_FALSE(ec);
+    return torrent;
+}
+
+TEST_CASE("Verifying a single-file torrent", "[verify]") {
+    TempDir dir("verify_test");
+    size_t const piece_length = 16384;
+    // 40 full pieces, batched, and a shorter last one
+    std::string data = make_data(40 * piece_length + 1000, 1);
+    auto torrent = parse(
+        dir.path / "single.torrent",
+        "d6:lengthi" + std::to_string(data.size()) + "e4:name4:data" +
+            "12:piece lengthi" + std::to_string(piece_length) +
+            "e6:pieces" + bencode_string(piece_hashes(data, piece_length)) +
+            "e");
+    write_file(dir.path / "data", data);
+
+    for (unsigned threads : {1, 3}) {
+        VerifyReport report = verify_content(*torrent, dir.path / "data",
+                                             threads, 4 * piece_length);
+        CHECK(report.piece_count == 41);
+        CHECK(report.mismatches.empty());
+        CHECK(report.file_errors.empty());
+        CHECK(report.bytes_hashed == data.size());
+        CHECK(report.bitfield == std::vector<uint8_t>{0xff, 0xff, 0xff, 0xff,
+                                                      0xff, 0x80});
+    }
+
+    // corrupt pieces 3 and 40
+    data[3 * piece_length + 5] ^= 1;
+    data[data.size() - 1] ^= 1;
+    write_file(dir.path / "data", data);
+    VerifyReport report = verify_content(*torrent, dir.path / "data", 2);
+    CHECK(report.mismatches == std::vector<size_t>{3, 40});
+    CHECK_FALSE(report.has_piece(3));
+    CHECK(report.has_piece(4));
+    CHECK(report.bitfield[0] == 0xef);
+
+    // missing file
+    report = verify_content(*torrent, dir.path / "missing");
+    CHECK(report.mismatches.size() == 41);
+    CHECK(report.file_errors.size() == 1);
+    CHECK(report.bytes_hashed == 0);
+}
+
+TEST_CASE("Verifying a multi-file torrent", "[verify]") {
+    TempDir dir("verify_test");
+    size_t const piece_length = 1024;
+    // pieces span files, one file is empty
+    std::vector<std::pair<std::string, std::string>> files = {
+        {"a", make_data(3000, 2)},
+        {"empty", ""},
+        {"sub/b", make_data(500, 3)},
+        {"sub/c", make_data(20000, 4)}};
+    std::string data, list;
+    for (auto const& [path, content] : files) {
+        data += content;
+        std::string components;
+        for (size_t begin = 0, end; begin <= path.size(); begin = end + 1) {
+            end = std::min(path.find('/', begin), path.size());
+            components += bencode_string(path.substr(begin, end - begin));
+        }
+        list += "d6:lengthi" + std::to_string(content.size()) + "e4:pathl" +
+                components + "ee";
+    }
+    auto torrent = parse(dir.path / "multi.torrent",
+                         "d5:filesl" + list + "e4:name3:dir" +
+                             "12:piece lengthi" + std::to_string(piece_length) +
+                             "e6:pieces" +
+                             bencode_string(piece_hashes(data, piece_length)) +
+                             "e");
+    REQUIRE(torrent->files.size() == 4);
+    CHECK(torrent->files[2].path == std::filesystem::path("sub") / "b");
+
+    for (auto const& [path, content] : files)
+        write_file(dir.path / "dir" / path, content);
+
+    size_t const piece_count = (data.size() + piece_length - 1) / piece_length;
+    VerifyReport report = verify_content(*torrent, dir.path / "dir");
+    CHECK(report.piece_count == piece_count);
+    CHECK(report.mismatches.empty());
+    CHECK(report.bytes_hashed == data.size());
+
+    // b is bytes 3000 to 3500, in piece 2 and 3
+    std::filesystem::remove(dir.path / "dir" / "sub" / "b");
+    report = verify_content(*torrent, dir.path / "dir");
+    CHECK(report.mismatches == std::vector<size_t>{2, 3});
+    CHECK(report.file_errors.size() == 1);
+
+    // a shorter file only fails the pieces of the missing part
+    write_file(dir.path / "dir" / "sub" / "b", files[2].second);
+    write_file(dir.path / "dir" / "sub" / "c",
+               files[3].second.substr(0, 10000));
+    report = verify_content(*torrent, dir.path / "dir");
+    REQUIRE_FALSE(report.mismatches.empty());
+    CHECK(report.mismatches.front() == (3500 + 10000) / piece_length);
+    CHECK(report.mismatches.back() == piece_count - 1);
+}
+
+TEST_CASE("Verifying a single-file v2 torrent", "[verify]") {
+    TempDir dir("verify_test");
+    std::string data = make_data(3 * merkle::BLOCK_SIZE, 5);
+    auto torrent = parse(dir.path / "v2.torrent",
+                         "d9:file treed" + v2_file_entry("data", data) +
+                             "e12:meta versioni2e4:name4:data"
+                             "12:piece lengthi" +
+                             std::to_string(4 * merkle::BLOCK_SIZE) + "ee");
+    REQUIRE_FALSE(torrent->has_v1());
+    write_file(dir.path / "data", data);
+
+    VerifyReport report = verify_content(*torrent, dir.path / "data");
+    CHECK(report.piece_count == 1);
+    CHECK(report.mismatches.empty());
+    CHECK(report.bytes_hashed == data.size());
+    CHECK(report.bitfield == std::vector<uint8_t>{0x80});
+
+    data[2 * merkle::BLOCK_SIZE] ^= 1;
+    write_file(dir.path / "data", data);
+    report = verify_content(*torrent, dir.path / "data");
+    CHECK(report.mismatches == std::vector<size_t>{0});
+}
+
+TEST_CASE("Verifying a multi-file v2 torrent", "[verify]") {
+    TempDir dir("verify_test");
+    size_t const piece_length = 2 * merkle::BLOCK_SIZE;
+    // each file starts a new piece: a is pieces 0 to 3, b piece 4 (of 2
+    // blocks) and c pieces 5 to 9
+    std::string a = make_data(3 * piece_length + 5000, 6);
+    std::string b = make_data(merkle::BLOCK_SIZE + 10, 7);
+    std::string c = make_data(5 * piece_length, 8);
+    std::string info = "d9:file treed" + v2_file_entry("a", a) +
+                       v2_file_entry("empty", "") + "3:subd" +
+                       v2_file_entry("b", b) + v2_file_entry("c", c) +
+                       "ee12:meta versioni2e4:name3:dir12:piece lengthi" +
+                       std::to_string(piece_length) + "ee";
+    auto write_content = [&] {
+        write_file(dir.path / "dir" / "a", a);
+        write_file(dir.path / "dir" / "empty", "");
+        write_file(dir.path / "dir" / "sub" / "b", b);
+        write_file(dir.path / "dir" / "sub" / "c", c);
+    };
+    write_content();
+    size_t const size = a.size() + b.size() + c.size();
+
+    SECTION("With piece layers") {
+        auto torrent = parse(dir.path / "layers.torrent",
+                             info + "12:piece layers" +
+                                 v2_piece_layers({a, b, c}, piece_length));
+        REQUIRE(torrent->v2_piece_count() == 10);
+        VerifyReport report = verify_content(*torrent, dir.path / "dir", 2);
+        CHECK(report.piece_count == 10);
+        CHECK(report.mismatches.empty());
+        CHECK(report.bytes_hashed == size);
+
+        // one piece of a, and b
+        a[2 * piece_length + 1] ^= 1;
+        b[b.size() - 1] ^= 1;
+        write_content();
+        report = verify_content(*torrent, dir.path / "dir");
+        CHECK(report.mismatches == std::vector<size_t>{2, 4});
+
+        std::filesystem::remove(dir.path / "dir" / "sub" / "c");
+        report = verify_content(*torrent, dir.path / "dir");
+        CHECK(report.mismatches == std::vector<size_t>{2, 4, 5, 6, 7, 8, 9});
+        CHECK(report.file_errors.size() == 1);
+    }
+
+    SECTION("Without piece layers") {
+        auto torrent = parse(dir.path / "roots.torrent", info);
+        REQUIRE(torrent->file_tree[0].piece_layer.empty());
+        VerifyReport report = verify_content(*torrent, dir.path / "dir");
+        CHECK(report.piece_count == 10);
+        CHECK(report.mismatches.empty());
+
+        // the pieces of c are only checked against its pieces root
+        c[piece_length] ^= 1;
+        write_content();
+        report = verify_content(*torrent, dir.path / "dir");
+        CHECK(report.mismatches == std::vector<size_t>{5, 6, 7, 8, 9});
+    }
+}
@@ -0,0 +1,254 @@
+// Peer wire receive benchmark over a loopback TCP connection: a sender
+// thread writes piece messages of 16 KiB blocks, each followed by a few have
+// messages. The receiver frames them one recv per field (the previous
+// Peer::read_message_raw) or with a MessageReader, and writes the blocks to
+// a piece buffer: copied from the framed message, or received in place
+// with read_block.
+// The requests of a piece are then sent one send per message (the previous
+// Peer::send_message) and queued in a corked MessageWriter.
+// Usage: wire_bench [megabytes per run]
+#include "message.hpp"
+#include "message_reader.hpp"
+#include "message_writer.hpp"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace bittorrent;
+
+constexpr size_t BLOCK_SIZE = 16 * 1024;
+constexpr size_t HAVES_PER_BLOCK = 4;
+constexpr size_t PIECE_SIZE = 1 << 20;
+
+// Connected loopback sockets: {receiver, sender}
+static std::pair<int, int> connect_loopback() {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), size) != 0 ||
+        listen(listener, 1) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr*>(&address), &size) !=
+            0) {
+        std::perror("listen");
+        std::exit(1);
+    }
+    int sender = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(sender, reinterpret_cast<sockaddr*>(&address), size) != 0) {
+        std::perror("connect");
+        std::exit(1);
+    }
+    int receiver = accept(listener, nullptr, nullptr);
+    close(listener);
+    return {receiver, sender};
+}
+
+// One block and its haves, serialized
+static std::vector<uint8_t> make_round() {
+    std::vector<uint8_t> payload(8 + BLOCK_SIZE, 0xAB);
+    std::vector<uint8_t> round =
+        Message(message_type::piece, std::move(payload)).serialize();
+    for (size_t i = 0; i < HAVES_PER_BLOCK; i++) {
+        auto have =
+            Message(message_type::have, std::vector<uint8_t>(4, 1)).serialize();
+        round.insert(round.end(), have.begin(), have.end());
+    }
+    return round;
+}
+
+static void send_rounds(int fd, std::vector<uint8_t> const& round,
+                        size_t rounds) {
+    for (size_t i = 0; i < rounds; i++)
+        for (size_t sent = 0; sent < round.size();) {
+            ssize_t r = send(fd, round.data() + sent, round.size() - sent, 0);
+            if (r <= 0) return;
+            sent += static_cast<size_t>(r);
+        }
+}
+
+static bool recv_exact(int fd, uint8_t* buffer, size_t size) {
+    for (size_t received = 0; received < size;) {
+        ssize_t r = recv(fd, buffer + received, size - received, 0);
+        if (r <= 0) return false;
+        received += static_cast<size_t>(r);
+    }
+    return true;
+}
+
+// length, id and payload each with their own recv, into new vectors
+static size_t receive_per_field(int fd, size_t messages, uint64_t& calls) {
+    std::vector<uint8_t> piece(PIECE_SIZE);
+    size_t offset = 0;
+    size_t checksum = 0;
+    for (size_t i = 0; i < messages; i++) {
+        uint8_t length_bytes[4];
+        if (!recv_exact(fd, length_bytes, 4)) break;
+        uint32_t length;
+        std::memcpy(&length, length_bytes, 4);
+        length = ntohl(length);
+        std::vector<uint8_t> id(1);
+        if (!recv_exact(fd, id.data(), 1)) break;
+        std::vector<uint8_t> payload(length - 1);
+        if (!recv_exact(fd, payload.data(), payload.size())) break;
+        checksum += id[0] + payload.size();
+        calls += 3;
+        if (id[0] != static_cast<uint8_t>(message_type::piece)) continue;
+        // the block, copied out of the payload (previously twice)
+        std::vector<uint8_t> block(payload.begin() + 8, payload.end());
+        offset = offset + block.size() > piece.size() ? 0 : offset;
+        std::memcpy(piece.data() + offset, block.data(), block.size());
+        offset += block.size();
+    }
+    return checksum;
+}
+
+static size_t receive_buffered(int fd, size_t messages, uint64_t& calls) {
+    MessageReader reader;
+    std::vector<uint8_t> piece(PIECE_SIZE);
+    size_t offset = 0;
+    size_t checksum = 0;
+    std::error_code ec;
+    for (size_t i = 0; i < messages; i++) {
+        auto message = reader.read(fd, ec);
+        if (!message) break;
+        checksum += message->id + message->payload.size();
+        if (message->type() != message_type::piece) continue;
+        auto block = message->payload.subspan(8);
+        offset = offset + block.size() > piece.size() ? 0 : offset;
+        std::memcpy(piece.data() + offset, block.data(), block.size());
+        offset += block.size();
+    }
+    calls = reader.recv_calls();
+    return checksum;
+}
+
+static size_t receive_in_place(int fd, size_t messages, uint64_t& calls) {
+    MessageReader reader;
+    std::vector<uint8_t> piece(PIECE_SIZE);
+    size_t offset = 0;
+    size_t checksum = 0;
+    std::error_code ec;
+    for (size_t i = 0; i < messages; i++) {
+        auto message = reader.read_until_block(fd, ec);
+        if (!message) break;
+        checksum += message->id + message->payload.size();
+        size_t size = reader.pending_block();
+        if (size == 0) continue;
+        offset = offset + size > piece.size() ? 0 : offset;
+        if (reader.read_block(fd, piece.data() + offset)) break;
+        checksum += size;
+        offset += size;
+    }
+    calls = reader.recv_calls();
+    std::printf("  (%.0f%% of the block bytes received in place)\n",
+                100.0 * reader.block_bytes_direct() /
+                    std::max<uint64_t>(1, reader.block_bytes_direct() +
+                                              reader.block_bytes_copied()));
+    return checksum;
+}
+
+template <typename F>
+static void run(char const* name, size_t rounds, F receive) {
+    auto [receiver, sender] = connect_loopback();
+    std::vector<uint8_t> round = make_round();
+    size_t const messages = rounds * (1 + HAVES_PER_BLOCK);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread thread(send_rounds, sender, std::cref(round), rounds);
+    uint64_t calls = 0;
+    size_t checksum = receive(receiver, messages, calls);
+    thread.join();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    close(sender);
+    close(receiver);
+
+    std::printf("  %-10s %10.0f messages/s %8.3f GB/s %6.2f recv/message%s\n",
+                name, messages / elapsed.count(),
+                rounds * round.size() / elapsed.count() / 1e9,
+                static_cast<double>(calls) / messages,
+                checksum == 0 ? " (nothing received)" : "");
+}
+
+// Requests for a piece of 64 blocks
+constexpr size_t REQUESTS_PER_PIECE = 64;
+
+static uint64_t send_per_message(int fd, size_t pieces) {
+    uint64_t calls = 0;
+    for (size_t piece = 0; piece < pieces; piece++)
+        for (size_t i = 0; i < REQUESTS_PER_PIECE; i++) {
+            std::vector<uint8_t> message =
+                Message::make_request(piece, i * BLOCK_SIZE, BLOCK_SIZE)
+                    .serialize();
+            for (size_t sent = 0; sent < message.size(); calls++) {
+                ssize_t r = send(fd, message.data() + sent,
+                                 message.size() - sent, 0);
+                if (r <= 0) return calls;
+                sent += static_cast<size_t>(r);
+            }
+        }
+    return calls;
+}
+
+static uint64_t send_queued(int fd, size_t pieces) {
+    MessageWriter writer;
+    for (size_t piece = 0; piece < pieces; piece++) {
+        writer.cork();
+        for (size_t i = 0; i < REQUESTS_PER_PIECE; i++)
+            writer.queue(
+                Message::make_request(piece, i * BLOCK_SIZE, BLOCK_SIZE));
+        if (writer.uncork(fd)) break;
+    }
+    return writer.send_calls();
+}
+
+template <typename F>
+static void run_send(char const* name, size_t pieces, F send_requests) {
+    auto [receiver, sender] = connect_loopback();
+    // drained, and dropped
+    std::thread thread([receiver = receiver] {
+        std::vector<uint8_t> buffer(1 << 16);
+        while (recv(receiver, buffer.data(), buffer.size(), 0) > 0) {
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t calls = send_requests(sender, pieces);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    shutdown(sender, SHUT_WR);
+    thread.join();
+    close(sender);
+    close(receiver);
+
+    size_t const messages = pieces * REQUESTS_PER_PIECE;
+    std::printf("  %-10s %10.0f messages/s %6.3f send/message\n", name,
+                messages / elapsed.count(),
+                static_cast<double>(calls) / messages);
+}
+
+int main(int argc, char* argv[]) {
+    size_t total = (argc > 1 ? std::atoi(argv[1]) : 1024) * size_t{1 << 20};
+    size_t rounds = std::max<size_t>(1, total / BLOCK_SIZE);
+
+    std::printf("piece messages of %zu KiB, %zu haves each\n",
+                BLOCK_SIZE / 1024, HAVES_PER_BLOCK);
+    run("per field", rounds, receive_per_field);
+    run("buffered", rounds, receive_buffered);
+    run("in place", rounds, receive_in_place);
+
+    size_t pieces = std::max<size_t>(1, rounds / REQUESTS_PER_PIECE);
+    std::printf("requests, %zu per piece\n", REQUESTS_PER_PIECE);
+    run_send("per message", pieces, send_per_message);
+    run_send("queued", pieces, send_queued);
+    return 0;
+}